@@ -0,0 +1,254 @@
+#include "BatchScheduler.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QStringList>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <opencv/highgui.h>
+
+//Number of full BGR frames a single pipeline keeps alive at once (handler, processing
+//copy, Lab conversion, per-subject masks...). Used to bound concurrency by memory.
+const int FRAMES_PER_PIPELINE = 12;
+
+//The container's frame count is an estimate (from its duration and frame rate), so a complete
+//video may end this many frames, or this share of its frames, before it.
+const int FRAME_COUNT_SLACK = 5;
+const double FRAME_COUNT_SLACK_RATIO = 0.01;
+
+static const char* batchVideoTypes[] = {"avi", "mp4", "mpg", "mov"};
+
+//Longest first; the name breaks ties so the order never depends on the file system.
+static bool longestFirst(const BatchJob& a, const BatchJob& b) {
+    if (a.frameCount != b.frameCount)
+        return a.frameCount > b.frameCount;
+    return a.name < b.name;
+}
+
+static bool byName(const BatchJob& a, const BatchJob& b) {
+    return a.name < b.name;
+}
+
+//Returns the memory available to new processes in bytes, or -1 if unknown.
+static qint64 availableMemory() {
+    QFile meminfo("/proc/meminfo");
+    if (! meminfo.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+    QTextStream in(&meminfo);
+    while (! in.atEnd()) {
+        QStringList fields = in.readLine().simplified().split(' ');
+        if (fields.size() >= 2 && fields[0] == "MemAvailable:")
+            return fields[1].toLongLong() * 1024;
+    }
+    return -1;
+}
+
+BatchScheduler::BatchScheduler(QObject* parent) :
+    QObject(parent), maxConcurrentJobs(0), concurrency(0), nextJob(0), finishedJobs(0)
+{
+}
+
+BatchScheduler::~BatchScheduler() {
+    QMap<HeadlessRunner*, int>::iterator it;
+    for (it = activeRunners.begin(); it != activeRunners.end(); it++)
+        delete it.key();
+}
+
+bool BatchScheduler::addDirectory(QString dirPath) {
+    QDir dir(dirPath);
+    if (! dir.exists()) {
+        error = "No such directory: " + dirPath;
+        return false;
+    }
+    QStringList filters;
+    for (int i = 0; i < 4; i++)
+        filters << QString("*.") + batchVideoTypes[i] << QString("*.") + QString(batchVideoTypes[i]).toUpper();
+
+    QFileInfoList videos = dir.entryInfoList(filters, QDir::Files, QDir::Name);
+    for (int i = 0; i < videos.size(); i++) {
+        QString base = dir.filePath(videos[i].completeBaseName());
+        if (! QFileInfo(base + ".session").exists()) {
+            qWarning() << "Batch Scheduler: Skipping " << videos[i].fileName() << ", no session file.";
+            continue;
+        }
+        if (! addJob(videos[i].filePath(), base + ".session", base + ".tracks.csv"))
+            return false;
+    }
+    return true;
+}
+
+bool BatchScheduler::addManifest(QString manifestPath) {
+    QFile manifest(manifestPath);
+    if (! manifest.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "Could not open " + manifestPath;
+        return false;
+    }
+    //Relative paths are taken relative to the manifest.
+    QDir base = QFileInfo(manifestPath).absoluteDir();
+    QTextStream in(&manifest);
+    int lineNumber = 0;
+    while (! in.atEnd()) {
+        QString line = in.readLine();
+        lineNumber++;
+        int comment = line.indexOf('#');
+        if (comment > -1)
+            line.truncate(comment);
+        line = line.simplified();
+        if (line.isEmpty())
+            continue;
+        QStringList fields = line.split(' ');
+        if (fields.size() != 3) {
+            error = QString("Malformed entry on line %1 of %2").arg(lineNumber).arg(manifestPath);
+            return false;
+        }
+        if (! addJob(base.absoluteFilePath(fields[0]), base.absoluteFilePath(fields[1]), base.absoluteFilePath(fields[2])))
+            return false;
+    }
+    return true;
+}
+
+bool BatchScheduler::addJob(QString videoPath, QString sessionPath, QString outputPath) {
+    BatchJob job;
+    job.name = QFileInfo(videoPath).fileName();
+    job.videoPath = videoPath;
+    job.sessionPath = sessionPath;
+    job.outputPath = outputPath;
+    job.succeeded = false;
+    job.framesProcessed = 0;
+    job.elapsedMs = 0;
+    if (! probeJob(job)) {
+        error = "Could not open video " + videoPath;
+        return false;
+    }
+    jobs.append(job);
+    return true;
+}
+
+//Videos analyzed before are not opened again, see VideoCache.
+bool BatchScheduler::probeJob(BatchJob& job) {
+    VideoProbe probe;
+    if (! videoCache.probe(job.videoPath, probe))
+        return false;
+    job.frameCount = probe.frameCount;
+    job.width = probe.width;
+    job.height = probe.height;
+    return true;
+}
+
+void BatchScheduler::setMaxConcurrentJobs(int jobs) {
+    maxConcurrentJobs = jobs;
+}
+
+//One pipeline per core (the ProcessingThread is the only busy thread of a pipeline),
+//reduced if the frames of that many pipelines would not fit in available memory.
+int BatchScheduler::autoConcurrency() {
+    int jobsByCores = qMax(1, QThread::idealThreadCount());
+
+    qint64 largestFrame = 0;
+    for (int i = 0; i < jobs.size(); i++)
+        largestFrame = qMax(largestFrame, (qint64)jobs[i].width * jobs[i].height * 3);
+
+    qint64 memory = availableMemory();
+    if (memory < 0 || largestFrame == 0)
+        return jobsByCores;
+    int jobsByMemory = qMax((qint64)1, memory / (largestFrame * FRAMES_PER_PIPELINE));
+    return qMin(jobsByCores, jobsByMemory);
+}
+
+bool BatchScheduler::start() {
+    if (jobs.isEmpty()) {
+        error = "No jobs to run.";
+        return false;
+    }
+    std::sort(jobs.begin(), jobs.end(), longestFirst);
+
+    concurrency = maxConcurrentJobs > 0 ? maxConcurrentJobs : autoConcurrency();
+    concurrency = qMin(concurrency, jobs.size());
+    qWarning("Batch Scheduler: Running %d jobs, %d at a time.", jobs.size(), concurrency);
+
+    for (int i = 0; i < concurrency; i++)
+        launchNext();
+    return true;
+}
+
+void BatchScheduler::launchNext() {
+    while (nextJob < jobs.size()) {
+        int index = nextJob++;
+        BatchJob& job = jobs[index];
+
+        HeadlessRunner* runner = new HeadlessRunner();
+        connect(runner, SIGNAL(finished()), this, SLOT(onJobFinished()));
+        QElapsedTimer timer;
+        timer.start();
+        if (runner->start(job.videoPath, job.sessionPath, job.outputPath)) {
+            activeRunners[runner] = index;
+            activeTimers[runner] = timer;
+            return;
+        }
+        //Failed jobs are reported and the slot goes to the next one.
+        job.error = runner->errorString();
+        qWarning() << "Batch Scheduler: " << job.name << " failed: " << job.error;
+        delete runner;
+        finishedJobs++;
+    }
+    //Queued, so a batch in which every job fails to start still finishes inside the event loop.
+    if (activeRunners.isEmpty() && finishedJobs == jobs.size())
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+}
+
+void BatchScheduler::onJobFinished() {
+    HeadlessRunner* runner = qobject_cast<HeadlessRunner*>(sender());
+    if (! runner || ! activeRunners.contains(runner))
+        return;
+
+    BatchJob& job = jobs[activeRunners[runner]];
+    job.elapsedMs = activeTimers[runner].elapsed();
+    job.framesProcessed = runner->framesProcessed();
+    //Runners only finish at the end of the video. Failed writes, or a video that ended well
+    //before the frame count of its container, leave the output incomplete.
+    job.error = runner->errorString();
+    int slack = qMax(FRAME_COUNT_SLACK, (int)(job.frameCount * FRAME_COUNT_SLACK_RATIO));
+    if (job.error.isEmpty() && job.framesProcessed < job.frameCount - slack)
+        job.error = QString("Stopped after %1 of %2 frames.").arg(job.framesProcessed).arg(job.frameCount);
+    job.succeeded = job.error.isEmpty();
+    if (job.succeeded)
+        qWarning("Batch Scheduler: %s done, %d frames in %.1f s.", qPrintable(job.name),
+                 job.framesProcessed, job.elapsedMs / 1000.0);
+    else qWarning() << "Batch Scheduler: " << job.name << " failed: " << job.error;
+
+    activeRunners.remove(runner);
+    activeTimers.remove(runner);
+    runner->deleteLater();
+    finishedJobs++;
+
+    launchNext();
+}
+
+int BatchScheduler::jobCount() {
+    return jobs.size();
+}
+
+QString BatchScheduler::report() {
+    QList<BatchJob> sorted = jobs;
+    std::sort(sorted.begin(), sorted.end(), byName);
+
+    QString out;
+    QTextStream stream(&out);
+    stream << "video,frames,seconds,fps,status\n";
+    for (int i = 0; i < sorted.size(); i++) {
+        const BatchJob& job = sorted[i];
+        double seconds = job.elapsedMs / 1000.0;
+        double fps = seconds > 0 ? job.framesProcessed / seconds : 0;
+        stream << job.name << ',' << job.framesProcessed << ',' << seconds << ',' << fps << ','
+               << (job.succeeded ? QString("ok") : "failed: " + job.error) << '\n';
+    }
+    stream.flush();
+    return out;
+}
+
+QString BatchScheduler::errorString() {
+    return error;
+}
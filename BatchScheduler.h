@@ -0,0 +1,77 @@
+#ifndef BATCHSCHEDULER_H
+#define BATCHSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QElapsedTimer>
+
+#include "HeadlessRunner.h"
+
+//A single video to be tracked by the BatchScheduler.
+struct BatchJob {
+    QString name;
+    QString videoPath;
+    QString sessionPath;
+    QString outputPath;
+    //Probed from the container before scheduling.
+    int frameCount;
+    int width;
+    int height;
+    //Filled in once the job has finished.
+    bool succeeded;
+    QString error;
+    int framesProcessed;
+    qint64 elapsedMs;
+};
+
+/*
+ * Runs many independent HeadlessRunners concurrently, one per video.
+ * Jobs come either from a directory (every video next to a <name>.session file) or
+ * from a manifest file with one "<video> <session> <tracks.csv>" entry per line.
+ *
+ * Every job has its own pipeline and output file and shares no tracking state with
+ * the others, so results do not depend on how the jobs happen to be interleaved.
+ * The longest videos are started first so a long job does not end up running alone.
+ */
+class BatchScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    BatchScheduler(QObject* parent = 0);
+    ~BatchScheduler();
+
+    bool addDirectory(QString dirPath);
+    bool addManifest(QString manifestPath);
+    //0 sizes the number of concurrent jobs from the core count and available memory.
+    void setMaxConcurrentJobs(int jobs);
+
+    bool start();
+    int jobCount();
+    //Per-job throughput as CSV, sorted by job name.
+    QString report();
+    QString errorString();
+signals:
+    void finished();
+private slots:
+    void onJobFinished();
+private:
+    QList<BatchJob> jobs;
+    QMap<HeadlessRunner*, int> activeRunners;
+    QMap<HeadlessRunner*, QElapsedTimer> activeTimers;
+    int maxConcurrentJobs;
+    int concurrency;
+    int nextJob;
+    int finishedJobs;
+    QString error;
+    //Probes of videos seen in earlier batches.
+    VideoCache videoCache;
+
+    bool addJob(QString videoPath, QString sessionPath, QString outputPath);
+    bool probeJob(BatchJob& job);
+    int autoConcurrency();
+    void launchNext();
+};
+
+#endif // BATCHSCHEDULER_H
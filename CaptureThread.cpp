@@ -1,12 +1,17 @@
 #include "CaptureThread.h"
 
 #include <QtDebug>
+#include "Trace.h"
+#include "Timeline.h"
 //config later
 
 //CONSTRUCTOR
 CaptureThread::CaptureThread(ImageHandler* imageHandler) :QThread(), imageHandler(imageHandler) {
     playing = false;
     stopped = false;
+    lastQueriedIndex = -1;
+    lastFrame = -1;
+    metrics = NULL;
     this->imageHandler = imageHandler;
 }
 
@@ -15,6 +20,7 @@ bool CaptureThread::loadVideo(QString fileName) {
     const char *p = byteArray.data();
 
     cap = cvCaptureFromFile(p);
+    lastQueriedIndex = -1;
     if (cap) {
         //this->stepForward();
         return true;
@@ -26,14 +32,16 @@ void CaptureThread::dropVideo() {
     qDebug() << "CaptureThread: Dropping Video...";
     cvReleaseCapture(&cap);
 
-    playingMutex.lock();
+    stateMutex.lock();
     playing = false;
+    imageHandler->setPlaying(false);
+    stateChanged.wakeAll();
 
     //dropVideo and ProcessingThead::dropFrame are called within the same context
     //that way, dropFrame will only clear its references
     //ImageHandler's clear methods must be called too
 
-    playingMutex.unlock();
+    stateMutex.unlock();
     qDebug() << "CaptureThread: Video Dropped.";
 }
 
@@ -42,118 +50,211 @@ void CaptureThread::run()
     qDebug() << "Capture thread started...";
     qDebug() << cvGetCaptureProperty(cap, CV_CAP_PROP_FRAME_COUNT);
     while (1) {
+        //Sleep until there is something to do, a paused video costs no CPU.
+        stateMutex.lock();
+        while (!playing && !stopped && commands.isEmpty())
+            stateChanged.wait(&stateMutex);
+
         //STOP CHECK
-        stoppedMutex.lock();
         if (stopped) {
             stopped = false;
-            stoppedMutex.unlock();
+            stateMutex.unlock();
             break;
-        } stoppedMutex.unlock();
+        }
         //END STOP CHECK
 
-        //qDebug() << "Capture Thread: Locking Playing Mutex.";
-        playingMutex.lock();
-        if (playing) {
-            //qDebug() << "Capture Thread: Passed Playing Check...";
-            playingMutex.unlock();
-            //Wait until the ImageHandler can read in an image...
-            //This method will block until it can.
+        QQueue<TransportCommand> pending;
+        pending.swap(commands);
+        stateMutex.unlock();
 
-            qDebug() << "Capture Thread: Waiting for read slot.";
-            imageHandler->getReadSlot();
-            qDebug() << "Capture Thread: Acquired read slot.";
+        //Transport commands go first, then the play state they left behind decides
+        //whether to read the next frame.
+        if (!pending.isEmpty()) {
+            runCommands(pending);
+            continue;
+        }
 
-            updateFrame(imageHandler->currentIndex()+1);
+        //Wait until the ImageHandler can read in an image...
+        //This method will block until it can.
+        TRACE_DEBUG("Capture Thread: Waiting for read slot.");
+        imageHandler->getReadSlot();
+        TRACE_DEBUG("Capture Thread: Acquired read slot.");
 
-            qDebug() << "Capture Thread: Releasing process slot.";
+        //Only wake the ProcessingThread if there actually is a new frame.
+        if (updateFrame(imageHandler->currentIndex()+1)) {
+            TRACE_DEBUG("Capture Thread: Releasing process slot.");
             imageHandler->releaseProcSlot();
-        }
-        playingMutex.unlock();
+        } else imageHandler->releaseReadSlot();
     } qDebug() << "Stopping Capture Thread...";
 }
 
-void CaptureThread::updateFrame(int newIndex) {
-    qDebug() << "Capture Thread: Updating frame";
+//Returns true if a new frame was handed to the ImageHandler.
+bool CaptureThread::updateFrame(int newIndex) {
+    TRACE_DEBUG("Capture Thread: Updating frame %1", newIndex);
+    bool updated = false;
     if (newIndex < 0) {
         qDebug() << "Capture Thread: New index received is invalid.";
-        pause();
-        updateFrame(0);
+        setPlaying(false);
+        updated = updateFrame(0);
     }
     else {
         //qDebug() << "Capture Thread: Attempting to change current frame position to: " << newIndex;
         Mat tempFrame;
-        cvSetCaptureProperty(cap, CV_CAP_PROP_POS_FRAMES, newIndex);
-        //cap->set(CV_CAP_PROP_POS_FRAMES, newIndex);
-        //qDebug() << "Capture Thread: Getting Image...";
-        IplImage* tempImage = cvQueryFrame(cap);
-        qDebug() << "Capture Thread: Got Image!";
+        IplImage* tempImage = NULL;
+        qint64 decodeStart = PipelineMetrics::now();
+        //Frames past the last frame of the range are treated as the end of the video.
+        if (lastFrame < 0 || newIndex <= lastFrame) {
+            //Seeking is expensive (the decoder rewinds to the previous keyframe),
+            //so only do it when we are not simply reading the next frame.
+            if (newIndex != lastQueriedIndex + 1)
+                cvSetCaptureProperty(cap, CV_CAP_PROP_POS_FRAMES, newIndex);
+            //cap->set(CV_CAP_PROP_POS_FRAMES, newIndex);
+            //qDebug() << "Capture Thread: Getting Image...";
+            tempImage = cvQueryFrame(cap);
+        }
+        qint64 decodeEnd = PipelineMetrics::now();
+        if (metrics && tempImage)
+            metrics->record(PIPE_DECODE, decodeEnd - decodeStart);
+        if (Timeline::isEnabled())
+            Timeline::record("decode", decodeStart, decodeEnd, "frame", newIndex);
+        lastQueriedIndex = tempImage ? newIndex : -1;
+        TRACE_DEBUG("Capture Thread: Got Image!");
 
-        playingMutex.lock();
+        stateMutex.lock();
         if (!playing) {
             if (newIndex == 0) {
                 emit playStateChanged(2);
             }
             else emit playStateChanged(0);
         }
-        playingMutex.unlock();
+        stateMutex.unlock();
 
         if (!tempImage)
         {
             qDebug() << "At end of video!";
             //at end of video
-            pause();
+            setPlaying(false);
             emit playStateChanged(3);
         }
         else {
             tempFrame = Mat(tempImage);
-            imageHandler->setFrame(tempFrame, newIndex);
+            imageHandler->setFrame(tempFrame, newIndex, decodeEnd);
+            updated = true;
         }
     }
-    qDebug() << "Finished updating frame.";
+    TRACE_DEBUG("Finished updating frame.");
+    return updated;
 }
 
 void CaptureThread::togglePlayState() {
-    playingMutex.lock();
-    playing = !playing;
-    if (playing) emit playStateChanged(1);
-    else emit playStateChanged(0);
-    playingMutex.unlock();
+    submit(CMD_TOGGLE);
 }
 
 void CaptureThread::play() {
-    playingMutex.lock();
-    playing = true;
-    qDebug() << "Capture Thread: Playing initiated.";
-    emit playStateChanged(1);
-    playingMutex.unlock();
+    submit(CMD_PLAY);
 }
 
 void CaptureThread::pause() {
-    playingMutex.lock();
-    playing = false;
-    qDebug() << "Capture Thread: Paused.";
-    emit playStateChanged(0);
-    playingMutex.unlock();
+    submit(CMD_PAUSE);
 }
 
-
 //ATTN: Modify the button enabling on the GUI to be smarter, please.
 void CaptureThread::stepBackward(){
-    imageHandler->getReadSlot();
-    updateFrame(imageHandler->currentIndex()-1);
-    imageHandler->releaseProcSlot();
+    submit(CMD_STEP, -1);
 }
 
 void CaptureThread::stepForward() {
+    submit(CMD_STEP, 1);
+}
+
+void CaptureThread::requestSeek(int newIndex) {
+    submit(CMD_SEEK, newIndex);
+}
+
+void CaptureThread::submit(int type, int arg) {
+    stateMutex.lock();
+    //Repeated clicks on the step buttons collapse into one relative step.
+    if (type == CMD_STEP && !commands.isEmpty() && commands.last().type == CMD_STEP) {
+        commands.last().arg += arg;
+    } else {
+        TransportCommand command;
+        command.type = type;
+        command.arg = arg;
+        commands.enqueue(command);
+    }
+    stateChanged.wakeAll();
+    stateMutex.unlock();
+}
+
+void CaptureThread::runCommands(QQueue<TransportCommand> &pending) {
+    bool seekRequested = false;
+    int target = imageHandler->currentIndex();
+
+    while (!pending.isEmpty()) {
+        TransportCommand command = pending.dequeue();
+        switch (command.type) {
+        case CMD_PLAY:
+            setPlaying(true);
+            break;
+        case CMD_PAUSE:
+            setPlaying(false);
+            break;
+        case CMD_TOGGLE:
+            setPlaying(!isPlaying());
+            break;
+        case CMD_STEP:
+            target += command.arg;
+            seekRequested = true;
+            break;
+        case CMD_SEEK:
+            target = command.arg;
+            seekRequested = true;
+            break;
+        }
+    }
+
+    if (seekRequested) {
+        qDebug() << "Capture Thread: Seeking to " << target;
+        seek(target);
+        emit seekCompleted(imageHandler->currentIndex());
+    }
+}
+
+void CaptureThread::setPlaying(bool play) {
+    stateMutex.lock();
+    playing = play;
+    imageHandler->setPlaying(play);
+    stateChanged.wakeAll();
+    if (playing) {
+        qDebug() << "Capture Thread: Playing initiated.";
+        emit playStateChanged(1);
+    } else {
+        qDebug() << "Capture Thread: Paused.";
+        emit playStateChanged(0);
+    }
+    stateMutex.unlock();
+}
+
+//Blocks until the frame is handed over, so this is not meant for the GUI thread.
+void CaptureThread::seek(int newIndex) {
     imageHandler->getReadSlot();
-    updateFrame(imageHandler->currentIndex()+1);
-    imageHandler->releaseProcSlot();
+    if (updateFrame(newIndex))
+        imageHandler->releaseProcSlot();
+    else imageHandler->releaseReadSlot();
+}
+
+void CaptureThread::setLastFrame(int index) {
+    lastFrame = index;
+}
+
+void CaptureThread::setMetrics(PipelineMetrics* newMetrics) {
+    metrics = newMetrics;
 }
 
 bool CaptureThread::isPlaying() {
-    playingMutex.lock();
+    stateMutex.lock();
     bool play = playing;
-    playingMutex.unlock();
+    stateMutex.unlock();
     return play;
 }
 
@@ -174,8 +275,9 @@ int CaptureThread::getInputSourceHeight() {
 }
 
 void CaptureThread::stopCaptureThread() {
-    stoppedMutex.lock();
-        stopped = true;
-    stoppedMutex.unlock();
+    stateMutex.lock();
+    stopped = true;
+    stateChanged.wakeAll();
+    stateMutex.unlock();
     imageHandler->releaseProcSlot();
 }
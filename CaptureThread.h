@@ -3,13 +3,32 @@
 
 #include <QThread>
 #include <QTGui>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
 
 #include "opencv/highgui.h"
 #include "Structures.h"
 #include "ImageHandler.h"
+#include "PipelineMetrics.h"
 
 using namespace cv;
 
+//Transport actions queued for the CaptureThread.
+enum TRANSPORT_COMMANDS {
+    CMD_PLAY = 0,
+    CMD_PAUSE = 1,
+    CMD_TOGGLE = 2,
+    CMD_STEP = 3,
+    CMD_SEEK = 4
+};
+
+struct TransportCommand {
+    int type;
+    //Frame offset for CMD_STEP, frame index for CMD_SEEK.
+    int arg;
+};
+
 class CaptureThread : public QThread {
     Q_OBJECT
 
@@ -30,13 +49,26 @@ public:
     int getInputSourceHeight();
 
     bool isPlaying();
+
+    //Hands the given frame to the ImageHandler, waiting for the read slot if necessary.
+    //Blocks the caller, use requestSeek() from the GUI.
+    void seek(int newIndex);
+    //Frames after index are treated as the end of the video. -1 plays to the real end.
+    void setLastFrame(int index);
+    //Decode times go to metrics (may be NULL). Set before the thread is started.
+    void setMetrics(PipelineMetrics* metrics);
 public slots:
+    //Transport slots only queue the action and return immediately, the capture
+    //thread carries them out between frames.
     void togglePlayState();
     void play();
     void pause();
     void stepForward();
     void stepBackward();
+    void requestSeek(int newIndex);
 signals:
+    //A queued step or seek has been carried out, index is the frame now loaded.
+    void seekCompleted(const int index);
     void steppedBack();
     void steppedForward();
 
@@ -49,13 +81,28 @@ signals:
 private:
     CvCapture* cap;
     ImageHandler* imageHandler;
-    QMutex stoppedMutex;
-    QMutex playingMutex;
+    //Protects the playing and stopped flags.
+    QMutex stateMutex;
+    //Signalled whenever playing or stopped changes or a command is queued, the run loop sleeps on it while paused.
+    QWaitCondition stateChanged;
+    //Transport commands not yet carried out, protected by stateMutex.
+    QQueue<TransportCommand> commands;
 
     volatile bool playing;
     volatile bool stopped;
+    //Index of the last frame decoded, used to avoid seeking on sequential reads.
+    int lastQueriedIndex;
+    //Last frame of the range being played, -1 if unbounded.
+    int lastFrame;
+    PipelineMetrics* metrics;
 
-    void updateFrame(int);
+    bool updateFrame(int);
+    //Queues a command, merging consecutive steps.
+    void submit(int type, int arg = 0);
+    //Carries out the given commands, all steps and seeks among them result in a single seek.
+    void runCommands(QQueue<TransportCommand> &pending);
+    //Changes the play state right away, only used from the capture thread.
+    void setPlaying(bool play);
 protected:
     void run();
 };
@@ -0,0 +1,126 @@
+#include "CheckpointWriter.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+CheckpointWriter::CheckpointWriter() :
+    frameInterval(CHECKPOINT_INTERVAL), busy(false), hasQueued(false)
+{
+    stats.written = 0;
+    stats.skipped = 0;
+    stats.failed = 0;
+    stats.lastFrameIndex = -1;
+    stats.lastWriteMs = 0;
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    waitForDone();
+}
+
+void CheckpointWriter::setPath(QString newPath, QString newVideoPath) {
+    mutex.lock();
+    filePath = newPath;
+    videoPath = newVideoPath;
+    mutex.unlock();
+}
+
+QString CheckpointWriter::path() {
+    mutex.lock();
+    QString result = filePath;
+    mutex.unlock();
+    return result;
+}
+
+void CheckpointWriter::setInterval(int frames) {
+    mutex.lock();
+    frameInterval = frames;
+    mutex.unlock();
+}
+
+int CheckpointWriter::interval() {
+    mutex.lock();
+    int result = frameInterval;
+    mutex.unlock();
+    return result;
+}
+
+void CheckpointWriter::submit(const TrackerState& state) {
+    mutex.lock();
+    if (filePath.isEmpty()) {
+        mutex.unlock();
+        return;
+    }
+    if (hasQueued)
+        stats.skipped++;
+    queued = state;
+    if (queued.videoPath.isEmpty())
+        queued.videoPath = videoPath;
+    hasQueued = true;
+    bool start = ! busy;
+    busy = true;
+    mutex.unlock();
+
+    if (start) {
+        WriteJob* job = new WriteJob(this);
+        job->setAutoDelete(true);
+        QThreadPool::globalInstance()->start(job);
+    }
+}
+
+void CheckpointWriter::WriteJob::run() {
+    owner->writeQueued();
+}
+
+//Keeps writing until no newer state is waiting.
+void CheckpointWriter::writeQueued() {
+    mutex.lock();
+    while (hasQueued) {
+        TrackerState state = queued;
+        queued = TrackerState();
+        hasQueued = false;
+        QString target = filePath;
+        mutex.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        QString writeError;
+        bool ok = TrackerCheckpoint::write(target, state, &writeError);
+        qint64 elapsed = timer.elapsed();
+
+        mutex.lock();
+        if (ok) {
+            stats.written++;
+            stats.lastFrameIndex = state.frameIndex;
+            stats.lastWriteMs = elapsed;
+            qDebug() << "Checkpoint Writer: Saved frame " << state.frameIndex << " to " << target << " in " << elapsed << " ms";
+        } else {
+            stats.failed++;
+            error = writeError;
+            qWarning() << "Checkpoint Writer: " << writeError;
+        }
+    }
+    busy = false;
+    idle.wakeAll();
+    mutex.unlock();
+}
+
+void CheckpointWriter::waitForDone() {
+    mutex.lock();
+    while (busy)
+        idle.wait(&mutex);
+    mutex.unlock();
+}
+
+CheckpointStats CheckpointWriter::getStats() {
+    mutex.lock();
+    CheckpointStats result = stats;
+    mutex.unlock();
+    return result;
+}
+
+QString CheckpointWriter::errorString() {
+    mutex.lock();
+    QString result = error;
+    mutex.unlock();
+    return result;
+}
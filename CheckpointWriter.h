@@ -0,0 +1,69 @@
+#ifndef CHECKPOINTWRITER_H
+#define CHECKPOINTWRITER_H
+
+#include <QMutex>
+#include <QRunnable>
+#include <QString>
+#include <QWaitCondition>
+#include "TrackerCheckpoint.h"
+
+struct CheckpointStats {
+    int written;
+    //States replaced by a newer one before they were written.
+    int skipped;
+    int failed;
+    int lastFrameIndex;
+    //Duration of the last write.
+    qint64 lastWriteMs;
+};
+
+/*
+ * Writes TrackerCheckpoints on the global thread pool, so the ProcessingThread only pays
+ * for copying its state. At most one write runs at a time; a state submitted meanwhile
+ * waits, and is replaced if an even newer one arrives before it is written.
+ * submit() may be called from any thread.
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    //Checkpoints are written to filePath, stamped with videoPath. Empty disables writing.
+    void setPath(QString filePath, QString videoPath = QString());
+    QString path();
+    //Frames between periodic checkpoints of the ProcessingThread, 0 for none.
+    void setInterval(int frames);
+    int interval();
+
+    void submit(const TrackerState& state);
+    //Blocks until every submitted state has been written.
+    void waitForDone();
+
+    CheckpointStats getStats();
+    //Describes why the last write failed.
+    QString errorString();
+private:
+    class WriteJob : public QRunnable {
+    public:
+        WriteJob(CheckpointWriter* owner) : owner(owner) {}
+        void run();
+    private:
+        CheckpointWriter* owner;
+    };
+
+    QMutex mutex;
+    QWaitCondition idle;
+    QString filePath;
+    QString videoPath;
+    int frameInterval;
+    bool busy;
+    bool hasQueued;
+    TrackerState queued;
+    CheckpointStats stats;
+    QString error;
+
+    void writeQueued();
+};
+
+#endif // CHECKPOINTWRITER_H
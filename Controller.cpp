@@ -2,6 +2,7 @@
 
 #include <QTGui>
 #include <QDebug>
+#include <QElapsedTimer>
 
 Controller::Controller(){}
 
@@ -13,7 +14,8 @@ Controller::~Controller(){}
  *
  * Note: Don't worry about having threads waste processing power by
  * running perpetually, even when there's nothing to do.
- * Use of semaphores will cause threads to wait for resources.
+ * Use of semaphores will cause threads to wait for resources, and
+ * the CaptureThread sleeps on a wait condition while paused.
  */
 bool Controller::loadVideo(QString filePath, int capThreadPrio,
                            int procThreadPrio, int dispThreadPrio) {
@@ -24,10 +26,21 @@ bool Controller::loadVideo(QString filePath, int capThreadPrio,
     captureThread = new CaptureThread(imageHandler);
     processThread = new ProcessingThread(imageHandler, imageData);
     displayThread = new DisplayThread(imageData);
+    //The interactive session keeps the HighGUI mask windows around for debugging.
+    processThread->setDebugWindows(true);
 
     if ((isOpened = captureThread->loadVideo(filePath))) {
         qDebug() << "Loaded video successfully.";
         qDebug() << "Starting threads...";
+        processThread->setVideoCache(&videoCache, filePath);
+        checkpointWriter.setPath(TrackerCheckpoint::pathFor(filePath), filePath);
+        processThread->setCheckpointWriter(&checkpointWriter);
+        metrics.reset();
+        imageHandler->setMetrics(&metrics);
+        imageData->setMetrics(&metrics);
+        captureThread->setMetrics(&metrics);
+        processThread->setMetrics(&metrics);
+        displayThread->setMetrics(&metrics);
 
         captureThread->start((QThread::Priority)capThreadPrio);
         processThread->start((QThread::Priority)procThreadPrio);
@@ -60,6 +73,10 @@ void Controller::dropVideo() {
 
     if (processThread->isRunning())
         stopProcessingThread();
+    //Nothing is submitted anymore, the exporter can write out what it has.
+    stopExport();
+    processThread->setCheckpointWriter(NULL);
+    checkpointWriter.waitForDone();
     processThread->dropFrame();
     //Remember, only the captureThread keeps track of the video.
     deleteProcessingThread();
@@ -67,6 +84,36 @@ void Controller::dropVideo() {
     qDebug() << "Finished everything!";
 }
 
+bool Controller::startExport(QString filePath) {
+    stopExport();
+    if (! trackExporter.open(filePath))
+        return false;
+    processThread->setTrackExporter(&trackExporter);
+    processThread->openTrajectoryStore(TrajectoryStore::pathFor(filePath));
+    return true;
+}
+
+void Controller::stopExport() {
+    if (! trackExporter.isOpen())
+        return;
+    //Waits for a frame being published, so no submit() runs while the exporter closes.
+    processThread->setTrackExporter(NULL);
+    trackExporter.close();
+    processThread->closeTrajectoryStore();
+}
+
+bool Controller::saveCheckpoint() {
+    return processThread->saveCheckpoint();
+}
+
+void Controller::restoreCheckpoint(const TrackerState& state) {
+    QElapsedTimer timer;
+    timer.start();
+    processThread->restoreState(state);
+    captureThread->requestSeek(state.frameIndex);
+    qDebug() << "Controller: Restored checkpoint of frame " << state.frameIndex << " in " << timer.elapsed() << " ms";
+}
+
 void Controller::stopCaptureThread() {
     qDebug()<< "About to stop capture thread...";
     captureThread->stopCaptureThread();
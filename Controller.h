@@ -38,6 +38,23 @@ public:
      * The finished display frame is then passed to the GUI thread (MainWindow) to be shown.
      */
     DisplayThread *displayThread;
+    /*
+     * The TrackExporter streams the poses the ProcessingThread publishes to a file on a thread of its own.
+     * It is only running between startExport() and stopExport() (or dropVideo()).
+     */
+    TrackExporter trackExporter;
+    /*
+     * Writes checkpoints of the tracker state next to the video, periodically and on saveCheckpoint().
+     */
+    CheckpointWriter checkpointWriter;
+    /*
+     * Per-video results (e.g. the background palette) kept across runs, see VideoCache.
+     */
+    VideoCache videoCache;
+    /*
+     * Stage latencies and per-subject costs of the loaded video, reset on every loadVideo().
+     */
+    PipelineMetrics metrics;
 
     /*
      * Called by the Main Window upon loading a video file.
@@ -45,7 +62,8 @@ public:
      *
      * Note: Don't worry about having threads waste processing power by
      * running perpetually, even when there's nothing to do.
-     * Use of semaphores will cause threads to wait for resources.
+     * Use of semaphores will cause threads to wait for resources, and
+     * the CaptureThread sleeps on a wait condition while paused.
      */
     bool loadVideo(QString, int, int, int);
 
@@ -55,6 +73,16 @@ public:
      */
     void dropVideo();
 
+    //Starts streaming the tracks of every processed frame to filePath. Requires a loaded video.
+    bool startExport(QString filePath);
+    //Detaches the exporter and waits for it to write out everything queued.
+    void stopExport();
+
+    //Checkpoints the tracker state now. The file is written in the background.
+    bool saveCheckpoint();
+    //Restores the tracker state of a checkpoint read with TrackerCheckpoint::read() and seeks to its frame.
+    void restoreCheckpoint(const TrackerState& state);
+
     //Halts the capture thread gracefully.
     void stopCaptureThread();
     //Deletes the capture thread... this is dangerous!
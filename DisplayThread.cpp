@@ -1,13 +1,17 @@
 #include "DisplayThread.h"
 #include "VideoFrame.h"
 #include <QDebug>
-#include "Subject.h"
-#include "SubjectGroup.h"
+#include "Trace.h"
+#include "Timeline.h"
 
 DisplayThread::DisplayThread(ImageData* imageData) :
     QThread(), imageData(imageData), drawBox(false), subjectBox(-1)
 {
     stopped = false;
+    selectionBox = NULL;
+    metrics = NULL;
+
+    setMaxFrameRate(DEFAULT_DISPLAY_RATE);
 
     currentIndex = -1;
 
@@ -23,14 +27,13 @@ DisplayThread::DisplayThread(ImageData* imageData) :
 
 void DisplayThread::run() {
     qDebug() << "Display thread started...";
+    QElapsedTimer lastRender;
 
     while(1) {
 
-        qDebug() << "Display Thread: Waiting for write slot.";
-
-        imageData->getWriteSlot();
+        TRACE_DEBUG("Display Thread: Waiting for new data.");
 
-        qDebug() << "Display Thread: Acquired write slot.";
+        imageData->waitForData();
 
         //STOP CHECK
         stoppedMutex.lock();
@@ -41,83 +44,124 @@ void DisplayThread::run() {
         } stoppedMutex.unlock();
         //END STOP CHECK
 
-        qDebug() << "Display Thread: Locking frameProtect.";
-        frameProtectMutex.lock();
-        currentFrame = imageData->getFrame();
-        currentIndex = imageData->currentIndex();
-        groups = imageData->getGroups();
-
-        qDebug() << "Display Thread: Unlocking frameProtect.";
-        frameProtectMutex.unlock();
-
-        qDebug() << "Display Thread: Releasing read slot.";
-        imageData->releaseReadSlot();
+        //Hold off until the next display tick. Anything published in the meantime
+        //replaces what we were woken for, so we always render the newest state.
+        int interval = frameInterval;
+        if (lastRender.isValid() && interval > 0) {
+            qint64 remaining = interval - lastRender.elapsed();
+            if (remaining > 0)
+                msleep(remaining);
+        }
+        lastRender.start();
+
+        //Apply whatever the mouse did since the last tick, in one go.
+        applyMouseMove();
+
+        //Woken for mouse input only.
+        if (! imageData->takeData())
+            continue;
+        qint64 renderStart = PipelineMetrics::now();
+
+        {
+            //The snapshot is immutable, holding the reader only keeps it from being reclaimed.
+            SnapshotReader snapshot(imageData->snapshots());
+            if (! snapshot.get())
+                continue;
+            TRACE_DEBUG("Display Thread: Locking frameProtect.");
+            frameProtectMutex.lock();
+            //The frame is shared, not copied: the ProcessingThread never writes to a frame
+            //once it has been published, it moves on to a fresh buffer for the next one.
+            currentFrame = snapshot->frame;
+            currentIndex = snapshot->frameIndex;
+            frameWidth.storeRelease(currentFrame.cols);
+            frameHeight.storeRelease(currentFrame.rows);
+            TRACE_DEBUG("Display Thread: Unlocking frameProtect.");
+            frameProtectMutex.unlock();
+        }
 
+        //The frame goes out as is; overlays are composited by the VideoFrame.
         imageProtectMutex.lock();
         sourceImage = MatToQImage(currentFrame);
-        paint();
+        emit frameUpdate(sourceImage, currentIndex);
         imageProtectMutex.unlock();
+
+        //New tracking state, so the subject layer has to be redrawn.
+        updateOverlay();
+        qint64 renderEnd = PipelineMetrics::now();
+        if (metrics)
+            metrics->record(PIPE_DISPLAY, renderEnd - renderStart);
+        if (Timeline::isEnabled())
+            Timeline::record("display", renderStart, renderEnd, "frame", currentIndex);
     } qDebug() << "Stopping Display Thread...";
     imageData->stop();
 }
 
-void DisplayThread::paint() {
-    paintProtectMutex.lock();
-    qDebug() << "Display Thread: painting...";
-    modImage = sourceImage;
-    QPainter painter(&modImage);
+//Rebuilds the subject layer (boxes, headings and trails) of the selected group from the current state.
+void DisplayThread::updateOverlay() {
+    SubjectOverlay overlay;
 
-    if (drawBox) {
-        painter.setPen(Qt::cyan);
-        painter.drawRect(*selectionBox);
-    }
-    if (subjectBox > -1) {
-        if (groups.count(subjectBox)) {
-            painter.setPen(Qt::cyan);
-            //Iterate through subjects map from groups.
-            IntSubjectMap subjects = groups[subjectBox]->getSubjects();
-
-            map<int, Subject*>::iterator it1;
-
-            for (it1 = subjects.begin(); it1 != subjects.end(); it1++) {
-                painter.setPen(Qt::darkCyan);
-                //Update mod image and paint each qRectangle.
-                QRectF frame = it1->second->getCurrentBoundingFrame();
-                painter.drawRect(frame);
-                QPointF pt1 = it1->second->pos();
+    flagProtectMutex.lock();
+    int groupID = subjectBox;
+    flagProtectMutex.unlock();
+
+    if (groupID > -1) {
+        SnapshotReader snapshot(imageData->snapshots());
+        if (snapshot.get()) {
+            const QVector<SubjectPose>& subjects = snapshot->subjects;
+            for (int i = 0; i < subjects.size(); i++) {
+                if (subjects[i].groupID != groupID)
+                    continue;
+                overlay.boxes.append(subjects[i].bound);
+                QPointF pt1 = subjects[i].pos;
                 //SHIFT FROM ORIGIN 0,0 TO FRAME BOUNDS
-                painter.setPen(Qt::yellow);
-                //pt1.setX(pt1.x() + frame.left());
-                //pt1.setY(pt1.y() + frame.top());
-                painter.drawLine(QPointF(pt1.x(), pt1.y()),
-                                 QPointF(pt1.x() + 15*sin(it1->second->dir()), pt1.y() - 15*cos(it1->second->dir())));
+                overlay.headings.append(QLineF(QPointF(pt1.x(), pt1.y()),
+                                               QPointF(pt1.x() + 15*sin(subjects[i].dir), pt1.y() - 15*cos(subjects[i].dir))));
+                const QPointF* trail = snapshot->trails.constData() + subjects[i].trailStart;
+                for (int j = 1; j < subjects[i].trailLength; j++)
+                    overlay.trails.append(QLineF(trail[j-1], trail[j]));
             }
         }
     }
-    painter.end();
-    paintProtectMutex.unlock();
-    emit frameUpdate(modImage, currentIndex);
+
+    emit overlayUpdate(overlay);
 }
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\\
 //%%%%%%%%%% MOUSE UTILITIES %%%%%%%%%%\\
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\\
 
+//Called on the GUI thread for every move event: only records the position, lock-free.
+//The display thread picks up the latest one on its next tick.
 void DisplayThread::onMouseMove(QMouseEvent *ev) {
-    mouseProtectMutex.lock();
+    pendingMousePos.storeRelease(packPoint(ev->pos()));
+    //Only the first move since the last tick needs to wake the display thread.
+    if (mouseMoved.fetchAndStoreOrdered(1) == 0)
+        imageData->wake();
+}
 
-    mouseData.pos = ev->pos();
+//Applies the latest recorded mouse position, if it changed since the last call.
+void DisplayThread::applyMouseMove() {
+    if (mouseMoved.fetchAndStoreOrdered(0) == 0)
+        return;
 
-    frameProtectMutex.lock();
-    if (mouseData.pos.x() > currentFrame.cols)
-        mouseData.pos.setX(currentFrame.cols);
-    else if (mouseData.pos.x() < 0)
-        mouseData.pos.setX(0);
-    if (mouseData.pos.y() > currentFrame.rows)
-        mouseData.pos.setY(currentFrame.rows);
-    else if (mouseData.pos.y() < 0)
-        mouseData.pos.setY(0);
-    frameProtectMutex.unlock();
+    QPoint pos = unpackPoint(pendingMousePos.loadAcquire());
+
+    int width = frameWidth.loadAcquire();
+    int height = frameHeight.loadAcquire();
+    if (pos.x() > width)
+        pos.setX(width);
+    else if (pos.x() < 0)
+        pos.setX(0);
+    if (pos.y() > height)
+        pos.setY(height);
+    else if (pos.y() < 0)
+        pos.setY(0);
+
+    bool boxChanged = false;
+    QRect box;
+
+    mouseProtectMutex.lock();
+    mouseData.pos = pos;
 
     if (drawBox) {
         //qDebug() << "Draw Box on!";
@@ -129,12 +173,25 @@ void DisplayThread::onMouseMove(QMouseEvent *ev) {
         if (selectionBox->height() > 50) selectionBox->setHeight(50);
         if (selectionBox->height() < -50) selectionBox->setHeight(-50);
 
-        imageProtectMutex.lock();
-        this->paint();
-        imageProtectMutex.unlock();
+        box = *selectionBox;
+        boxChanged = true;
     }
-
     mouseProtectMutex.unlock();
+
+    if (boxChanged)
+        emit selectionBoxChanged(box);
+    emit mousePosChanged(pos);
+}
+
+//Widget coordinates fit in 16 bits each, so a position travels as a single atomic integer.
+//Each half is packed unsigned and sign extended again on unpacking, as shifting a negative
+//int is undefined.
+quint32 DisplayThread::packPoint(const QPoint &pt) {
+    return ((quint32)(quint16)pt.x() << 16) | (quint16)pt.y();
+}
+
+QPoint DisplayThread::unpackPoint(quint32 packed) {
+    return QPoint((qint16)(quint16)(packed >> 16), (qint16)(quint16)(packed & 0xFFFF));
 }
 
 void DisplayThread::onMousePress(QMouseEvent *ev) {
@@ -148,9 +205,7 @@ void DisplayThread::onMousePress(QMouseEvent *ev) {
             startPoint = ev->pos();
             selectionBox = new QRect(startPoint.x(), startPoint.y(), 0, 0);
             drawBox = true;
-            imageProtectMutex.lock();
-            this->paint();
-            imageProtectMutex.unlock();
+            emit selectionBoxChanged(*selectionBox);
         }
     } else if (mouseData.cursorType == COLOR_PICKER) {
         mouseProtectMutex.unlock();
@@ -162,6 +217,9 @@ void DisplayThread::onMousePress(QMouseEvent *ev) {
 }
 
 void DisplayThread::onMouseRelease(QMouseEvent *ev) {
+    //The box is formed from the last move, even if the display has not ticked since.
+    applyMouseMove();
+
     mouseProtectMutex.lock();
 
     mouseData.pos = ev->pos();
@@ -179,11 +237,15 @@ void DisplayThread::onMouseRelease(QMouseEvent *ev) {
 
                 mouseData.leftButtonRelease = true;
 
+                emit selectionBoxChanged(QRect());
                 emit selectionBoxFormed(mouseData);
             }
         }
         else if (ev->button() == Qt::RightButton) {
-            if (drawBox) drawBox = false;
+            if (drawBox) {
+                drawBox = false;
+                emit selectionBoxChanged(QRect());
+            }
         }
     }
 
@@ -195,6 +257,8 @@ void DisplayThread::dropFrame() {
 
     currentFrame.release();
     currentIndex = -1;
+    frameWidth.storeRelease(0);
+    frameHeight.storeRelease(0);
 
     frameProtectMutex.unlock();
 }
@@ -203,7 +267,16 @@ void DisplayThread::stopDisplayThread() {
     stoppedMutex.lock();
     stopped = true;
     stoppedMutex.unlock();
-    imageData->releaseWriteSlot();
+    imageData->stop();
+}
+
+//Caps how often processed frames are painted. 0 paints every frame.
+void DisplayThread::setMaxFrameRate(int hz) {
+    frameInterval = hz > 0 ? 1000 / hz : 0;
+}
+
+void DisplayThread::setMetrics(PipelineMetrics* newMetrics) {
+    metrics = newMetrics;
 }
 
 void DisplayThread::setMouseCursor(int cursorType) {
@@ -251,14 +324,14 @@ void DisplayThread::releaseSelectionBox() {
     mouseData.selectionBox.setWidth(0);
     mouseData.selectionBox.setHeight(0);
 
-    this->paint();
-
     mouseProtectMutex.unlock();
+
+    emit selectionBoxChanged(QRect());
 }
 
 void DisplayThread::showSubjectBoxes(const int groupID) {
     flagProtectMutex.lock();
     this->subjectBox = groupID;
     flagProtectMutex.unlock();
-    this->paint();
+    updateOverlay();
 }
@@ -3,12 +3,15 @@
 
 #include <QThread>
 #include <QTGui>
+#include <QElapsedTimer>
+#include <QAtomicInt>
 #include "opencv/highgui.h"
 
 #include "Structures.h"
 #include "VideoFrame.h"
 #include "ImageData.h"
 #include "MatToQImage.h"
+#include "PipelineMetrics.h"
 
 using namespace cv;
 
@@ -23,6 +26,9 @@ public:
 
     //Setters
     void setMouseCursor(int);
+    void setMaxFrameRate(int hz);
+    //Render times go to metrics (may be NULL). Set before the thread is started.
+    void setMetrics(PipelineMetrics* metrics);
 
     //Geters
     QPoint getMouseCursorPos();
@@ -32,6 +38,12 @@ public:
 signals:
     //Called to let the MainWindow know to repaint.
     void frameUpdate(const QImage &frame, const int);
+    //Subject layer changed (new tracking state or selected group).
+    void overlayUpdate(const SubjectOverlay &overlay);
+    //Selection rubber-band moved, empty when it is released.
+    void selectionBoxChanged(const QRect &box);
+    //Mouse position in frame coordinates, at most once per display tick.
+    void mousePosChanged(const QPoint &pos);
     void selectionBoxFormed(MouseData);
     void colorPicked(QPoint);
 public slots:
@@ -55,20 +67,17 @@ private:
     QMutex mouseProtectMutex;
     //Prevents modifications made to flags.
     QMutex flagProtectMutex;
-    //
-    QMutex paintProtectMutex;
     //Stored frame from ProcessingThread
     Mat currentFrame;
     //Current frame index
     int currentIndex;
+    //Minimum time between two painted frames in ms, 0 if unlimited.
+    volatile int frameInterval;
+    PipelineMetrics* metrics;
     //Converted from currentFrame
     QImage sourceImage;
-    //
-    QImage modImage;
     //Stores a reference to ImageData
     ImageData *imageData;
-    //Contains Subject Groups, mapped by GroupID.
-    IntGroupMap groups;
     //Constructs the QImage from the modified Matrix and calls frameUpdate();
     MouseData mouseData;
     //Used to calculate the selection box.
@@ -77,12 +86,23 @@ private:
     bool drawBox;
     //Holds reference to the selectionBox.
     QRect* selectionBox;
+    //Latest mouse position from the GUI thread, packed by packPoint().
+    QAtomicInteger<quint32> pendingMousePos;
+    //Set when pendingMousePos has not been applied yet.
+    QAtomicInt mouseMoved;
+    //Size of the current frame, used to clamp the mouse position without locking.
+    QAtomicInt frameWidth;
+    QAtomicInt frameHeight;
     //Determines whether or not to draw the subject boxes, -1 if no, >0 if yes, corresponding to group ID.
     int subjectBox;
     //
     VideoFrame* videoFrame;
-    //Handles Painting performed on the QImage.
-    void paint();
+    //Rebuilds the subject layer and emits overlayUpdate().
+    void updateOverlay();
+    //Applies the latest pending mouse move, called once per display tick.
+    void applyMouseMove();
+    static quint32 packPoint(const QPoint &pt);
+    static QPoint unpackPoint(quint32 packed);
 protected:
     void run();
 };
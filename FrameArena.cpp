@@ -0,0 +1,105 @@
+#include "FrameArena.h"
+#include <QThreadStorage>
+#include <cstdlib>
+#include <cstring>
+
+static QThreadStorage<FrameArena*> threadArenas;
+
+FrameArena::Scope::Scope(FrameArena* arena) :
+    arena(arena), marker(arena->mark()), stage(arena->getStage())
+{
+}
+
+FrameArena::Scope::~Scope() {
+    arena->rewind(marker);
+    arena->setStage(stage);
+}
+
+FrameArena::FrameArena(size_t blockSize) :
+    blockSize(blockSize), currentBlock(0), offset(0), base(0), stage(STAGE_FRAME)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+FrameArena::~FrameArena() {
+    for (size_t i = 0; i < blocks.size(); i++)
+        free(blocks[i].data);
+}
+
+FrameArena* FrameArena::current() {
+    if (! threadArenas.hasLocalData())
+        threadArenas.setLocalData(new FrameArena());
+    return threadArenas.localData();
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+    //Find the first block from the current one on that still fits the request.
+    while (currentBlock < (int)blocks.size()) {
+        Block& block = blocks[currentBlock];
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start + size <= block.size) {
+            offset = start + size;
+            stats.allocations[stage]++;
+            stats.bytes[stage] += size;
+            if (base + offset > stats.peak)
+                stats.peak = base + offset;
+            return block.data + start;
+        }
+        base += block.size;
+        currentBlock++;
+        offset = 0;
+    }
+    //Out of blocks. Oversized requests get a block of their own, which is kept like any other.
+    Block block;
+    block.size = size + alignment > blockSize ? size + alignment : blockSize;
+    block.data = (char*)malloc(block.size);
+    blocks.push_back(block);
+    stats.capacity += block.size;
+    stats.heapBlocks[stage]++;
+    return allocate(size, alignment);
+}
+
+void FrameArena::reset() {
+    currentBlock = 0;
+    offset = 0;
+    base = 0;
+    stats.resets++;
+}
+
+FrameArena::Marker FrameArena::mark() const {
+    Marker marker;
+    marker.block = currentBlock;
+    marker.offset = offset;
+    return marker;
+}
+
+void FrameArena::rewind(Marker marker) {
+    //Everything allocated between the marker and the current position is released.
+    for (int i = marker.block; i < currentBlock; i++)
+        base -= blocks[i].size;
+    currentBlock = marker.block;
+    offset = marker.offset;
+}
+
+void FrameArena::setStage(ArenaStage stage) {
+    this->stage = stage;
+}
+
+ArenaStage FrameArena::getStage() const {
+    return stage;
+}
+
+FrameArenaStats FrameArena::getStats() const {
+    return stats;
+}
+
+cv::Mat FrameArena::mat(int rows, int cols, int type) {
+    size_t step = cols * CV_ELEM_SIZE(type);
+    return cv::Mat(rows, cols, type, allocate(rows * step), step);
+}
+
+cv::Mat FrameArena::zeros(int rows, int cols, int type) {
+    cv::Mat m = mat(rows, cols, type);
+    memset(m.data, 0, m.rows * m.step);
+    return m;
+}
@@ -0,0 +1,151 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <QtGlobal>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "opencv/highgui.h"
+
+//Stages of ProcessingThread::process() that draw from the arena, used to label the counters.
+enum ArenaStage {
+    STAGE_FRAME = 0,   //Color conversion of the whole frame.
+    STAGE_MASK,        //Elliptical search masks.
+    STAGE_LABELS,      //Binary matrices and component labels.
+    STAGE_KMEANS,      //K-means centers, clusters and frequencies.
+    ARENA_STAGE_COUNT
+};
+
+/*
+ * Counters of one arena. They only cover scratch memory drawn from the arena: allocations
+ * OpenCV makes inside its own functions (cvtColor, kmeans, findContours...), the frames the
+ * CaptureThread decodes, and the snapshots, cached results and exported rows of a frame are
+ * not counted, except for frameBuffers below.
+ */
+struct FrameArenaStats {
+    //Allocations served from the arena.
+    quint64 allocations[ARENA_STAGE_COUNT];
+    quint64 bytes[ARENA_STAGE_COUNT];
+    //Blocks the arena had to request from the heap. Stays flat once the arena has grown to its working size.
+    quint64 heapBlocks[ARENA_STAGE_COUNT];
+    quint64 resets;
+    size_t capacity;
+    size_t peak;
+    //Published frames the ProcessingThread allocated on the heap because every buffer of its
+    //frame pool was still held by a snapshot. Filled in by the ProcessingThread.
+    quint64 frameBuffers;
+};
+
+/*
+ * Bump allocator for scratch memory that only lives for one frame (or one subject job).
+ * Allocating moves a pointer forward, freeing does nothing; reset() or rewinding to a
+ * mark releases everything allocated since in one go. Blocks are kept across resets,
+ * so once the arena has seen a typical frame it no longer touches the heap.
+ *
+ * An arena belongs to a single thread, see current(). Memory handed out is only valid
+ * until the owner resets or rewinds past it, so nothing allocated here may be stored in
+ * state that outlives the frame.
+ */
+class FrameArena
+{
+public:
+    //Position in the arena to rewind to.
+    struct Marker {
+        int block;
+        size_t offset;
+    };
+
+    //Rewinds the arena to where it was on construction. Nests.
+    class Scope {
+    public:
+        Scope(FrameArena* arena);
+        ~Scope();
+    private:
+        FrameArena* arena;
+        Marker marker;
+        ArenaStage stage;
+    };
+
+    FrameArena(size_t blockSize = 4 << 20);
+    ~FrameArena();
+
+    //The arena of the calling thread, created on first use and deleted with the thread.
+    static FrameArena* current();
+
+    void* allocate(size_t size, size_t alignment = 16);
+    //Releases everything. Called at the start of every frame.
+    void reset();
+    Marker mark() const;
+    void rewind(Marker marker);
+
+    //Subsequent allocations are counted towards stage.
+    void setStage(ArenaStage stage);
+    ArenaStage getStage() const;
+    FrameArenaStats getStats() const;
+
+    //Matrix headers over arena memory. The data is not reference counted and lives until the next reset.
+    cv::Mat mat(int rows, int cols, int type);
+    cv::Mat zeros(int rows, int cols, int type);
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t blockSize;
+    int currentBlock;
+    size_t offset;
+    //Total size of the blocks before currentBlock.
+    size_t base;
+    ArenaStage stage;
+    FrameArenaStats stats;
+
+    //Not copyable.
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+};
+
+//STL allocator drawing from the arena of the thread that constructs it.
+template <class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    template <class U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    ArenaAllocator() : arena(FrameArena::current()) {}
+    ArenaAllocator(FrameArena* arena) : arena(arena) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_type n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_type) {}
+
+    FrameArena* arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+//Scratch counterparts of the k-means containers in Structures.h.
+//Colors are short hex strings, which fit std::string's inline buffer.
+typedef std::list<cv::Point3_<uchar>, ArenaAllocator<cv::Point3_<uchar> > > ArenaColorList;
+typedef std::set<std::string, std::less<std::string>, ArenaAllocator<std::string> > ArenaColorSet;
+typedef std::map<int, ArenaColorSet, std::less<int>, ArenaAllocator<std::pair<const int, ArenaColorSet> > > ArenaClusterMap;
+typedef std::map<std::string, float, std::less<std::string>, ArenaAllocator<std::pair<const std::string, float> > > ArenaFrequencyMap;
+typedef std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int> > > ArenaCountMap;
+
+#endif // FRAMEARENA_H
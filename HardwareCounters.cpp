@@ -0,0 +1,113 @@
+#include "HardwareCounters.h"
+#include <QAtomicInt>
+#include <QDebug>
+#include <QThreadStorage>
+
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+static const char* counterNames[HW_COUNTER_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+static QThreadStorage<HardwareCounters*> threadCounters;
+//Counters that cannot be opened are reported once, not once per thread.
+static QAtomicInt warned(0);
+
+#ifdef Q_OS_LINUX
+static const quint64 counterConfigs[HW_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+//Opens a counter of the calling thread on any CPU. Returns -1 and sets errno on failure.
+static int openCounter(quint64 config, int groupFd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    //User space only, which also works with perf_event_paranoid at 2.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+#endif
+
+HardwareCounters::HardwareCounters() :
+    leader(-1), opened(0)
+{
+    for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+        fds[i] = -1;
+        slot[i] = -1;
+    }
+#ifdef Q_OS_LINUX
+    QString failures;
+    for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+        fds[i] = openCounter(counterConfigs[i], leader);
+        if (fds[i] < 0) {
+            failures += QString(" %1 (%2)").arg(counterNames[i]).arg(strerror(errno));
+            continue;
+        }
+        if (leader < 0)
+            leader = fds[i];
+        slot[i] = opened++;
+    }
+    if (! failures.isEmpty() && warned.testAndSetOrdered(0, 1))
+        qWarning() << "Hardware Counters: Could not open" << qPrintable(failures);
+#endif
+}
+
+HardwareCounters::~HardwareCounters() {
+#ifdef Q_OS_LINUX
+    for (int i = 0; i < HW_COUNTER_COUNT; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+#endif
+}
+
+HardwareCounters* HardwareCounters::current() {
+    if (! threadCounters.hasLocalData())
+        threadCounters.setLocalData(new HardwareCounters());
+    HardwareCounters* counters = threadCounters.localData();
+    return counters->opened > 0 ? counters : NULL;
+}
+
+bool HardwareCounters::probe(QString& error) {
+#ifdef Q_OS_LINUX
+    int fd = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (fd < 0) {
+        error = QString("perf_event_open failed: %1. Counting may be disabled by "
+                        "/proc/sys/kernel/perf_event_paranoid or unavailable in this container.").arg(strerror(errno));
+        return false;
+    }
+    close(fd);
+    return true;
+#else
+    error = "Hardware counters are only read on Linux.";
+    return false;
+#endif
+}
+
+const char* HardwareCounters::counterName(int counter) {
+    return counter >= 0 && counter < HW_COUNTER_COUNT ? counterNames[counter] : "unknown";
+}
+
+bool HardwareCounters::read(CounterValues& values) {
+#ifdef Q_OS_LINUX
+    //PERF_FORMAT_GROUP: the number of counters, then their values in the order they were opened.
+    quint64 buffer[1 + HW_COUNTER_COUNT];
+    if (::read(leader, buffer, sizeof(buffer)) < (ssize_t)((1 + opened) * sizeof(quint64)))
+        return false;
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+        values.values[i] = slot[i] >= 0 ? (qint64)buffer[1 + slot[i]] : -1;
+    return true;
+#else
+    Q_UNUSED(values);
+    return false;
+#endif
+}
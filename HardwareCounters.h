@@ -0,0 +1,51 @@
+#ifndef HARDWARECOUNTERS_H
+#define HARDWARECOUNTERS_H
+
+#include <QString>
+#include <QtGlobal>
+
+enum HardwareCounter {
+    HW_CYCLES = 0,
+    HW_INSTRUCTIONS,
+    HW_CACHE_MISSES,
+    HW_BRANCH_MISSES,
+    HW_COUNTER_COUNT
+};
+
+//Counts since the counters were opened, -1 where a counter is not available.
+struct CounterValues {
+    qint64 values[HW_COUNTER_COUNT];
+};
+
+/*
+ * CPU performance counters of one thread (user space only), read as a group through
+ * Linux perf_event_open so the counts of one read belong to the same interval.
+ * Counters the CPU or kernel does not offer are left out. Where none can be opened
+ * (other systems, perf_event_paranoid, containers and VMs without a PMU) current()
+ * returns NULL and callers go on without counts.
+ */
+class HardwareCounters
+{
+public:
+    ~HardwareCounters();
+
+    //Counters of the calling thread, opened on first use. NULL if none could be opened.
+    static HardwareCounters* current();
+    //Opens and closes a cycle counter to see whether counting works here.
+    static bool probe(QString& error);
+    static const char* counterName(int counter);
+
+    //False if the counters could not be read.
+    bool read(CounterValues& values);
+private:
+    HardwareCounters();
+
+    //File descriptor of the group leader, -1 if nothing is open.
+    int leader;
+    int fds[HW_COUNTER_COUNT];
+    //Position of each counter in a group read, -1 if it is not open.
+    int slot[HW_COUNTER_COUNT];
+    int opened;
+};
+
+#endif // HARDWARECOUNTERS_H
@@ -0,0 +1,141 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFileInfo>
+#include <QTextStream>
+#include <cstdio>
+#include "HeadlessRunner.h"
+#include "BatchScheduler.h"
+#include "ShardCoordinator.h"
+#include "Trace.h"
+#include "Timeline.h"
+
+//Per-frame qDebug output dominates the run time of a headless job; only warnings are kept.
+static void quietMessageHandler(QtMsgType type, const QMessageLogContext &, const QString &msg) {
+    if (type == QtDebugMsg)
+        return;
+    fprintf(stderr, "%s\n", qPrintable(msg));
+}
+
+static int usage() {
+    QTextStream err(stderr);
+    err << "Usage: ParticleTrackerHeadless [--verbose] <video> <session> <tracks.csv>\n"
+        << "       ParticleTrackerHeadless [--verbose] --batch <directory|manifest> [--jobs N]\n"
+        << "       ParticleTrackerHeadless [--verbose] --shards N [--overlap F] <video> <session> <tracks.csv>\n"
+        << "       ParticleTrackerHeadless [--verbose] --first F --last L <video> <session> <tracks.csv>\n"
+        << "       ParticleTrackerHeadless [--verbose] --resume <checkpoint.ptck> <video> <session> <tracks.csv>\n"
+        << "--resume carries on after the checkpoint's frame and appends to the existing track file.\n"
+        << "--timeline <trace.json> records what the threads of this process did, for a trace viewer.\n"
+        << "--counters adds CPU performance counts per stage to the metrics report (Linux only).\n";
+    return 1;
+}
+
+//Removes "--name value" from the arguments and returns value (empty if absent).
+static QString takeOption(QStringList& args, QString name) {
+    int i = args.indexOf(name);
+    if (i < 0 || i + 1 >= args.size())
+        return QString();
+    QString value = args[i + 1];
+    args.removeAt(i + 1);
+    args.removeAt(i);
+    return value;
+}
+
+//Writes the recorded timeline, if any, and passes result on.
+static int finishTimeline(QString path, int result) {
+    if (! path.isEmpty()) {
+        Timeline::setEnabled(false);
+        Timeline::writeChromeTrace(path);
+    }
+    return result;
+}
+
+static int runBatch(QCoreApplication& a, QString source, int jobs) {
+    BatchScheduler scheduler;
+    bool added = QFileInfo(source).isDir() ? scheduler.addDirectory(source) : scheduler.addManifest(source);
+    scheduler.setMaxConcurrentJobs(jobs);
+    if (! added || ! scheduler.start()) {
+        qCritical("%s", qPrintable(scheduler.errorString()));
+        return 1;
+    }
+    QObject::connect(&scheduler, SIGNAL(finished()), &a, SLOT(quit()));
+    int result = a.exec();
+
+    QTextStream out(stdout);
+    out << scheduler.report();
+    return result;
+}
+
+static int runShards(QCoreApplication& a, QStringList& args, int shards, QString overlap) {
+    ShardCoordinator coordinator;
+    coordinator.setShardCount(shards);
+    if (! overlap.isNull())
+        coordinator.setOverlap(overlap.toInt());
+    if (! coordinator.start(args[0], args[1], args[2])) {
+        qCritical("%s", qPrintable(coordinator.errorString()));
+        return 1;
+    }
+    QObject::connect(&coordinator, SIGNAL(finished(bool)), &a, SLOT(quit()));
+    a.exec();
+    if (! coordinator.errorString().isEmpty()) {
+        qCritical("%s", qPrintable(coordinator.errorString()));
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    args.removeFirst();
+
+    bool verbose = args.removeAll("--verbose") > 0;
+    if (! verbose)
+        qInstallMessageHandler(quietMessageHandler);
+    //Outlives the runner, so the traces of its shutdown are written too.
+    Trace::Session trace(verbose ? TRACE_LEVEL : TRACE_LEVEL_INFO);
+
+    bool counters = args.removeAll("--counters") > 0;
+    QString timeline = takeOption(args, "--timeline");
+    if (! timeline.isEmpty())
+        Timeline::setEnabled(true);
+
+    QString batch = takeOption(args, "--batch");
+    int jobs = takeOption(args, "--jobs").toInt();
+    if (! batch.isEmpty())
+        return args.isEmpty() ? finishTimeline(timeline, runBatch(a, batch, jobs)) : usage();
+    QString shards = takeOption(args, "--shards");
+    QString overlap = takeOption(args, "--overlap");
+    QString first = takeOption(args, "--first");
+    QString last = takeOption(args, "--last");
+    QString resume = takeOption(args, "--resume");
+    if (args.size() != 3 || (! resume.isNull() && (! first.isNull() || ! shards.isNull())))
+        return usage();
+    if (! shards.isNull())
+        return finishTimeline(timeline, runShards(a, args, shards.toInt(), overlap));
+
+    HeadlessRunner runner;
+    //Worker of a sharded run.
+    if (! first.isNull())
+        runner.setFrameRange(first.toInt(), last.isNull() ? -1 : last.toInt());
+    if (! resume.isNull())
+        runner.setResume(resume);
+    //Without counters the metrics report just lacks the counts.
+    if (counters)
+        runner.setHardwareCounters(true);
+    QObject::connect(&runner, SIGNAL(finished()), &a, SLOT(quit()));
+    if (! runner.start(args[0], args[1], args[2])) {
+        qCritical("%s", qPrintable(runner.errorString()));
+        return 1;
+    }
+
+    int result = a.exec();
+    runner.stop();
+    qWarning("Processed %d frames.", runner.framesProcessed());
+    //Also fails a shard worker, and with it the sharded run.
+    if (result == 0 && ! runner.errorString().isEmpty()) {
+        qCritical("%s", qPrintable(runner.errorString()));
+        result = 1;
+    }
+    return finishTimeline(timeline, result);
+}
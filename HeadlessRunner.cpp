@@ -0,0 +1,216 @@
+#include "HeadlessRunner.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+
+HeadlessRunner::HeadlessRunner(QObject* parent) :
+    QObject(parent), imageHandler(NULL), captureThread(NULL), processThread(NULL), seeded(false), running(false),
+    firstFrame(0), lastFrame(-1)
+{
+}
+
+HeadlessRunner::~HeadlessRunner() {
+    stop();
+    delete captureThread;
+    delete processThread;
+    delete imageHandler;
+}
+
+bool HeadlessRunner::start(QString videoPath, QString sessionPath, QString outputPath) {
+    if (! session.load(sessionPath)) {
+        error = session.errorString();
+        return false;
+    }
+    TrackerState resumeState;
+    bool resume = ! resumePath.isEmpty();
+    if (resume) {
+        if (! TrackerCheckpoint::read(resumePath, resumeState, &error))
+            return false;
+        if (QFileInfo(resumeState.videoPath).fileName() != QFileInfo(videoPath).fileName())
+            qWarning() << "Headless Runner: " << resumePath << " was taken on " << resumeState.videoPath << ", not on " << videoPath;
+    }
+    if (! trackExporter.open(outputPath, resume)) {
+        error = "Could not open " + outputPath + " for writing.";
+        return false;
+    }
+
+    imageHandler = new ImageHandler();
+    captureThread = new CaptureThread(imageHandler);
+    //No ImageData: nothing downstream of the ProcessingThread but the TrackExporter.
+    processThread = new ProcessingThread(imageHandler, NULL);
+    processThread->setTrackExporter(&trackExporter);
+    processThread->openTrajectoryStore(TrajectoryStore::pathFor(outputPath), resume);
+    processThread->setVideoCache(&videoCache, videoPath);
+    checkpointWriter.setPath(TrackerCheckpoint::pathFor(outputPath), videoPath);
+    processThread->setCheckpointWriter(&checkpointWriter);
+    QFileInfo outputInfo(outputPath);
+    reportBase = outputInfo.dir().filePath(outputInfo.completeBaseName());
+    imageHandler->setMetrics(&metrics);
+    captureThread->setMetrics(&metrics);
+    processThread->setMetrics(&metrics);
+
+    captureThread->setLastFrame(lastFrame);
+    if (! captureThread->loadVideo(videoPath)) {
+        error = "Could not open video " + videoPath;
+        trackExporter.close();
+        return false;
+    }
+
+    connect(processThread, SIGNAL(frameProcessed(int)), this, SLOT(onFrameProcessed(int)), Qt::QueuedConnection);
+    connect(captureThread, SIGNAL(playStateChanged(int)), this, SLOT(onPlayStateChange(int)), Qt::QueuedConnection);
+
+    if (resume) {
+        //Also cuts the output back to the checkpoint's frame.
+        processThread->restoreState(resumeState);
+        seeded = true;
+        qWarning("Headless Runner: Resuming after frame %d.", resumeState.frameIndex);
+    }
+
+    captureThread->start(QThread::HighPriority);
+    processThread->start(QThread::HighPriority);
+    running = true;
+
+    if (resume) {
+        //The checkpoint's frame is shown as saved, tracking goes on from the next one.
+        captureThread->requestSeek(resumeState.frameIndex);
+        captureThread->play();
+        return true;
+    }
+    //Push the first frame through so the seeds are resolved against a processed frame,
+    //just like in the GUI.
+    captureThread->stepForward();
+    return true;
+}
+
+void HeadlessRunner::setResume(QString checkpointPath) {
+    resumePath = checkpointPath;
+}
+
+void HeadlessRunner::seedSession() {
+    QList<GroupSeed> groups = session.getGroups();
+    Point3_<uchar> color;
+    for (int i = 0; i < groups.size(); i++) {
+        if (! processThread->setGroupColor(groups[i].pos, groups[i].ID, color))
+            qWarning() << "Headless Runner: Group " << groups[i].ID << " is seeded outside of the frame.";
+    }
+
+    QList<SubjectSeed> subjects = session.getSubjects();
+    for (int i = 0; i < subjects.size(); i++)
+        processThread->addSubject(subjects[i].groupID, subjects[i].subjectID, subjects[i].bound,
+                                  processThread->getCurrentFrame(), processThread->getCurrentFrameIndex());
+}
+
+bool HeadlessRunner::setHardwareCounters(bool enabled) {
+    QString reason;
+    return metrics.setHardwareCounters(enabled, reason);
+}
+
+void HeadlessRunner::setFrameRange(int first, int last) {
+    firstFrame = first;
+    lastFrame = last;
+}
+
+void HeadlessRunner::onFrameProcessed(const int index) {
+    if (! seeded) {
+        qDebug() << "Headless Runner: Seeding session at frame " << index;
+        seedSession();
+        seeded = true;
+        if (firstFrame > index) {
+            //Keep the learned colors, then look for the subjects where the range begins.
+            processThread->clearSubjects();
+            captureThread->requestSeek(firstFrame);
+            return;
+        }
+        captureThread->play();
+    } else if (index == firstFrame && firstFrame > 0 && ! captureThread->isPlaying()) {
+        //The frame was tracked without subjects. Detection is an edit, so the frame's rows
+        //are exported again with the detected subjects before the range is tracked on.
+        qDebug() << "Headless Runner: Detected " << processThread->detectSubjects() << " subjects at frame " << index;
+        captureThread->play();
+    }
+}
+
+void HeadlessRunner::onPlayStateChange(const int newState) {
+    if (newState == END_OF_VIDEO && running) {
+        stop();
+        emit finished();
+    }
+}
+
+void HeadlessRunner::stop() {
+    if (! running)
+        return;
+    running = false;
+
+    //The ProcessingThread is stopped first so the capture thread's final proc slot
+    //release cannot trigger another pass over a stale frame.
+    processThread->stopProcessingThread();
+    processThread->wait();
+    logArenaStats();
+    captureThread->stopCaptureThread();
+    captureThread->wait();
+    captureThread->dropVideo();
+
+    trackExporter.close();
+    logExportStats();
+    if (error.isEmpty())
+        error = trackExporter.errorString();
+    processThread->closeTrajectoryStore();
+    checkpointWriter.waitForDone();
+    CheckpointStats checkpoints = checkpointWriter.getStats();
+    qDebug() << "Headless Runner: Wrote " << checkpoints.written << " checkpoints, last at frame " << checkpoints.lastFrameIndex
+             << " (" << checkpoints.lastWriteMs << " ms), " << checkpoints.failed << " failed";
+    writeMetrics();
+}
+
+//Scratch allocations per stage of the processing thread. Once the arena has grown to
+//its working size the heap block counts stop increasing, as does the count of frame
+//buffers once the frame pool is full. Logged as warnings, so a run without --verbose
+//reports them too.
+void HeadlessRunner::logArenaStats() {
+    static const char* stageNames[ARENA_STAGE_COUNT] = { "frame", "mask", "labels", "kmeans" };
+    FrameArenaStats stats = processThread->getArenaStats();
+    qWarning() << "Headless Runner: Arena capacity " << stats.capacity << " bytes, peak " << stats.peak
+               << " bytes over " << stats.resets << " frames, " << stats.frameBuffers << " frame buffers allocated";
+    for (int i = 0; i < ARENA_STAGE_COUNT; i++) {
+        qWarning() << "Headless Runner: Arena stage " << stageNames[i] << ": " << stats.allocations[i] << " allocations, "
+                   << stats.bytes[i] << " bytes, " << stats.heapBlocks[i] << " heap blocks";
+    }
+}
+
+void HeadlessRunner::logExportStats() {
+    TrackExportStats stats = trackExporter.getStats();
+    qDebug() << "Headless Runner: Exported " << stats.framesWritten << " of " << stats.framesQueued << " frames, "
+             << stats.rowsWritten << " rows, " << stats.bytesWritten << " bytes at " << stats.rowsPerSecond << " rows/s";
+    qDebug() << "Headless Runner: Export queue peaked at " << stats.maxQueueDepth << " of " << TrackExporter::QUEUE_CAPACITY
+             << " rows, " << stats.rowsDeferred << " rows deferred, " << stats.syncs << " syncs";
+    if (stats.writeErrors > 0)
+        qWarning() << "Headless Runner: " << stats.writeErrors << " writes to the track file failed: "
+                   << trackExporter.errorString();
+}
+
+//Per-frame tracking time, capture-to-publish latency and the capture handoff in the log,
+//everything else in the reports.
+void HeadlessRunner::writeMetrics() {
+    PipelineStage logged[] = { PIPE_FRAME, PIPE_LATENCY };
+    for (int i = 0; i < 2; i++) {
+        StageStats stats = metrics.stageStats(logged[i]);
+        qDebug() << "Headless Runner: " << PipelineMetrics::stageName(logged[i]) << " p50 " << stats.p50 / 1000
+                 << " us, p99 " << stats.p99 / 1000 << " us, max " << stats.max / 1000 << " us over " << stats.count
+                 << " frames (" << stats.rate << " frames/s)";
+    }
+    HandoffStats handoff = metrics.handoffStats(HANDOFF_CAPTURE);
+    qDebug() << "Headless Runner: Capture waited " << handoff.producerWaitMs << " ms for processing, processing waited "
+             << handoff.consumerWaitMs << " ms for frames (slot occupied " << handoff.occupancy * 100 << "%), bottleneck: "
+             << metrics.bottleneck();
+    if (! metrics.writeReport(reportBase + ".metrics.json") || ! metrics.writeReport(reportBase + ".metrics.csv"))
+        qWarning() << "Headless Runner: Could not write the metrics reports next to " << reportBase;
+}
+
+int HeadlessRunner::framesProcessed() {
+    return trackExporter.framesWritten();
+}
+
+QString HeadlessRunner::errorString() {
+    return error;
+}
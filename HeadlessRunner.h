@@ -0,0 +1,85 @@
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QObject>
+#include <QString>
+
+#include "CaptureThread.h"
+#include "ProcessingThread.h"
+#include "ImageHandler.h"
+#include "SessionFile.h"
+#include "TrackExporter.h"
+
+/*
+ * Runs the Capture -> Processing pipeline of a single video without a DisplayThread.
+ * The first frame is processed exactly as it would be in the GUI, after which the
+ * groups and subjects of the session file are seeded and the video is played through
+ * as fast as the ProcessingThread can go. Tracks are written by a TrackExporter
+ * (CSV, or binary for ".trk" output paths). A checkpoint of the tracker state is
+ * written next to the output every CHECKPOINT_INTERVAL frames, and the stage latencies
+ * of the run to "<output>.metrics.json" and "<output>.metrics.csv" once it stops.
+ *
+ * Resumed from a checkpoint, the session is not seeded: the checkpoint's state is restored,
+ * tracking carries on after its frame and the rows of later frames in the existing track
+ * file are replaced.
+ *
+ * With a frame range, the session only serves to learn the group colors on the first
+ * frame. The subjects are then re-detected on the first frame of the range and tracked
+ * up to its last frame (see ShardCoordinator).
+ */
+class HeadlessRunner : public QObject
+{
+    Q_OBJECT
+public:
+    HeadlessRunner(QObject* parent = 0);
+    ~HeadlessRunner();
+
+    //Loads the video and session and starts the threads. Returns false on failure.
+    bool start(QString videoPath, QString sessionPath, QString outputPath);
+    //Restricts tracking to frames first..last (inclusive). Must be called before start().
+    void setFrameRange(int first, int last);
+    //Carries on from a checkpoint (see TrackerCheckpoint) and appends to the existing output.
+    //Must be called before start().
+    void setResume(QString checkpointPath);
+    //Adds hardware counts per stage to the metrics reports. False if counters are unavailable,
+    //the run then goes on without them.
+    bool setHardwareCounters(bool enabled);
+    //Halts the threads and closes the output. Safe to call more than once.
+    void stop();
+
+    int framesProcessed();
+    //Why start() failed, or once stopped, why the output is incomplete (e.g. the disk filled up).
+    //Empty if nothing went wrong.
+    QString errorString();
+signals:
+    void finished();
+private slots:
+    void onFrameProcessed(const int);
+    void onPlayStateChange(const int);
+private:
+    ImageHandler* imageHandler;
+    CaptureThread* captureThread;
+    ProcessingThread* processThread;
+    SessionFile session;
+    TrackExporter trackExporter;
+    //Checkpoints go next to the output, see TrackerCheckpoint::pathFor().
+    CheckpointWriter checkpointWriter;
+    VideoCache videoCache;
+    PipelineMetrics metrics;
+    //Output path without its extension, the reports are named after it.
+    QString reportBase;
+    QString error;
+    bool seeded;
+    bool running;
+    int firstFrame;
+    int lastFrame;
+    QString resumePath;
+
+    //Applies the session's groups and subjects to the first frame.
+    void seedSession();
+    void logArenaStats();
+    void logExportStats();
+    void writeMetrics();
+};
+
+#endif // HEADLESSRUNNER_H
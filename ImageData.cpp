@@ -1,64 +1,55 @@
 #include "ImageData.h"
 #include "QDebug"
+#include <QElapsedTimer>
+#include "Timeline.h"
 
 ImageData::ImageData()
 {
-    readSlot = new QSemaphore(1);
-    writeSlot = new QSemaphore(0);
-
     halt = false;
-    frameIndex = -1;
+    pending = false;
+    woken = false;
+    coalesced = 0;
+    metrics = NULL;
+    publishedAt = 0;
 }
 
-void ImageData::setData(const Mat &frame, int newIndex, IntGroupMap groups) {
-    currentFrameProtect.lock();
+void ImageData::setData(TrackingSnapshot* snapshot) {
+    store.publish(snapshot);
+    qint64 now = PipelineMetrics::now();
 
-    if (frameIndex != newIndex) {
-        currentFrame = frame;
-        frameIndex = newIndex;
-        this->groups = groups;
-    }
-
-    currentFrameProtect.unlock();
-}
-
-void ImageData::updateGroups(IntGroupMap groups) {
     currentFrameProtect.lock();
-    this->groups = groups;
+    bool replaced = pending;
+    qint64 replacedAt = publishedAt;
+    if (pending)
+        coalesced++;
+    pending = true;
+    publishedAt = now;
+    dataReady.wakeAll();
     currentFrameProtect.unlock();
+    if (metrics && replaced)
+        metrics->recordResidency(HANDOFF_DISPLAY, now - replacedAt, true);
 }
 
 Mat ImageData::getFrame() {
-    currentFrameProtect.lock();
-
-    Mat tempMat = currentFrame.clone();
-
-    currentFrameProtect.unlock();
-
-    return tempMat;
+    SnapshotReader snapshot(&store);
+    return snapshot.get() ? snapshot->frame.clone() : Mat();
 }
 
-IntGroupMap ImageData::getGroups() {
-    groupProtect.lock();
-    IntGroupMap tempMap = groups;
-    groupProtect.unlock();
-    return tempMap;
+int ImageData::currentIndex() {
+    SnapshotReader snapshot(&store);
+    return snapshot.get() ? snapshot->frameIndex : -1;
 }
 
-int ImageData::currentIndex() {
-    currentFrameProtect.lock();
-    int tempIndex = frameIndex;
-    currentFrameProtect.unlock();
-    return tempIndex;
+SnapshotStore* ImageData::snapshots() {
+    return &store;
 }
 
 void ImageData::clear() {
-    currentFrameProtect.lock();
+    store.publish(NULL);
 
-    currentFrame.release();
-    frameIndex = -1;
+    currentFrameProtect.lock();
+    pending = false;
     //backgroundPalette.clear();
-
     currentFrameProtect.unlock();
 }
 
@@ -67,6 +58,11 @@ void ImageData::stop() {
     halt = true;
     qDebug() << "Halting image data.";
     haltProtect.unlock();
+
+    //Wake the consumer so it can notice.
+    currentFrameProtect.lock();
+    dataReady.wakeAll();
+    currentFrameProtect.unlock();
 }
 
 bool ImageData::halted() {
@@ -76,18 +72,58 @@ bool ImageData::halted() {
     return stopped;
 }
 
-void ImageData::getReadSlot() {
-    readSlot->acquire();
+bool ImageData::waitForData(unsigned long msecs) {
+    Timeline::Span span("wait data");
+    qint64 start = PipelineMetrics::now();
+    QElapsedTimer elapsed;
+    elapsed.start();
+    currentFrameProtect.lock();
+    //Wakeups can be spurious, so the condition is checked again after each and the wait
+    //goes on for whatever is left of msecs.
+    while (! pending && ! woken && ! halted()) {
+        unsigned long remaining = ULONG_MAX;
+        if (msecs != ULONG_MAX) {
+            qint64 spent = elapsed.elapsed();
+            if (spent >= (qint64)msecs)
+                break;
+            remaining = msecs - spent;
+        }
+        dataReady.wait(&currentFrameProtect, remaining);
+    }
+    woken = false;
+    bool hasData = pending;
+    currentFrameProtect.unlock();
+    //Waits ended by mouse input only are left out, the next one continues them.
+    if (metrics && hasData)
+        metrics->recordWait(HANDOFF_DISPLAY, false, PipelineMetrics::now() - start);
+    return hasData;
+}
+
+bool ImageData::takeData() {
+    currentFrameProtect.lock();
+    bool hasData = pending;
+    qint64 takenAfter = PipelineMetrics::now() - publishedAt;
+    pending = false;
+    currentFrameProtect.unlock();
+    if (metrics && hasData)
+        metrics->recordResidency(HANDOFF_DISPLAY, takenAfter, false);
+    return hasData;
 }
 
-void ImageData::releaseReadSlot() {
-    readSlot->release();
+void ImageData::wake() {
+    currentFrameProtect.lock();
+    woken = true;
+    dataReady.wakeAll();
+    currentFrameProtect.unlock();
 }
 
-void ImageData::getWriteSlot() {
-    writeSlot->acquire();
+int ImageData::coalescedFrames() {
+    currentFrameProtect.lock();
+    int tempCount = coalesced;
+    currentFrameProtect.unlock();
+    return tempCount;
 }
 
-void ImageData::releaseWriteSlot() {
-    writeSlot->release();
+void ImageData::setMetrics(PipelineMetrics* newMetrics) {
+    metrics = newMetrics;
 }
@@ -3,48 +3,66 @@
 
 #include "opencv/highgui.h"
 #include <QMutex>
-#include <QSemaphore>
-#include "SubjectGroup.h"
+#include <QWaitCondition>
+#include <climits>
+#include "TrackingSnapshot.h"
 #include "MedianCut.h"
+#include "PipelineMetrics.h"
 
 using namespace cv;
 using namespace std;
 
-//Used as a buffer between the ProcessingThread and the DisplayThread.
+/*
+ * Used as a buffer between the ProcessingThread and the DisplayThread.
+ * Only the most recent snapshot is kept: publishing never waits for the display, and a
+ * snapshot that is replaced before the display got to it is simply skipped (coalesced).
+ * The snapshots themselves are read through snapshots() without locking.
+ */
 class ImageData
 {
 public:
     ImageData();
 
-    void setData(const Mat& frame, int newIndex, IntGroupMap groups);
-    void updateGroups(IntGroupMap groups);
+    //Publishes a new frame and tracking state, taking ownership of the snapshot.
+    //Never blocks on the consumer.
+    void setData(TrackingSnapshot* snapshot);
     Mat getFrame(); //Returns the current Frame.
-    IntGroupMap getGroups();
     int currentIndex();
+    //Store holding the latest snapshot, read it with a SnapshotReader.
+    SnapshotStore* snapshots();
     void clear();
     bool halted();
     void stop();
 
-    void getReadSlot();
-    void releaseReadSlot();
-    void getWriteSlot();
-    void releaseWriteSlot();
+    //Blocks until unread data has been published (or the buffer is halted), at most msecs.
+    //Returns true if there is unread data.
+    bool waitForData(unsigned long msecs = ULONG_MAX);
+    //Marks the latest snapshot as read. Returns false if nothing new was published.
+    bool takeData();
+    //Wakes the consumer once without publishing anything (e.g. for pending mouse input).
+    void wake();
+    //Number of published updates that were replaced before they were read.
+    int coalescedFrames();
+    //Optional sink of the consumer waits and residency (HANDOFF_DISPLAY). Set before the threads start.
+    void setMetrics(PipelineMetrics* metrics);
 private:
-    //Protects access to the current frame.
+    //Protects the pending state below.
     QMutex currentFrameProtect;
-    //Protects access to the background palette.
-    QMutex groupProtect;
     //
     QMutex haltProtect;
-    //Regulates the reading of the input data from the ProcessingThread.
-    QSemaphore* readSlot;
-    //Regulates the writing of the data to the DisplayThread.
-    QSemaphore* writeSlot;
-    //Current Frame Reference, not meant to be modified within here.
-    Mat currentFrame;
-    int frameIndex; //Updates constantly.
+    //Signalled whenever new data is published or the buffer is halted.
+    QWaitCondition dataReady;
+    //Latest published tracking state.
+    SnapshotStore store;
     volatile bool halt;
-    IntGroupMap groups;
+    //True while the latest data has not been taken by the consumer.
+    bool pending;
+    //True if the consumer was woken by wake() and has not returned from waitForData yet.
+    bool woken;
+    int coalesced;
+    PipelineMetrics* metrics;
+    //When the pending data was published.
+    qint64 publishedAt;
 };
 
 #endif // IMAGEDATA_H
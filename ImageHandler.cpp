@@ -1,5 +1,7 @@
 #include "ImageHandler.h"
 #include <QDebug>
+#include "Trace.h"
+#include "Timeline.h"
 
 ImageHandler::ImageHandler() {
     //This guarantees that input comes first... despite thread action
@@ -7,31 +9,42 @@ ImageHandler::ImageHandler() {
     procSlot = new QSemaphore(0);
 
     frameIndex = -1;
+    frameCaptureTime = 0;
+    metrics = NULL;
+    handedOverAt = 0;
 }
 
 /*
  * Note: As the frame is being passed by value, don't modify it here.
  */
-void ImageHandler::setFrame(const Mat& frame, int newIndex) {
-    qDebug() << "Image Handler: Received call to set Frame.";
+void ImageHandler::setFrame(const Mat& frame, int newIndex, qint64 captureTime) {
+    TRACE_DEBUG("Image Handler: Received call to set Frame.");
     currentFrameProtect.lock();
     if (frameIndex != newIndex) {
             currentFrame = frame;
             frameIndex = newIndex;
+            frameCaptureTime = captureTime;
     } //Note: setFrame should only be called from the CaptureThread
     currentFrameProtect.unlock();
-    qDebug() << "Image Handler: Finished set Frame pass.";
+    TRACE_DEBUG("Image Handler: Finished set Frame pass.");
 }
 
 Mat ImageHandler::getFrame() {
-    qDebug() << "Image Handler: Received call to get Frame.";
+    TRACE_DEBUG("Image Handler: Received call to get Frame.");
     currentFrameProtect.lock();
         Mat tempFrame = currentFrame.clone();
     currentFrameProtect.unlock();
-    qDebug() << "Image Handler: Returning Frame";
+    TRACE_DEBUG("Image Handler: Returning Frame");
     return tempFrame;
 }
 
+qint64 ImageHandler::captureTime() {
+    currentFrameProtect.lock();
+    qint64 time = frameCaptureTime;
+    currentFrameProtect.unlock();
+    return time;
+}
+
 void ImageHandler::clear() {
     currentFrameProtect.lock();
         currentFrame.release();
@@ -49,13 +62,31 @@ int ImageHandler::currentIndex() {
 void ImageHandler::getReadSlot() {
 //    qDebug() << "readSlot: " << readSlot->available();
 //    qDebug() << "ProcessingResources: " <<procSlot->available() << endl;
+    Timeline::Span span("wait read slot");
+    qint64 start = PipelineMetrics::now();
     readSlot->acquire();
+    //The CaptureThread held back by processing.
+    if (metrics)
+        metrics->recordWait(HANDOFF_CAPTURE, true, PipelineMetrics::now() - start);
 }
 
 void ImageHandler::getProcSlot() {
 //    qDebug() << "readSlot: " << readSlot->available();
 //    qDebug() << "ProcessingResources: " <<procSlot->available() << endl;
+    Timeline::Span span("wait proc slot");
+    qint64 start = PipelineMetrics::now();
+    bool wasPlaying = playing.loadAcquire() != 0;
+    int pausesBefore = pauses.loadAcquire();
     procSlot->acquire();
+    //The ProcessingThread starved of frames, unless the video was paused meanwhile: then it
+    //waited for the user, and the frame (e.g. of a step) may have waited for a paint.
+    qint64 end = PipelineMetrics::now();
+    if (metrics && wasPlaying && pauses.loadAcquire() == pausesBefore) {
+        metrics->recordWait(HANDOFF_CAPTURE, false, end - start);
+        if (handedOverAt > 0)
+            metrics->recordResidency(HANDOFF_CAPTURE, end - handedOverAt, false);
+    }
+    handedOverAt = 0;
 }
 
 void ImageHandler::releaseReadSlot() {
@@ -67,5 +98,16 @@ void ImageHandler::releaseReadSlot() {
 void ImageHandler::releaseProcSlot() {
 //    qDebug() << "readSlot: " << readSlot->available();
 //    qDebug() << "ProcessingResources: " <<procSlot->available() << endl;
+    handedOverAt = PipelineMetrics::now();
     procSlot->release();
 }
+
+void ImageHandler::setMetrics(PipelineMetrics* newMetrics) {
+    metrics = newMetrics;
+}
+
+void ImageHandler::setPlaying(bool play) {
+    if (! play)
+        pauses.fetchAndAddOrdered(1);
+    playing.storeRelease(play ? 1 : 0);
+}
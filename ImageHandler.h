@@ -1,9 +1,12 @@
 #ifndef IMAGEHANDLER_H
 #define IMAGEHANDLER_H
 
+#include <QAtomicInt>
 #include <QMutex>
 #include <QSemaphore>
 #include <opencv/highgui.h>
+#include <QtGlobal>
+#include "PipelineMetrics.h"
 
 using namespace cv;
 
@@ -16,8 +19,10 @@ class ImageHandler
 {
 public:
     ImageHandler();
-    void setFrame(const Mat& frame, int newIndex);
+    //captureTime is when the frame was decoded, see PipelineMetrics::now().
+    void setFrame(const Mat& frame, int newIndex, qint64 captureTime = 0);
     Mat getFrame(); //Returns the current Frame.
+    qint64 captureTime(); //Returns the decode time of the current Frame.
     void clear(); //Removes the currentFrame and resets frameIndex.
     int currentIndex(); //Returns the index of the current Frame.
 
@@ -25,6 +30,11 @@ public:
     void releaseReadSlot();
     void getProcSlot();
     void releaseProcSlot();
+    //Optional sink of the slot waits (HANDOFF_CAPTURE). Set before the threads start.
+    void setMetrics(PipelineMetrics* metrics);
+    //Told by the CaptureThread whether it reads frames on its own. A wait for a frame that
+    //overlaps a pause is idle time of the user, not of the pipeline, and is not recorded.
+    void setPlaying(bool playing);
 
 private:
     QMutex currentFrameProtect; //Protects the current frame from simultaneous accesses.
@@ -33,6 +43,14 @@ private:
 
     Mat currentFrame;
     int frameIndex; //Updates constantly.
+    qint64 frameCaptureTime;
+    PipelineMetrics* metrics;
+    //When the last frame was handed to the ProcessingThread, 0 once it was taken.
+    //Ordered by the semaphores.
+    qint64 handedOverAt;
+    QAtomicInt playing;
+    //Bumped on every pause, so a pause and play within one wait is noticed.
+    QAtomicInt pauses;
 };
 
 #endif // IMAGEHANDLER_H
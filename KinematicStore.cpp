@@ -0,0 +1,123 @@
+#include "KinematicStore.h"
+#include <cmath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int KinematicStore::size() const {
+    return x.size();
+}
+
+void KinematicStore::insert(int row, QPointF pos, float dir, QRectF box) {
+    x.insert(x.begin() + row, pos.x());
+    y.insert(y.begin() + row, pos.y());
+    heading.insert(heading.begin() + row, dir);
+    cosHeading.insert(cosHeading.begin() + row, std::cos(dir));
+    sinHeading.insert(sinHeading.begin() + row, std::sin(dir));
+    vx.insert(vx.begin() + row, 0.0f);
+    vy.insert(vy.begin() + row, 0.0f);
+    left.insert(left.begin() + row, box.left());
+    top.insert(top.begin() + row, box.top());
+    width.insert(width.begin() + row, box.width());
+    height.insert(height.begin() + row, box.height());
+    axisMajor.insert(axisMajor.begin() + row, 0.0f);
+    axisMinor.insert(axisMinor.begin() + row, 0.0f);
+    winLeft.insert(winLeft.begin() + row, 0.0f);
+    winTop.insert(winTop.begin() + row, 0.0f);
+    winWidth.insert(winWidth.begin() + row, 0.0f);
+    winHeight.insert(winHeight.begin() + row, 0.0f);
+}
+
+void KinematicStore::erase(int row) {
+    std::vector<float>* columns[] = { &x, &y, &heading, &cosHeading, &sinHeading, &vx, &vy,
+                                      &left, &top, &width, &height, &axisMajor, &axisMinor,
+                                      &winLeft, &winTop, &winWidth, &winHeight };
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++)
+        columns[i]->erase(columns[i]->begin() + row);
+}
+
+void KinematicStore::clear() {
+    std::vector<float>* columns[] = { &x, &y, &heading, &cosHeading, &sinHeading, &vx, &vy,
+                                      &left, &top, &width, &height, &axisMajor, &axisMinor,
+                                      &winLeft, &winTop, &winWidth, &winHeight };
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++)
+        columns[i]->clear();
+}
+
+void KinematicStore::setPos(int row, QPointF pos) {
+    vx[row] = pos.x() - x[row];
+    vy[row] = pos.y() - y[row];
+    x[row] = pos.x();
+    y[row] = pos.y();
+}
+
+void KinematicStore::setHeading(int row, float dir) {
+    heading[row] = dir;
+    cosHeading[row] = std::cos(dir);
+    sinHeading[row] = std::sin(dir);
+}
+
+void KinematicStore::setBox(int row, QRectF box) {
+    left[row] = box.left();
+    top[row] = box.top();
+    width[row] = box.width();
+    height[row] = box.height();
+}
+
+//Rotating the axis endpoints (+-a, +-a) and (+-b, +-b) by the heading, the extreme
+//coordinates are a*|cos - sin| horizontally and a*|cos + sin| vertically (a >= b).
+void KinematicStore::computeSearchWindows() {
+    int n = size();
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 oneAndHalf = _mm_set1_ps(1.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    for (; i + 4 <= n; i += 4) {
+        __m128 w = _mm_loadu_ps(&width[i]);
+        __m128 h = _mm_loadu_ps(&height[i]);
+        //Axes are truncated to whole pixels.
+        __m128 a = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(oneAndHalf, _mm_max_ps(w, h))));
+        __m128 b = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_min_ps(w, h)));
+        __m128 c = _mm_loadu_ps(&cosHeading[i]);
+        __m128 s = _mm_loadu_ps(&sinHeading[i]);
+        __m128 ex = _mm_mul_ps(a, _mm_and_ps(_mm_sub_ps(c, s), signMask));
+        __m128 ey = _mm_mul_ps(a, _mm_and_ps(_mm_add_ps(c, s), signMask));
+        __m128 cx = _mm_loadu_ps(&x[i]);
+        __m128 cy = _mm_loadu_ps(&y[i]);
+        __m128 x1 = _mm_sub_ps(cx, ex), x2 = _mm_add_ps(cx, ex);
+        __m128 y1 = _mm_sub_ps(cy, ey), y2 = _mm_add_ps(cy, ey);
+        __m128 values[4] = { x1, y1, _mm_sub_ps(x2, x1), _mm_sub_ps(y2, y1) };
+        //floor(): truncate, then step down where truncation rounded a negative value up.
+        for (int k = 0; k < 4; k++) {
+            __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(values[k]));
+            values[k] = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, values[k]), one));
+        }
+        _mm_storeu_ps(&axisMajor[i], a);
+        _mm_storeu_ps(&axisMinor[i], b);
+        _mm_storeu_ps(&winLeft[i], values[0]);
+        _mm_storeu_ps(&winTop[i], values[1]);
+        _mm_storeu_ps(&winWidth[i], values[2]);
+        _mm_storeu_ps(&winHeight[i], values[3]);
+    }
+#endif
+    computeSearchWindowsScalar(i);
+}
+
+void KinematicStore::computeSearchWindowsScalar(int first) {
+    for (int i = first; i < size(); i++) {
+        float a = (int)(1.5f * std::max(width[i], height[i]));
+        float b = (int)std::min(width[i], height[i]);
+        float ex = a * std::fabs(cosHeading[i] - sinHeading[i]);
+        float ey = a * std::fabs(cosHeading[i] + sinHeading[i]);
+        float x1 = x[i] - ex, x2 = x[i] + ex;
+        float y1 = y[i] - ey, y2 = y[i] + ey;
+        axisMajor[i] = a;
+        axisMinor[i] = b;
+        winLeft[i] = std::floor(x1);
+        winTop[i] = std::floor(y1);
+        winWidth[i] = std::floor(x2 - x1);
+        winHeight[i] = std::floor(y2 - y1);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef KINEMATICSTORE_H
+#define KINEMATICSTORE_H
+
+#include <QPointF>
+#include <QRectF>
+#include <vector>
+
+/*
+ * Kinematic state of all registered subjects, one contiguous array per quantity
+ * (structure of arrays). Row i belongs to the i-th subject of the SubjectRegistry.
+ * Per-frame passes such as computeSearchWindows() run over every row at once and are
+ * vectorized with SSE2 where available.
+ */
+struct KinematicStore
+{
+    //Center of mass and heading (radians, 0 = up).
+    std::vector<float> x, y, heading;
+    //Cached cos/sin of heading, refreshed whenever the heading changes.
+    std::vector<float> cosHeading, sinHeading;
+    //Displacement over the last update, in pixels per frame.
+    std::vector<float> vx, vy;
+    //Bounding box.
+    std::vector<float> left, top, width, height;
+
+    //Search window results, see computeSearchWindows().
+    std::vector<float> axisMajor, axisMinor;
+    std::vector<float> winLeft, winTop, winWidth, winHeight;
+
+    int size() const;
+    void insert(int row, QPointF pos, float dir, QRectF box);
+    void erase(int row);
+    void clear();
+
+    //Moves a subject, updating its velocity.
+    void setPos(int row, QPointF pos);
+    void setHeading(int row, float dir);
+    void setBox(int row, QRectF box);
+
+    //Computes every subject's search window: an ellipse around its last position with the
+    //major axis (1.5x the longer box side) along its heading and the minor axis the shorter
+    //side, and the axis aligned rectangle bounding it.
+    void computeSearchWindows();
+private:
+    void computeSearchWindowsScalar(int first);
+};
+
+#endif // KINEMATICSTORE_H
@@ -0,0 +1,90 @@
+#include "LatencyHistogram.h"
+#include <cmath>
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::clear() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    minValue = 0;
+    maxValue = 0;
+    sum = 0;
+}
+
+//Values below SUB_BUCKETS get a bucket each. Above, the highest set bit picks the power
+//of two and the SUB_BUCKET_BITS bits below it the linear bucket within it.
+int LatencyHistogram::bucketOf(qint64 value) {
+    if (value < SUB_BUCKETS)
+        return value < 0 ? 0 : (int)value;
+    int exponent = 63;
+    while (! (value & ((qint64)1 << exponent)))
+        exponent--;
+    if (exponent >= MAX_EXPONENT)
+        return BUCKETS - 1;
+    int sub = (int)(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::valueOf(int bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    int sub = bucket % SUB_BUCKETS;
+    qint64 width = (qint64)1 << (exponent - SUB_BUCKET_BITS);
+    return (SUB_BUCKETS + sub) * width + width / 2;
+}
+
+void LatencyHistogram::record(qint64 value) {
+    counts[bucketOf(value)]++;
+    if (total == 0 || value < minValue)
+        minValue = value;
+    if (total == 0 || value > maxValue)
+        maxValue = value;
+    total++;
+    sum += value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other.total == 0)
+        return;
+    for (int i = 0; i < BUCKETS; i++)
+        counts[i] += other.counts[i];
+    minValue = total == 0 ? other.minValue : qMin(minValue, other.minValue);
+    maxValue = total == 0 ? other.maxValue : qMax(maxValue, other.maxValue);
+    total += other.total;
+    sum += other.sum;
+}
+
+quint64 LatencyHistogram::count() const {
+    return total;
+}
+
+qint64 LatencyHistogram::min() const {
+    return minValue;
+}
+
+qint64 LatencyHistogram::max() const {
+    return maxValue;
+}
+
+double LatencyHistogram::mean() const {
+    return total ? sum / total : 0;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const {
+    if (total == 0)
+        return 0;
+    quint64 rank = (quint64)ceil(percent / 100 * total);
+    rank = qMax((quint64)1, qMin(rank, total));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        //Clamped, so the midpoint never reports more than was recorded.
+        if (seen >= rank)
+            return qBound(minValue, valueOf(i), maxValue);
+    }
+    return maxValue;
+}
@@ -0,0 +1,45 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+
+/*
+ * Histogram of durations in nanoseconds with a constant relative error (HDR style):
+ * every power of two is split into SUB_BUCKETS linear buckets, so values are kept to
+ * within 1/SUB_BUCKETS (about 6%) from a nanosecond up to MAX_VALUE. Recording is a
+ * couple of shifts and an increment and never allocates. Not thread safe.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 value);
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    quint64 count() const;
+    qint64 min() const;
+    qint64 max() const;
+    double mean() const;
+    //Value below which percent of the recorded values lie, 0 if empty.
+    qint64 percentile(double percent) const;
+
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    //Values at or above 2^MAX_EXPONENT ns (about 18 minutes) share the last bucket.
+    static const int MAX_EXPONENT = 40;
+    static const int BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+private:
+    quint64 counts[BUCKETS];
+    quint64 total;
+    qint64 minValue;
+    qint64 maxValue;
+    double sum;
+
+    static int bucketOf(qint64 value);
+    //Midpoint of the values falling into the bucket.
+    static qint64 valueOf(int bucket);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,9 +1,11 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "Trace.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    Trace::Session trace(TRACE_LEVEL);
     MainWindow w;
     w.show();
     
@@ -4,6 +4,7 @@
 #include "Controller.h"
 #include <QDebug>
 #include <QMessageBox>
+#include "Timeline.h"
 
 //Constructor
 MainWindow::MainWindow(QWidget *parent) :
@@ -11,8 +12,12 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     ui->setupUi(this);
 
+    //Overlays are built on the display thread and queued to the GUI.
+    qRegisterMetaType<SubjectOverlay>("SubjectOverlay");
+
     //Allocate dynamic memory for the Controller.
     controller = new Controller;
+    metricsPanel = NULL;
 
     //Initiate GUI and Signals/Slots...
     setInitialGUIState();
@@ -42,6 +47,8 @@ void MainWindow::loadVideo() {
     if (! tempPath.isEmpty() && isValidPath(tempPath)) {
 
         if (isVideoLoaded) {
+            //Stops the export of the old video's tracks.
+            ui->actionExport_Tracks->setChecked(false);
             controller->dropVideo();
         }
 
@@ -53,6 +60,7 @@ void MainWindow::loadVideo() {
         //ui->removeSubjectButton->setEnabled(true);
         ui->addGroupButton->setEnabled(true);
         ui->removeGroupButton->setEnabled(true);
+        ui->saveCheckpointButton->setEnabled(true);
 
         ui->loadVideoText->setText(tempPath);
 
@@ -73,11 +81,13 @@ void MainWindow::loadVideo() {
         connect(controller->captureThread, SIGNAL(playStateChanged(int)), this, SLOT(onPlayStateChange(int)));
 
         connect(ui->videoFrame, SIGNAL(onMouseMoveEvent(QMouseEvent*)), controller->displayThread, SLOT(onMouseMove(QMouseEvent*)));
-        connect(ui->videoFrame, SIGNAL(onMouseMoveEvent(QMouseEvent*)), this, SLOT(updateMousePosLabel()));
+        connect(controller->displayThread, SIGNAL(mousePosChanged(QPoint)), this, SLOT(updateMousePosLabel(QPoint)));
         connect(ui->videoFrame, SIGNAL(onMousePressEvent(QMouseEvent*)), controller->displayThread, SLOT(onMousePress(QMouseEvent*)));
         connect(ui->videoFrame, SIGNAL(onMouseReleaseEvent(QMouseEvent*)), controller->displayThread, SLOT(onMouseRelease(QMouseEvent*)));
 
         connect(controller->displayThread, SIGNAL(frameUpdate(QImage, int)), this, SLOT(updateFrame(QImage, int)));
+        connect(controller->displayThread, SIGNAL(overlayUpdate(SubjectOverlay)), ui->videoFrame, SLOT(setOverlay(SubjectOverlay)));
+        connect(controller->displayThread, SIGNAL(selectionBoxChanged(QRect)), ui->videoFrame, SLOT(setSelectionBox(QRect)));
         connect(controller->displayThread, SIGNAL(selectionBoxFormed(MouseData)), this, SLOT(onSelectionBoxForm(MouseData)));
         connect(controller->displayThread, SIGNAL(colorPicked(QPoint)), this, SLOT(setGroupColor(QPoint)));
 
@@ -87,6 +97,8 @@ void MainWindow::loadVideo() {
         connect(this, SIGNAL(subjectUpdate()),  controller->processThread,  SLOT(updateSubjects()));
 
         isVideoLoaded = true;
+        ui->actionExport_Tracks->setEnabled(true);
+        ui->actionLoad_Checkpoint->setEnabled(true);
 
         //Force Painting of First Frame (stepForward works because initializes at -1).
         controller->captureThread->stepForward();
@@ -184,6 +196,13 @@ void MainWindow::signalSlotsInit() {
 
     connect(ui->groupsListWidget, SIGNAL(itemSelectionChanged()), this, SLOT(updateColorPickerButton()));
     connect(ui->subjectsListWidget, SIGNAL(itemSelectionChanged()), this, SLOT(updateSubjectSelectorButton()));
+
+    connect(ui->actionExport_Tracks, SIGNAL(toggled(bool)), this, SLOT(exportTracks(bool)));
+    connect(&exportStatusTimer, SIGNAL(timeout()), this, SLOT(updateExportStatus()));
+    connect(ui->saveCheckpointButton, SIGNAL(clicked()), this, SLOT(saveCheckpoint()));
+    connect(ui->actionLoad_Checkpoint, SIGNAL(triggered()), this, SLOT(loadCheckpoint()));
+    connect(ui->actionPipeline_Metrics, SIGNAL(triggered()), this, SLOT(showMetrics()));
+    connect(ui->actionRecord_Timeline, SIGNAL(toggled(bool)), this, SLOT(recordTimeline(bool)));
 }
 
 //Called upon a focus-change inside the SubjectListWidget.
@@ -191,12 +210,13 @@ void MainWindow::signalSlotsInit() {
 void MainWindow::updateSubjectSelectorButton() {
     if(ui->subjectsListWidget->currentRow() > -1 && ui->groupsListWidget->currentRow() > -1 && ! ui->groupsListWidget->currentItem()->icon().isNull()) {
         ui->subjectSelectorButton->setEnabled(true);
-        if (ui->subjectsListWidget->currentItem()->data(1002).toInt()) {
+        float dir;
+        //The subject may still be initializing.
+        if (ui->subjectsListWidget->currentItem()->data(1002).toInt() &&
+                controller->processThread->getSubjectDirection(ui->subjectsListWidget->currentItem()->data(1003).toInt(),
+                                                               ui->subjectsListWidget->currentItem()->data(1001).toInt(), dir)) {
             ui->subjectAngleDial->setEnabled(true);
-            ui->subjectAngleLine->setText(QString::number(rad2Deg(
-                                              controller->processThread->getSubject(
-                                                              ui->subjectsListWidget->currentItem()->data(1001).toInt(),
-                                                              ui->subjectsListWidget->currentItem()->data(1003).toInt())->dir())));
+            ui->subjectAngleLine->setText(QString::number(rad2Deg(dir)));
         } else ui->subjectAngleDial->setEnabled(false);
     }
     else {
@@ -254,7 +274,7 @@ void MainWindow::removeSubject() {
         int tempID = ui->subjectsListWidget->currentItem()->data(1001).toInt();
         if (ui->subjectsListWidget->currentItem()->data(1002).toInt()) {
             qDebug() << "Removing from Subject Group.";
-            controller->processThread->getSubjectGroup(ui->subjectsListWidget->currentItem()->data(1003).toInt())->removeSubject(tempID);
+            controller->processThread->removeSubject(ui->subjectsListWidget->currentItem()->data(1003).toInt(), tempID);
             controller->processThread->updateSubjects();
         }
         ui->subjectsListWidget->takeItem(ui->subjectsListWidget->currentRow());
@@ -266,25 +286,127 @@ void MainWindow::onSelectionBoxForm(MouseData mouseData) {
     if (ui->subjectsListWidget->currentItem()->data(1002).toInt()) {
         //If selection box has already been formed...
         //Remove the subject from its current group.
-        controller->processThread->getSubjectGroup(ui->subjectsListWidget->currentItem()->data(1003).toInt())->removeSubject(
-                    ui->subjectsListWidget->currentItem()->data(1001).toInt());
+        controller->processThread->removeSubject(ui->subjectsListWidget->currentItem()->data(1003).toInt(),
+                                                 ui->subjectsListWidget->currentItem()->data(1001).toInt());
     }
-    controller->processThread->addSubject(ui->groupsListWidget->currentItem()->data(1001).toInt(),
-                                          ui->subjectsListWidget->currentItem()->data(1001).toInt(),
-                                          mouseData.selectionBox,
-                                          controller->displayThread->getCurrentSourceFrame(),
-                                          controller->displayThread->getCurrentFrameIndex());
+    //Runs on the worker pool, the subject shows up once the job is applied.
+    QFutureWatcher<SubjectInitResult>* watcher = new QFutureWatcher<SubjectInitResult>(this);
+    connect(watcher, SIGNAL(progressValueChanged(int)), this, SLOT(onSubjectInitProgress(int)));
+    connect(watcher, SIGNAL(finished()), this, SLOT(onSubjectInitFinished()));
+    connect(watcher, SIGNAL(finished()), watcher, SLOT(deleteLater()));
+    watcher->setFuture(controller->processThread->submitSubject(ui->groupsListWidget->currentItem()->data(1001).toInt(),
+                                                                ui->subjectsListWidget->currentItem()->data(1001).toInt(),
+                                                                mouseData.selectionBox,
+                                                                controller->displayThread->getCurrentSourceFrame(),
+                                                                controller->displayThread->getCurrentFrameIndex()));
     ui->subjectsListWidget->currentItem()->setData(1002, 1); //Selection Box has been made.
     ui->subjectsListWidget->currentItem()->setData(1003, ui->groupsListWidget->currentItem()->data(1001).toInt());
     updateSubjectSelectorButton();
 }
 
+void MainWindow::onSubjectInitProgress(int pass) {
+    ui->statusBar->showMessage(tr("Initializing subject (pass %1)...").arg(pass));
+}
+
+void MainWindow::onSubjectInitFinished() {
+    ui->statusBar->clearMessage();
+}
+
+void MainWindow::exportTracks(bool enabled) {
+    if (! enabled) {
+        exportStatusTimer.stop();
+        controller->stopExport();
+        TrackExportStats stats = controller->trackExporter.getStats();
+        ui->statusBar->showMessage(tr("Exported %1 frames.").arg(stats.framesWritten), 5000);
+        if (stats.writeErrors > 0)
+            QMessageBox::warning(this, tr("Export Incomplete"), tr("%1 writes to the track file failed.\n%2")
+                                 .arg(stats.writeErrors).arg(controller->trackExporter.errorString()));
+        return;
+    }
+    QString path = QFileDialog::getSaveFileName(this, tr("Export Tracks"), dir.path(),
+                                                tr("Track CSV (*.csv);;Binary Tracks (*.trk)"));
+    if (path.isEmpty() || ! controller->startExport(path)) {
+        if (! path.isEmpty())
+            QMessageBox::warning(this, tr("Export Failed"), tr("Could not open %1 for writing.").arg(path));
+        //Unchecking calls back in here with enabled == false.
+        ui->actionExport_Tracks->blockSignals(true);
+        ui->actionExport_Tracks->setChecked(false);
+        ui->actionExport_Tracks->blockSignals(false);
+        return;
+    }
+    exportStatusTimer.start(1000);
+    updateExportStatus();
+}
+
+void MainWindow::updateExportStatus() {
+    TrackExportStats stats = controller->trackExporter.getStats();
+    ui->statusBar->showMessage(tr("Exporting: %1 frames written, %2 rows/s, queue %3 rows, backlog %4 rows")
+                               .arg(stats.framesWritten).arg(stats.rowsPerSecond, 0, 'f', 0)
+                               .arg(stats.queueDepth).arg(stats.backlog));
+}
+
+void MainWindow::saveCheckpoint() {
+    if (controller->saveCheckpoint())
+        ui->statusBar->showMessage(tr("Saving checkpoint to %1").arg(controller->checkpointWriter.path()), 5000);
+    else ui->statusBar->showMessage(tr("Nothing to checkpoint yet."), 5000);
+}
+
+void MainWindow::loadCheckpoint() {
+    QString path = QFileDialog::getOpenFileName(this, tr("Load Checkpoint"), dir.path(), tr("Checkpoints (*.ptck)"));
+    if (path.isEmpty())
+        return;
+    TrackerState state;
+    QString error;
+    if (! TrackerCheckpoint::read(path, state, &error)) {
+        QMessageBox::warning(this, tr("Load Failed"), error);
+        return;
+    }
+    //Nothing is replaced until the user agreed to use it on another video.
+    if (QFileInfo(state.videoPath).fileName() != QFileInfo(ui->loadVideoText->text()).fileName() &&
+            QMessageBox::question(this, tr("Different Video"),
+                tr("The checkpoint was taken on %1, not on the loaded video. Restore it anyway?").arg(state.videoPath),
+                QMessageBox::Yes | QMessageBox::No, QMessageBox::No) != QMessageBox::Yes)
+        return;
+    controller->restoreCheckpoint(state);
+
+    //The lists mirror the restored groups and subjects, with IDs continuing after theirs.
+    ui->subjectsListWidget->clear();
+    ui->groupsListWidget->clear();
+    currentGroupID = 0;
+    currentSubjectID = 0;
+    for (int i = 0; i < state.groups.size(); i++) {
+        const CheckpointGroup& group = state.groups[i];
+        Mat_<Vec3b> lab(1, 1, Vec3b(group.color.x, group.color.y, group.color.z));
+        Mat bgr;
+        cvtColor(lab, bgr, CV_Lab2BGR);
+        QPixmap tempPix(20,20);
+        tempPix.fill(QColor(bgr.data[2], bgr.data[1], bgr.data[0]));
+        QListWidgetItem* tempWidgetItem = new QListWidgetItem(tr("Group ") + QString::number(group.ID));
+        tempWidgetItem->setFlags(tempWidgetItem->flags() | Qt::ItemIsEditable);
+        tempWidgetItem->setData(1001, QVariant(group.ID));
+        tempWidgetItem->setIcon(QIcon(tempPix));
+        ui->groupsListWidget->addItem(tempWidgetItem);
+        currentGroupID = qMax(currentGroupID, group.ID + 1);
+    }
+    for (int i = 0; i < state.subjects.size(); i++) {
+        const CheckpointSubject& subject = state.subjects[i];
+        QListWidgetItem* tempWidgetItem = new QListWidgetItem(tr("Subject ") + QString::number(subject.subjectID));
+        tempWidgetItem->setFlags(tempWidgetItem->flags() | Qt::ItemIsEditable);
+        tempWidgetItem->setData(1001, QVariant(subject.subjectID));
+        tempWidgetItem->setData(1002, QVariant(1));
+        tempWidgetItem->setData(1003, QVariant(subject.groupID));
+        ui->subjectsListWidget->addItem(tempWidgetItem);
+        currentSubjectID = qMax(currentSubjectID, subject.subjectID + 1);
+    }
+    ui->statusBar->showMessage(tr("Restored checkpoint of frame %1.").arg(state.frameIndex), 5000);
+}
+
 void MainWindow::updateSubjectDirection(int value) {
     qDebug() << "Received direction change.";
     ui->subjectAngleLine->setText(QString::number(value));
-    controller->processThread->getSubject(
-                ui->subjectsListWidget->currentItem()->data(1001).toInt(),
-                ui->subjectsListWidget->currentItem()->data(1003).toInt())->setDirection(deg2Rad(value));
+    controller->processThread->setSubjectDirection(ui->subjectsListWidget->currentItem()->data(1003).toInt(),
+                                                   ui->subjectsListWidget->currentItem()->data(1001).toInt(),
+                                                   deg2Rad(value));
     qDebug() << "Updating Subjects...";
     controller->processThread->updateSubjects();
 
@@ -300,10 +422,13 @@ void MainWindow::addNewGroup() {
 
 void MainWindow::setGroupColor(QPoint pos) {
     //Take the currently selected group ID and use it to instantiate a new Group in the Processing Thread's list.
-    Point3_<uchar> tempRGB = controller->processThread->setGroupColor(pos, ui->groupsListWidget->currentItem()->data(1001).toInt());
+    Point3_<uchar> tempRGB;
+    bool picked = controller->processThread->setGroupColor(pos, ui->groupsListWidget->currentItem()->data(1001).toInt(), tempRGB);
 
     setMouseDefault();
     ui->groupClusterPickerButton->setChecked(false);
+    if (! picked)
+        return;
 
     QPixmap tempPix(20,20);
     tempPix.fill(QColor(tempRGB.z, tempRGB.y, tempRGB.x));
@@ -371,11 +496,32 @@ void MainWindow::setMouseDefault() {
 
 void MainWindow::updateFrame(const QImage &frame, const int index) {
     //Handle Frame Paint Call
-    ui->videoFrame->setPixmap(QPixmap::fromImage(frame));
+    ui->videoFrame->setFrame(frame);
     ui->frameIndexLabel->setText(QString("Frame: "+QString::number(index)));
 }
 
-void MainWindow::updateMousePosLabel() {
-    ui->mousePosLabel->setText(QString("X: ")+QString::number(controller->displayThread->getMouseCursorPos().x()) +
-                               QString(" Y:")+QString::number(controller->displayThread->getMouseCursorPos().y()));
+void MainWindow::updateMousePosLabel(const QPoint &pos) {
+    ui->mousePosLabel->setText(QString("X: ")+QString::number(pos.x()) +
+                               QString(" Y:")+QString::number(pos.y()));
+}
+
+void MainWindow::showMetrics() {
+    if (metricsPanel == NULL)
+        metricsPanel = new MetricsPanel(&controller->metrics, this);
+    metricsPanel->show();
+    metricsPanel->raise();
+}
+
+void MainWindow::recordTimeline(bool enabled) {
+    if (enabled) {
+        Timeline::clear();
+        Timeline::setEnabled(true);
+        ui->statusBar->showMessage(tr("Recording timeline..."));
+        return;
+    }
+    Timeline::setEnabled(false);
+    ui->statusBar->clearMessage();
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Timeline"), dir.path(), tr("Chrome Trace (*.json)"));
+    if (! path.isEmpty() && ! Timeline::writeChromeTrace(path))
+        QMessageBox::warning(this, tr("Save Timeline"), tr("Could not write ") + path);
 }
@@ -8,7 +8,10 @@
 #include <QVariant>
 #include "Controller.h"
 #include <QAbstractSlider>
+#include <QFutureWatcher>
+#include <QTimer>
 #include "Utilities.h"
+#include "MetricsPanel.h"
 
 namespace Ui {
 class MainWindow;
@@ -48,6 +51,10 @@ private:
     int currentGroupID;
     //Current playing state of the program.
     bool playing;
+    //Refreshes the export statistics in the status bar while tracks are exported.
+    QTimer exportStatusTimer;
+    //Created on first use of the Pipeline Metrics action.
+    MetricsPanel* metricsPanel;
 public slots:
     //Linked directly to GUI input, passes to Controller for thread-handling.
     void loadVideo();
@@ -60,10 +67,24 @@ private slots:
     void onPlayStateChange(const int);
     //Receives new Mouse Data containing the Bounding Box for a Subject.
     void onSelectionBoxForm(MouseData);
+    //Reports the progress of a subject initialization job in the status bar.
+    void onSubjectInitProgress(int pass);
+    void onSubjectInitFinished();
+    //Linked to the Export Tracks action. Asks for a file and starts or stops the export.
+    void exportTracks(bool enabled);
+    void updateExportStatus();
+    //Linked to the save button. Checkpoints the tracker state next to the video.
+    void saveCheckpoint();
+    //Linked to the Load Checkpoint action. Restores the tracker state and the group and subject lists.
+    void loadCheckpoint();
+    //Linked to the Pipeline Metrics action. Shows the stage latencies of the loaded video.
+    void showMetrics();
+    //Linked to the Record Timeline action. Starts recording thread activity, or stops and saves it.
+    void recordTimeline(bool enabled);
     //Linked to ProcessingThread's signal. When the ProcessingThread has completed analyzing/filtering its frame, it will emit a completed signal.
     void updateFrame(const QImage &frame, const int index);
     //Updates the mouse-coordinate display.
-    void updateMousePosLabel();
+    void updateMousePosLabel(const QPoint &pos);
     //
     void setMouseDefault();
     //
@@ -32,30 +32,61 @@
 
 #include "MatToQImage.h"
 
+//Called by Qt once the last QImage sharing a Mat's buffer goes away.
+static void releaseMat(void* info)
+{
+    delete static_cast<Mat*>(info);
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 5, 0)
+//Grayscale color table (used to translate colour indexes to qRgb values), built once.
+static QVector<QRgb> buildGrayColorTable()
+{
+    QVector<QRgb> colorTable;
+    for (int i=0; i<256; i++)
+        colorTable.push_back(qRgb(i,i,i));
+    return colorTable;
+}
+#endif
+
+/*
+ * The returned QImage shares the Mat's pixel buffer instead of copying it. It keeps its
+ * own reference to the Mat, so the buffer stays alive for as long as the image does, and
+ * it is read-only: painting on it (or a copy of it) detaches first.
+ * The caller must not write to the Mat's buffer while the image is in use.
+ */
 QImage MatToQImage(const Mat& mat)
 {
     // 8-bits unsigned, NO. OF CHANNELS=1
     if(mat.type()==CV_8UC1)
     {
-        // Set the color table (used to translate colour indexes to qRgb values)
-        QVector<QRgb> colorTable;
-        for (int i=0; i<256; i++)
-            colorTable.push_back(qRgb(i,i,i));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+        Mat* ref = new Mat(mat);
+        return QImage((const uchar*)ref->data, mat.cols, mat.rows, mat.step, QImage::Format_Grayscale8, releaseMat, ref);
+#else
+        static const QVector<QRgb> colorTable = buildGrayColorTable();
         // Copy input Mat
         const uchar *qImageBuffer = (const uchar*)mat.data;
         // Create QImage with same dimensions as input Mat
         QImage img(qImageBuffer, mat.cols, mat.rows, mat.step, QImage::Format_Indexed8);
         img.setColorTable(colorTable);
         return img;
+#endif
     }
     // 8-bits unsigned, NO. OF CHANNELS=3
     if(mat.type()==CV_8UC3)
     {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        //Qt reads OpenCV's BGR byte order directly, no swap needed.
+        Mat* ref = new Mat(mat);
+        return QImage((const uchar*)ref->data, mat.cols, mat.rows, mat.step, QImage::Format_BGR888, releaseMat, ref);
+#else
         // Copy input Mat
         const uchar *qImageBuffer = (const uchar*)mat.data;
         // Create QImage with same dimensions as input Mat
         QImage img(qImageBuffer, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
         return img.rgbSwapped();
+#endif
     }
     else
     {
@@ -10,6 +10,7 @@
 
 using namespace cv;
 
+//Wraps the Mat's buffer without copying it. See MatToQImage.cpp.
 QImage MatToQImage(const Mat&);
 
 #endif // MATTOQIMAGE_H
@@ -0,0 +1,173 @@
+#include "MetricsPanel.h"
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QVBoxLayout>
+
+//Subjects beyond this many are left out of the table, the reports list all of them.
+static const int MAX_SUBJECT_ROWS = 50;
+
+//Nanoseconds to microseconds with one decimal.
+static QString micros(double ns) {
+    return QString::number(ns / 1000, 'f', 1);
+}
+
+//Mean count per frame, empty if the stage was not counted.
+static QString perFrame(const StageCounters& counts, HardwareCounter counter) {
+    if (counts.frames == 0 || counts.totals[counter] < 0)
+        return QString();
+    return QString::number((double)counts.totals[counter] / counts.frames, 'f', 0);
+}
+
+MetricsPanel::MetricsPanel(PipelineMetrics* newMetrics, QWidget* parent) :
+    QWidget(parent, Qt::Tool), metrics(newMetrics)
+{
+    setWindowTitle(tr("Pipeline Metrics"));
+    resize(640, 480);
+
+    QStringList stageColumns;
+    stageColumns << tr("Stage") << tr("Count") << tr("Rate/s") << tr("Mean us") << tr("p50 us")
+                 << tr("p90 us") << tr("p99 us") << tr("p99.9 us") << tr("Max us")
+                 << tr("Cycles/frame") << tr("IPC") << tr("Cache misses/frame") << tr("Branch misses/frame");
+    stageTable = new QTableWidget(PIPELINE_STAGE_COUNT, stageColumns.size(), this);
+    stageTable->setHorizontalHeaderLabels(stageColumns);
+    stageTable->verticalHeader()->hide();
+    stageTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QStringList subjectColumns;
+    subjectColumns << tr("Group") << tr("Subject") << tr("Frames") << tr("Total ms") << tr("Mean us") << tr("Max us");
+    subjectTable = new QTableWidget(0, subjectColumns.size(), this);
+    subjectTable->setHorizontalHeaderLabels(subjectColumns);
+    subjectTable->verticalHeader()->hide();
+    subjectTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+    QStringList handoffColumns;
+    handoffColumns << tr("Handoff") << tr("Frames") << tr("Coalesced") << tr("Occupancy %")
+                   << tr("Producer wait ms") << tr("Producer p99 us") << tr("Consumer wait ms")
+                   << tr("Consumer p99 us") << tr("Residency p50 us") << tr("Residency p99 us");
+    handoffTable = new QTableWidget(PIPELINE_HANDOFF_COUNT, handoffColumns.size(), this);
+    handoffTable->setHorizontalHeaderLabels(handoffColumns);
+    handoffTable->verticalHeader()->hide();
+    handoffTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    bottleneckLabel = new QLabel(this);
+
+    resetButton = new QPushButton(tr("Reset"), this);
+    saveButton = new QPushButton(tr("Save..."), this);
+    countersBox = new QCheckBox(tr("Hardware counters"), this);
+    countersBox->setChecked(metrics->hardwareCountersEnabled());
+    QHBoxLayout* buttons = new QHBoxLayout();
+    buttons->addWidget(countersBox);
+    buttons->addWidget(bottleneckLabel);
+    buttons->addStretch();
+    buttons->addWidget(resetButton);
+    buttons->addWidget(saveButton);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(stageTable, 1);
+    layout->addWidget(subjectTable, 1);
+    layout->addWidget(handoffTable);
+    layout->addLayout(buttons);
+
+    connect(&refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    connect(resetButton, SIGNAL(clicked()), this, SLOT(reset()));
+    connect(saveButton, SIGNAL(clicked()), this, SLOT(save()));
+    connect(countersBox, SIGNAL(toggled(bool)), this, SLOT(toggleCounters(bool)));
+}
+
+void MetricsPanel::showEvent(QShowEvent* event) {
+    refresh();
+    refreshTimer.start(1000);
+    QWidget::showEvent(event);
+}
+
+void MetricsPanel::hideEvent(QHideEvent* event) {
+    refreshTimer.stop();
+    QWidget::hideEvent(event);
+}
+
+void MetricsPanel::setCell(QTableWidget* table, int row, int column, QString text) {
+    QTableWidgetItem* item = table->item(row, column);
+    if (item == NULL) {
+        item = new QTableWidgetItem();
+        if (column > 0)
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        table->setItem(row, column, item);
+    }
+    item->setText(text);
+}
+
+void MetricsPanel::refresh() {
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        StageStats stats = metrics->stageStats((PipelineStage)i);
+        setCell(stageTable, i, 0, PipelineMetrics::stageName(i));
+        setCell(stageTable, i, 1, QString::number(stats.count));
+        setCell(stageTable, i, 2, QString::number(stats.rate, 'f', 1));
+        setCell(stageTable, i, 3, micros(stats.mean));
+        setCell(stageTable, i, 4, micros(stats.p50));
+        setCell(stageTable, i, 5, micros(stats.p90));
+        setCell(stageTable, i, 6, micros(stats.p99));
+        setCell(stageTable, i, 7, micros(stats.p999));
+        setCell(stageTable, i, 8, micros(stats.max));
+
+        StageCounters counts = metrics->stageCounters((PipelineStage)i);
+        setCell(stageTable, i, 9, perFrame(counts, HW_CYCLES));
+        setCell(stageTable, i, 10, counts.frames > 0 && counts.totals[HW_CYCLES] > 0 && counts.totals[HW_INSTRUCTIONS] >= 0 ?
+                    QString::number((double)counts.totals[HW_INSTRUCTIONS] / counts.totals[HW_CYCLES], 'f', 2) : QString());
+        setCell(stageTable, i, 11, perFrame(counts, HW_CACHE_MISSES));
+        setCell(stageTable, i, 12, perFrame(counts, HW_BRANCH_MISSES));
+    }
+
+    for (int i = 0; i < PIPELINE_HANDOFF_COUNT; i++) {
+        HandoffStats handoff = metrics->handoffStats((PipelineHandoff)i);
+        setCell(handoffTable, i, 0, PipelineMetrics::handoffName(i));
+        setCell(handoffTable, i, 1, QString::number(handoff.handoffs));
+        setCell(handoffTable, i, 2, QString::number(handoff.coalesced));
+        setCell(handoffTable, i, 3, QString::number(handoff.occupancy * 100, 'f', 1));
+        setCell(handoffTable, i, 4, QString::number(handoff.producerWaitMs, 'f', 1));
+        setCell(handoffTable, i, 5, micros(handoff.producerWait.p99));
+        setCell(handoffTable, i, 6, QString::number(handoff.consumerWaitMs, 'f', 1));
+        setCell(handoffTable, i, 7, micros(handoff.consumerWait.p99));
+        setCell(handoffTable, i, 8, micros(handoff.residency.p50));
+        setCell(handoffTable, i, 9, micros(handoff.residency.p99));
+    }
+    QString bottleneck = metrics->bottleneck();
+    bottleneckLabel->setText(bottleneck.isEmpty() ? QString() : tr("Bottleneck: %1").arg(bottleneck));
+
+    QList<SubjectCost> costs = metrics->subjectCosts();
+    int rows = qMin(costs.size(), MAX_SUBJECT_ROWS);
+    subjectTable->setRowCount(rows);
+    for (int i = 0; i < rows; i++) {
+        const SubjectCost& cost = costs[i];
+        setCell(subjectTable, i, 0, QString::number(cost.groupID));
+        setCell(subjectTable, i, 1, QString::number(cost.subjectID));
+        setCell(subjectTable, i, 2, QString::number(cost.frames));
+        setCell(subjectTable, i, 3, QString::number(cost.totalNs / 1e6, 'f', 1));
+        setCell(subjectTable, i, 4, micros(cost.frames > 0 ? (double)cost.totalNs / cost.frames : 0));
+        setCell(subjectTable, i, 5, micros(cost.maxNs));
+    }
+}
+
+void MetricsPanel::reset() {
+    metrics->reset();
+    refresh();
+}
+
+void MetricsPanel::save() {
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Metrics"), QString(),
+                                                tr("CSV (*.csv);;JSON (*.json)"));
+    if (path.isEmpty())
+        return;
+    if (! metrics->writeReport(path))
+        QMessageBox::warning(this, tr("Save Metrics"), tr("Could not write ") + path);
+}
+
+void MetricsPanel::toggleCounters(bool enabled) {
+    QString error;
+    if (! metrics->setHardwareCounters(enabled, error)) {
+        countersBox->blockSignals(true);
+        countersBox->setChecked(false);
+        countersBox->blockSignals(false);
+        QMessageBox::warning(this, tr("Hardware Counters"), error);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef METRICSPANEL_H
+#define METRICSPANEL_H
+
+#include <QWidget>
+#include <QCheckBox>
+#include <QLabel>
+#include <QTableWidget>
+#include <QPushButton>
+#include <QTimer>
+#include "PipelineMetrics.h"
+
+/*
+ * Tool window showing the stage latencies and the most expensive subjects of a
+ * PipelineMetrics, refreshed once a second while it is visible. With hardware counters on,
+ * the counted stages also show their counts per frame. The handoff table shows how long
+ * each thread waited on its neighbours, which tells which of them holds the others back.
+ */
+class MetricsPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    MetricsPanel(PipelineMetrics* metrics, QWidget* parent = 0);
+protected:
+    void showEvent(QShowEvent* event);
+    void hideEvent(QHideEvent* event);
+private slots:
+    void refresh();
+    void reset();
+    void save();
+    void toggleCounters(bool enabled);
+private:
+    PipelineMetrics* metrics;
+    QTableWidget* stageTable;
+    QTableWidget* subjectTable;
+    QTableWidget* handoffTable;
+    QLabel* bottleneckLabel;
+    QPushButton* resetButton;
+    QPushButton* saveButton;
+    QCheckBox* countersBox;
+    QTimer refreshTimer;
+
+    static void setCell(QTableWidget* table, int row, int column, QString text);
+};
+
+#endif // METRICSPANEL_H
@@ -21,12 +21,33 @@ SOURCES +=\
     Utilities.cpp \
     SubjectGroup.cpp \
     Subject.cpp \
+    SubjectRegistry.cpp \
+    KinematicStore.cpp \
+    TrajectoryRing.cpp \
+    TrajectoryStore.cpp \
+    TrajectoryFormat.cpp \
+    TrajectoryReader.cpp \
+    TrackingResultCache.cpp \
+    TrackerCheckpoint.cpp \
+    CheckpointWriter.cpp \
+    VideoCache.cpp \
+    LatencyHistogram.cpp \
+    PipelineMetrics.cpp \
+    HardwareCounters.cpp \
+    Trace.cpp \
+    Timeline.cpp \
+    FrameArena.cpp \
     ProcessingThread.cpp \
+    SubjectInitJob.cpp \
     MedianCut.cpp \
     MainWindow.cpp \
+    MetricsPanel.cpp \
     ImageData.cpp \
+    TrackingSnapshot.cpp \
     DisplayThread.cpp \
     DisjointSets.cpp \
+    TrackWriter.cpp \
+    TrackExporter.cpp \
     Main.cpp
 
 HEADERS  += \
@@ -36,14 +57,35 @@ HEADERS  += \
     Structures.h \
     ImageHandler.h \
     MainWindow.h \
+    MetricsPanel.h \
     VideoFrame.h \
     Utilities.h \
     SubjectGroup.h \
     Subject.h \
+    SubjectRegistry.h \
+    KinematicStore.h \
+    TrajectoryRing.h \
+    TrajectoryStore.h \
+    TrajectoryFormat.h \
+    TrajectoryReader.h \
+    TrackingResultCache.h \
+    TrackerCheckpoint.h \
+    CheckpointWriter.h \
+    VideoCache.h \
+    LatencyHistogram.h \
+    PipelineMetrics.h \
+    HardwareCounters.h \
+    Trace.h \
+    Timeline.h \
+    FrameArena.h \
     MedianCut.h \
     ImageData.h \
+    TrackingSnapshot.h \
     DisplayThread.h \
     DisjointSets.h \
+    TrackWriter.h \
+    TrackExporter.h \
+    SubjectInitJob.h \
     ProcessingThread.h
 
 FORMS += mainwindow.ui
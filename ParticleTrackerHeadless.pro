@@ -0,0 +1,99 @@
+#-------------------------------------------------
+#
+# Headless batch tracker: Capture -> Processing only,
+# no DisplayThread, no widgets, no HighGUI windows.
+#
+#-------------------------------------------------
+
+QT += core gui
+QT -= widgets
+
+QMAKE_CXXFLAGS += -std=c++11
+QMAKE_LFLAGS += -stdlib=libc++
+
+TARGET = ParticleTrackerHeadless
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+SOURCES +=\
+    CaptureThread.cpp \
+    ImageHandler.cpp \
+    ImageData.cpp \
+    TrackingSnapshot.cpp \
+    Utilities.cpp \
+    SubjectGroup.cpp \
+    Subject.cpp \
+    SubjectRegistry.cpp \
+    KinematicStore.cpp \
+    TrajectoryRing.cpp \
+    TrajectoryStore.cpp \
+    TrajectoryFormat.cpp \
+    TrajectoryReader.cpp \
+    TrackingResultCache.cpp \
+    TrackerCheckpoint.cpp \
+    CheckpointWriter.cpp \
+    VideoCache.cpp \
+    LatencyHistogram.cpp \
+    PipelineMetrics.cpp \
+    HardwareCounters.cpp \
+    Trace.cpp \
+    Timeline.cpp \
+    FrameArena.cpp \
+    ProcessingThread.cpp \
+    SubjectInitJob.cpp \
+    MedianCut.cpp \
+    DisjointSets.cpp \
+    SessionFile.cpp \
+    TrackWriter.cpp \
+    TrackExporter.cpp \
+    HeadlessRunner.cpp \
+    BatchScheduler.cpp \
+    TrackStitcher.cpp \
+    ShardCoordinator.cpp \
+    HeadlessMain.cpp
+
+HEADERS  += \
+    CaptureThread.h \
+    Structures.h \
+    ImageHandler.h \
+    ImageData.h \
+    TrackingSnapshot.h \
+    Utilities.h \
+    SubjectGroup.h \
+    Subject.h \
+    SubjectRegistry.h \
+    KinematicStore.h \
+    TrajectoryRing.h \
+    TrajectoryStore.h \
+    TrajectoryFormat.h \
+    TrajectoryReader.h \
+    TrackingResultCache.h \
+    TrackerCheckpoint.h \
+    CheckpointWriter.h \
+    VideoCache.h \
+    LatencyHistogram.h \
+    PipelineMetrics.h \
+    HardwareCounters.h \
+    Trace.h \
+    Timeline.h \
+    FrameArena.h \
+    ProcessingThread.h \
+    SubjectInitJob.h \
+    MedianCut.h \
+    DisjointSets.h \
+    SessionFile.h \
+    TrackWriter.h \
+    TrackExporter.h \
+    HeadlessRunner.h \
+    BatchScheduler.h \
+    TrackStitcher.h \
+    ShardCoordinator.h
+
+INCLUDEPATH += /usr/local/include\
+
+LIBS += -L/usr/local/lib \
+     -lopencv_core \
+     -lopencv_imgproc \
+     -lopencv_features2d\
+     -lopencv_highgui
@@ -0,0 +1,398 @@
+#include "PipelineMetrics.h"
+#include "Timeline.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
+
+static const char* stageNames[PIPELINE_STAGE_COUNT] = {
+    "decode", "color", "roi", "labels", "kmeans", "moments", "publish", "display", "frame", "latency"
+};
+
+static const char* handoffNames[PIPELINE_HANDOFF_COUNT] = { "capture", "display" };
+
+static QElapsedTimer startClock() {
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+//Started on first use, read concurrently afterwards.
+static const QElapsedTimer& metricsClock() {
+    static const QElapsedTimer clock = startClock();
+    return clock;
+}
+
+static bool costlier(const SubjectCost& a, const SubjectCost& b) {
+    return a.totalNs > b.totalNs;
+}
+
+void FrameTimings::clear(qint64 start) {
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++)
+        stages[i] = -1;
+    frameStart = start;
+    captureTime = 0;
+    subjects.resize(0);
+    counters = NULL;
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        for (int c = 0; c < HW_COUNTER_COUNT; c++)
+            counts[i][c] = -1;
+    }
+}
+
+void FrameTimings::startCounting(HardwareCounters* newCounters) {
+    counters = newCounters;
+    if (counters && ! counters->read(lastCounts))
+        counters = NULL;
+}
+
+void FrameTimings::lap(PipelineStage stage, qint64& mark) {
+    qint64 time = PipelineMetrics::now();
+    stages[stage] = qMax(stages[stage], (qint64)0) + time - mark;
+    //One read() per lap, only while counting.
+    CounterValues values;
+    if (counters && counters->read(values)) {
+        for (int c = 0; c < HW_COUNTER_COUNT; c++) {
+            if (values.values[c] >= 0)
+                counts[stage][c] = qMax(counts[stage][c], (qint64)0) + values.values[c] - lastCounts.values[c];
+        }
+        lastCounts = values;
+    }
+    //Laps double as the sub-phases of the frame on the timeline.
+    if (Timeline::isEnabled())
+        Timeline::record(stageNames[stage], mark, time);
+    mark = time;
+}
+
+PipelineMetrics::PipelineMetrics() :
+    enabled(true), countersEnabled(false), startTime(now())
+{
+    memset(counters, 0, sizeof(counters));
+    memset(coalesced, 0, sizeof(coalesced));
+    memset(occupiedNs, 0, sizeof(occupiedNs));
+}
+
+qint64 PipelineMetrics::now() {
+    return metricsClock().nsecsElapsed();
+}
+
+const char* PipelineMetrics::stageName(int stage) {
+    return stage >= 0 && stage < PIPELINE_STAGE_COUNT ? stageNames[stage] : "unknown";
+}
+
+const char* PipelineMetrics::handoffName(int handoff) {
+    return handoff >= 0 && handoff < PIPELINE_HANDOFF_COUNT ? handoffNames[handoff] : "unknown";
+}
+
+void PipelineMetrics::setEnabled(bool enable) {
+    enabled = enable;
+}
+
+bool PipelineMetrics::isEnabled() {
+    return enabled;
+}
+
+bool PipelineMetrics::setHardwareCounters(bool enable, QString& error) {
+    if (enable && ! HardwareCounters::probe(error)) {
+        qWarning() << "Pipeline Metrics: Hardware counters unavailable:" << qPrintable(error);
+        countersEnabled = false;
+        return false;
+    }
+    countersEnabled = enable;
+    return true;
+}
+
+bool PipelineMetrics::hardwareCountersEnabled() {
+    return countersEnabled;
+}
+
+void PipelineMetrics::reset() {
+    mutex.lock();
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++)
+        histograms[i].clear();
+    subjects.clear();
+    memset(counters, 0, sizeof(counters));
+    for (int i = 0; i < PIPELINE_HANDOFF_COUNT; i++) {
+        producerWaits[i].clear();
+        consumerWaits[i].clear();
+        residency[i].clear();
+    }
+    memset(coalesced, 0, sizeof(coalesced));
+    memset(occupiedNs, 0, sizeof(occupiedNs));
+    startTime = now();
+    mutex.unlock();
+}
+
+void PipelineMetrics::record(PipelineStage stage, qint64 ns) {
+    if (! enabled)
+        return;
+    mutex.lock();
+    histograms[stage].record(ns);
+    mutex.unlock();
+}
+
+void PipelineMetrics::addFrame(const FrameTimings& timings) {
+    if (! enabled)
+        return;
+    mutex.lock();
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        if (timings.stages[i] >= 0)
+            histograms[i].record(timings.stages[i]);
+        bool counted = false;
+        for (int c = 0; c < HW_COUNTER_COUNT; c++)
+            counted = counted || timings.counts[i][c] >= 0;
+        if (counted) {
+            StageCounters& stage = counters[i];
+            for (int c = 0; c < HW_COUNTER_COUNT; c++) {
+                //A counter missing on any frame stays missing, its sum would not be comparable.
+                if (timings.counts[i][c] < 0 || (stage.frames > 0 && stage.totals[c] < 0))
+                    stage.totals[c] = -1;
+                else stage.totals[c] = (stage.frames > 0 ? stage.totals[c] : 0) + timings.counts[i][c];
+            }
+            stage.frames++;
+        }
+    }
+    for (int i = 0; i < timings.subjects.size(); i++) {
+        const SubjectCost& sample = timings.subjects[i];
+        quint64 key = ((quint64)(quint32)sample.groupID << 32) | (quint32)sample.subjectID;
+        QHash<quint64, SubjectCost>::iterator it = subjects.find(key);
+        if (it == subjects.end()) {
+            SubjectCost cost = sample;
+            cost.frames = 1;
+            cost.maxNs = sample.totalNs;
+            subjects.insert(key, cost);
+        } else {
+            it->frames++;
+            it->totalNs += sample.totalNs;
+            it->maxNs = qMax(it->maxNs, sample.totalNs);
+        }
+    }
+    mutex.unlock();
+}
+
+void PipelineMetrics::recordWait(PipelineHandoff handoff, bool producer, qint64 ns) {
+    if (! enabled)
+        return;
+    mutex.lock();
+    if (producer)
+        producerWaits[handoff].record(ns);
+    else consumerWaits[handoff].record(ns);
+    mutex.unlock();
+}
+
+void PipelineMetrics::recordResidency(PipelineHandoff handoff, qint64 ns, bool replaced) {
+    if (! enabled)
+        return;
+    mutex.lock();
+    residency[handoff].record(ns);
+    occupiedNs[handoff] += ns;
+    if (replaced)
+        coalesced[handoff]++;
+    mutex.unlock();
+}
+
+LatencyHistogram PipelineMetrics::histogram(PipelineStage stage) {
+    mutex.lock();
+    LatencyHistogram copy = histograms[stage];
+    mutex.unlock();
+    return copy;
+}
+
+StageStats PipelineMetrics::statsOf(const LatencyHistogram& histogram, double seconds) {
+    StageStats stats;
+    stats.count = histogram.count();
+    stats.rate = seconds > 0 ? stats.count / seconds : 0;
+    stats.min = histogram.min();
+    stats.mean = histogram.mean();
+    stats.p50 = histogram.percentile(50);
+    stats.p90 = histogram.percentile(90);
+    stats.p99 = histogram.percentile(99);
+    stats.p999 = histogram.percentile(99.9);
+    stats.max = histogram.max();
+    return stats;
+}
+
+StageStats PipelineMetrics::stageStats(PipelineStage stage) {
+    mutex.lock();
+    LatencyHistogram copy = histograms[stage];
+    double seconds = (now() - startTime) / 1e9;
+    mutex.unlock();
+    return statsOf(copy, seconds);
+}
+
+QList<SubjectCost> PipelineMetrics::subjectCosts() {
+    mutex.lock();
+    QList<SubjectCost> costs = subjects.values();
+    mutex.unlock();
+    std::sort(costs.begin(), costs.end(), costlier);
+    return costs;
+}
+
+StageCounters PipelineMetrics::stageCounters(PipelineStage stage) {
+    mutex.lock();
+    StageCounters copy = counters[stage];
+    mutex.unlock();
+    return copy;
+}
+
+HandoffStats PipelineMetrics::handoffStats(PipelineHandoff handoff) {
+    mutex.lock();
+    LatencyHistogram producer = producerWaits[handoff];
+    LatencyHistogram consumer = consumerWaits[handoff];
+    LatencyHistogram resident = residency[handoff];
+    quint64 replaced = coalesced[handoff];
+    qint64 occupied = occupiedNs[handoff];
+    double seconds = (now() - startTime) / 1e9;
+    mutex.unlock();
+
+    HandoffStats stats;
+    stats.handoffs = resident.count();
+    stats.coalesced = replaced;
+    stats.occupancy = seconds > 0 ? qMin(occupied / 1e9 / seconds, 1.0) : 0;
+    stats.producerWait = statsOf(producer, seconds);
+    stats.consumerWait = statsOf(consumer, seconds);
+    stats.producerWaitMs = producer.mean() * producer.count() / 1e6;
+    stats.consumerWaitMs = consumer.mean() * consumer.count() / 1e6;
+    stats.residency = statsOf(resident, seconds);
+    return stats;
+}
+
+QString PipelineMetrics::bottleneck() {
+    HandoffStats capture = handoffStats(HANDOFF_CAPTURE);
+    if (capture.producerWait.count == 0 && capture.consumerWait.count == 0)
+        return QString();
+    //Processing starved for frames longer than it held the capture thread back: decoding can't keep up.
+    return capture.consumerWaitMs > capture.producerWaitMs ? "decode" : "processing";
+}
+
+QString PipelineMetrics::toCsv() {
+    QString csv;
+    QTextStream out(&csv);
+    out << "stage,count,rate_hz,min_us,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n";
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        StageStats stats = stageStats((PipelineStage)i);
+        out << stageName(i) << ',' << stats.count << ',' << stats.rate << ',' << stats.min / 1e3 << ','
+            << stats.mean / 1e3 << ',' << stats.p50 / 1e3 << ',' << stats.p90 / 1e3 << ','
+            << stats.p99 / 1e3 << ',' << stats.p999 / 1e3 << ',' << stats.max / 1e3 << '\n';
+    }
+    out << "\ngroup,subject,frames,total_ms,mean_us,max_us\n";
+    QList<SubjectCost> costs = subjectCosts();
+    for (int i = 0; i < costs.size(); i++) {
+        const SubjectCost& cost = costs[i];
+        out << cost.groupID << ',' << cost.subjectID << ',' << cost.frames << ',' << cost.totalNs / 1e6 << ','
+            << cost.totalNs / 1e3 / qMax(cost.frames, (quint64)1) << ',' << cost.maxNs / 1e3 << '\n';
+    }
+    out << "\nhandoff,handoffs,coalesced,occupancy,producer_wait_ms,producer_wait_p50_us,producer_wait_p99_us,"
+           "consumer_wait_ms,consumer_wait_p50_us,consumer_wait_p99_us,residency_p50_us,residency_p99_us\n";
+    for (int i = 0; i < PIPELINE_HANDOFF_COUNT; i++) {
+        HandoffStats handoff = handoffStats((PipelineHandoff)i);
+        out << handoffName(i) << ',' << handoff.handoffs << ',' << handoff.coalesced << ',' << handoff.occupancy << ','
+            << handoff.producerWaitMs << ',' << handoff.producerWait.p50 / 1e3 << ',' << handoff.producerWait.p99 / 1e3 << ','
+            << handoff.consumerWaitMs << ',' << handoff.consumerWait.p50 / 1e3 << ',' << handoff.consumerWait.p99 / 1e3 << ','
+            << handoff.residency.p50 / 1e3 << ',' << handoff.residency.p99 / 1e3 << '\n';
+    }
+    out << "bottleneck," << bottleneck() << '\n';
+    bool header = false;
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        StageCounters stage = stageCounters((PipelineStage)i);
+        if (stage.frames == 0)
+            continue;
+        if (! header) {
+            out << "\nstage,frames";
+            for (int c = 0; c < HW_COUNTER_COUNT; c++)
+                out << ',' << HardwareCounters::counterName(c) << "_per_frame";
+            out << ",ipc\n";
+            header = true;
+        }
+        out << stageName(i) << ',' << stage.frames;
+        for (int c = 0; c < HW_COUNTER_COUNT; c++) {
+            out << ',';
+            if (stage.totals[c] >= 0)
+                out << (double)stage.totals[c] / stage.frames;
+        }
+        out << ',';
+        if (stage.totals[HW_CYCLES] > 0 && stage.totals[HW_INSTRUCTIONS] >= 0)
+            out << (double)stage.totals[HW_INSTRUCTIONS] / stage.totals[HW_CYCLES];
+        out << '\n';
+    }
+    out.flush();
+    return csv;
+}
+
+QByteArray PipelineMetrics::toJson() {
+    QJsonArray stages;
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        StageStats stats = stageStats((PipelineStage)i);
+        QJsonObject stage;
+        stage["stage"] = stageName(i);
+        stage["count"] = (double)stats.count;
+        stage["rate_hz"] = stats.rate;
+        stage["min_us"] = stats.min / 1e3;
+        stage["mean_us"] = stats.mean / 1e3;
+        stage["p50_us"] = stats.p50 / 1e3;
+        stage["p90_us"] = stats.p90 / 1e3;
+        stage["p99_us"] = stats.p99 / 1e3;
+        stage["p999_us"] = stats.p999 / 1e3;
+        stage["max_us"] = stats.max / 1e3;
+        StageCounters counts = stageCounters((PipelineStage)i);
+        if (counts.frames > 0) {
+            QJsonObject perFrame;
+            for (int c = 0; c < HW_COUNTER_COUNT; c++) {
+                if (counts.totals[c] >= 0)
+                    perFrame[HardwareCounters::counterName(c)] = (double)counts.totals[c] / counts.frames;
+            }
+            if (counts.totals[HW_CYCLES] > 0 && counts.totals[HW_INSTRUCTIONS] >= 0)
+                perFrame["ipc"] = (double)counts.totals[HW_INSTRUCTIONS] / counts.totals[HW_CYCLES];
+            stage["counters_per_frame"] = perFrame;
+        }
+        stages.append(stage);
+    }
+    QJsonArray subjectArray;
+    QList<SubjectCost> costs = subjectCosts();
+    for (int i = 0; i < costs.size(); i++) {
+        QJsonObject subject;
+        subject["group"] = costs[i].groupID;
+        subject["subject"] = costs[i].subjectID;
+        subject["frames"] = (double)costs[i].frames;
+        subject["total_ms"] = costs[i].totalNs / 1e6;
+        subject["max_us"] = costs[i].maxNs / 1e3;
+        subjectArray.append(subject);
+    }
+    QJsonArray handoffs;
+    for (int i = 0; i < PIPELINE_HANDOFF_COUNT; i++) {
+        HandoffStats stats = handoffStats((PipelineHandoff)i);
+        QJsonObject handoff;
+        handoff["handoff"] = handoffName(i);
+        handoff["handoffs"] = (double)stats.handoffs;
+        handoff["coalesced"] = (double)stats.coalesced;
+        handoff["occupancy"] = stats.occupancy;
+        handoff["producer_wait_ms"] = stats.producerWaitMs;
+        handoff["producer_wait_p50_us"] = stats.producerWait.p50 / 1e3;
+        handoff["producer_wait_p99_us"] = stats.producerWait.p99 / 1e3;
+        handoff["consumer_wait_ms"] = stats.consumerWaitMs;
+        handoff["consumer_wait_p50_us"] = stats.consumerWait.p50 / 1e3;
+        handoff["consumer_wait_p99_us"] = stats.consumerWait.p99 / 1e3;
+        handoff["residency_p50_us"] = stats.residency.p50 / 1e3;
+        handoff["residency_p99_us"] = stats.residency.p99 / 1e3;
+        handoffs.append(handoff);
+    }
+    QJsonObject root;
+    root["stages"] = stages;
+    root["subjects"] = subjectArray;
+    root["handoffs"] = handoffs;
+    root["bottleneck"] = bottleneck();
+    return QJsonDocument(root).toJson();
+}
+
+bool PipelineMetrics::writeReport(QString filePath) {
+    QFile file(filePath);
+    if (! file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QByteArray report = filePath.endsWith(".json", Qt::CaseInsensitive) ? toJson() : toCsv().toUtf8();
+    return file.write(report) == report.size();
+}
@@ -0,0 +1,173 @@
+#ifndef PIPELINEMETRICS_H
+#define PIPELINEMETRICS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "LatencyHistogram.h"
+#include "HardwareCounters.h"
+
+//Stages a frame goes through, in pipeline order.
+enum PipelineStage {
+    PIPE_DECODE = 0,    //Seek and decode, CaptureThread.
+    PIPE_COLOR,         //Saturation boost and color space conversions.
+    PIPE_ROI,           //Elliptical search masks of the subjects.
+    PIPE_LABELS,        //Binary masks and connected components.
+    PIPE_KMEANS,        //Weighted k-means of the subjects that needed it.
+    PIPE_MOMENTS,       //Center of mass, direction and bounding box.
+    PIPE_PUBLISH,       //Export queue and snapshot publication.
+    PIPE_DISPLAY,       //Frame conversion and overlay, DisplayThread.
+    PIPE_FRAME,         //Whole process() call.
+    PIPE_LATENCY,       //From the end of decoding to publication.
+    PIPELINE_STAGE_COUNT
+};
+
+//Buffers frames are handed over through, in pipeline order.
+enum PipelineHandoff {
+    HANDOFF_CAPTURE = 0,    //ImageHandler slots, CaptureThread -> ProcessingThread.
+    HANDOFF_DISPLAY,        //ImageData, ProcessingThread -> DisplayThread.
+    PIPELINE_HANDOFF_COUNT
+};
+
+//Time spent on one subject, summed over the frames it was tracked in.
+struct SubjectCost {
+    int groupID;
+    int subjectID;
+    quint64 frames;
+    qint64 totalNs;
+    qint64 maxNs;
+};
+
+/*
+ * Stage times of one frame of the ProcessingThread. Filled in without locking and handed
+ * to PipelineMetrics::addFrame() once the frame is done.
+ */
+struct FrameTimings {
+    //Summed over all subjects, -1 if the stage did not run.
+    qint64 stages[PIPELINE_STAGE_COUNT];
+    qint64 frameStart;
+    //PipelineMetrics::now() when the frame was decoded, 0 if unknown.
+    qint64 captureTime;
+    //(group, subject, ns) of every subject tracked.
+    QVector<SubjectCost> subjects;
+    //Hardware counts per stage, summed over all subjects. -1 if not counted.
+    qint64 counts[PIPELINE_STAGE_COUNT][HW_COUNTER_COUNT];
+
+    FrameTimings() { clear(0); }
+    void clear(qint64 start);
+    //Counts the laps of this frame with the calling thread's counters. counters may be NULL.
+    void startCounting(HardwareCounters* counters);
+    //Adds the time (and counts) since mark to the stage and moves mark to now.
+    void lap(PipelineStage stage, qint64& mark);
+private:
+    HardwareCounters* counters;
+    CounterValues lastCounts;
+};
+
+//Hardware counts of one stage, summed over the frames it was counted in.
+struct StageCounters {
+    quint64 frames;
+    //-1 where the counter was not available.
+    qint64 totals[HW_COUNTER_COUNT];
+};
+
+//Summary of one stage.
+struct StageStats {
+    quint64 count;
+    //Samples per second since the last reset.
+    double rate;
+    qint64 min;
+    double mean;
+    qint64 p50;
+    qint64 p90;
+    qint64 p99;
+    qint64 p999;
+    qint64 max;
+};
+
+//Summary of one handoff.
+struct HandoffStats {
+    //Frames put into the buffer, and those replaced before the consumer took them.
+    quint64 handoffs;
+    quint64 coalesced;
+    //Share of the time the buffer held a frame the consumer had not taken yet.
+    double occupancy;
+    //Producer blocked on a free slot (backpressure), consumer blocked on a frame (starvation).
+    StageStats producerWait;
+    StageStats consumerWait;
+    double producerWaitMs;
+    double consumerWaitMs;
+    //Time a frame sat in the buffer until it was taken or replaced.
+    StageStats residency;
+};
+
+/*
+ * Latency histograms of every pipeline stage plus per-subject costs, fed by the Capture,
+ * Processing and Display threads, and the waits at the handoffs between them. The
+ * ProcessingThread takes the lock once per frame, everything else once per sample, so it
+ * can stay enabled in production.
+ * Thread safe.
+ */
+class PipelineMetrics
+{
+public:
+    PipelineMetrics();
+
+    //Nanoseconds on a monotonic clock shared by all threads.
+    static qint64 now();
+    static const char* stageName(int stage);
+
+    void setEnabled(bool enabled);
+    bool isEnabled();
+    //Reads hardware counters around the ProcessingThread's stages. Returns false with the
+    //reason in error if they are not available, counting stays off then.
+    bool setHardwareCounters(bool enabled, QString& error);
+    bool hardwareCountersEnabled();
+    void reset();
+
+    void record(PipelineStage stage, qint64 ns);
+    void addFrame(const FrameTimings& timings);
+    //Time the producer (or consumer) of a handoff was blocked on it.
+    void recordWait(PipelineHandoff handoff, bool producer, qint64 ns);
+    //A frame left the buffer after ns, taken by the consumer or replaced (coalesced).
+    void recordResidency(PipelineHandoff handoff, qint64 ns, bool coalesced);
+
+    LatencyHistogram histogram(PipelineStage stage);
+    StageStats stageStats(PipelineStage stage);
+    //Most expensive first.
+    QList<SubjectCost> subjectCosts();
+    StageCounters stageCounters(PipelineStage stage);
+    HandoffStats handoffStats(PipelineHandoff handoff);
+    static const char* handoffName(int handoff);
+    //"decode" or "processing", whichever holds the other back more; empty without data.
+    //The display cannot hold back tracking, it skips (coalesces) frames instead.
+    //Waits while the video is paused are not recorded, see ImageHandler::setPlaying().
+    QString bottleneck();
+
+    //Stage table, a blank line, then the subject table, the handoff table, and the counts
+    //per frame of the counted stages if there are any. Times in microseconds unless named.
+    QString toCsv();
+    QByteArray toJson();
+    //JSON for a ".json" path, CSV otherwise.
+    bool writeReport(QString filePath);
+private:
+    QMutex mutex;
+    volatile bool enabled;
+    volatile bool countersEnabled;
+    qint64 startTime;
+    LatencyHistogram histograms[PIPELINE_STAGE_COUNT];
+    QHash<quint64, SubjectCost> subjects;
+    StageCounters counters[PIPELINE_STAGE_COUNT];
+    LatencyHistogram producerWaits[PIPELINE_HANDOFF_COUNT];
+    LatencyHistogram consumerWaits[PIPELINE_HANDOFF_COUNT];
+    LatencyHistogram residency[PIPELINE_HANDOFF_COUNT];
+    quint64 coalesced[PIPELINE_HANDOFF_COUNT];
+    qint64 occupiedNs[PIPELINE_HANDOFF_COUNT];
+
+    static StageStats statsOf(const LatencyHistogram& histogram, double seconds);
+};
+
+#endif // PIPELINEMETRICS_H
@@ -3,19 +3,76 @@
 #include "Utilities.h"
 #include "MedianCut.h"
 #include "DisjointSets.h"
+#include "Trace.h"
+#include "Timeline.h"
 
 #include "opencv2/imgproc/imgproc.hpp"
+#include <algorithm>
+#include <cstring>
 
 ProcessingThread::ProcessingThread(ImageHandler* iHandler, ImageData* iData) : currentIndex(-1)
 {
     stopped = false;
     hasBackgroundPalette = false;
+    debugWindows = false;
+    foregroundChanged = true;
     imageHandler = iHandler;
     imageData = iData;
+    trackExporter = NULL;
+    checkpointWriter = NULL;
+    videoCache = NULL;
+    lastCheckpointFrame = 0;
+    trackedUpTo = -1;
+    frameBuffers = 0;
+    metrics = NULL;
+    currentCaptureTime = 0;
+    memset(&arenaStats, 0, sizeof(arenaStats));
+    registry.setTrajectoryStore(&trajectories);
+}
+
+//Opens the HighGUI debug windows. Never called in headless mode.
+void ProcessingThread::setDebugWindows(bool enabled) {
+    debugWindows = enabled;
+    if (debugWindows) {
+        cvNamedWindow("BinMask");
+        cvNamedWindow("Binary");
+    }
+}
+
+//Tracks are handed to the exporter at the publish point of every frame.
+void ProcessingThread::setTrackExporter(TrackExporter* exporter) {
+    frameProtectMutex.lock();
+    trackExporter = exporter;
+    frameProtectMutex.unlock();
+}
+
+void ProcessingThread::setMetrics(PipelineMetrics* newMetrics) {
+    frameProtectMutex.lock();
+    metrics = newMetrics;
+    frameProtectMutex.unlock();
+}
 
-    cvNamedWindow("BinMask");
-    cvNamedWindow("Binary");
-//    cvNamedWindow("Ellipse");
+//Called before the thread is started.
+void ProcessingThread::setVideoCache(VideoCache* cache, QString path) {
+    videoCache = cache;
+    videoPath = path;
+    Mat palette;
+    if (cache && ! hasBackgroundPalette && cache->backgroundPalette(path, palette)) {
+        qDebug() << "Processing Thread: Background palette of " << path << " taken from cache.";
+        groupsMutex.lock();
+        backgroundPalette = palette;
+        groupsMutex.unlock();
+        sharedMutex.lock();
+        sharedPalette = palette;
+        sharedMutex.unlock();
+        hasBackgroundPalette = true;
+    }
+}
+
+void ProcessingThread::setCheckpointWriter(CheckpointWriter* writer) {
+    frameProtectMutex.lock();
+    checkpointWriter = writer;
+    frameProtectMutex.unlock();
 }
 
 void ProcessingThread::run() {
@@ -23,9 +80,9 @@ void ProcessingThread::run() {
 
     while (1) {
         //Get frame from ImageHandler if possible, otherwise wait
-        qDebug() << "Processing Thread: Waiting for Processing Slot.";
+        TRACE_DEBUG("Processing Thread: Waiting for Processing Slot.");
         imageHandler->getProcSlot();
-        qDebug() << "Processing Thread: Acquired Processing Slot.";
+        TRACE_DEBUG("Processing Thread: Acquired Processing Slot.");
 
         //STOP CHECK
         stoppedMutex.lock();
@@ -40,14 +97,23 @@ void ProcessingThread::run() {
         frameProtectMutex.lock();
         currentFrame = imageHandler->getFrame();
         currentIndex = imageHandler->currentIndex();
+        currentCaptureTime = imageHandler->captureTime();
         frameProtectMutex.unlock();
 
-        qDebug() << "Processing Thread: Releasing Input Slot.";
+        TRACE_DEBUG("Processing Thread: Releasing Input Slot.");
         imageHandler->releaseReadSlot();
 
         if (!hasBackgroundPalette) {
-            backgroundPalette = findBackgroundColors();
+            Mat palette = findBackgroundColors();
+            groupsMutex.lock();
+            backgroundPalette = palette;
+            groupsMutex.unlock();
+            sharedMutex.lock();
+            sharedPalette = palette;
+            sharedMutex.unlock();
             hasBackgroundPalette = true;
+            if (videoCache)
+                videoCache->storeBackgroundPalette(videoPath, palette);
         }
 
         //Initiate Processing for Current Frame
@@ -57,9 +123,22 @@ void ProcessingThread::run() {
 }
 
 void ProcessingThread::process() {
-    qDebug() << "Processing Thread: Processing...";
-    Mat tempFrame;
+    TRACE_DEBUG("Processing Thread: Processing frame %1", currentIndex);
+    //All scratch memory of the previous frame is released at once.
+    Timeline::Span frameSpan("process", "frame", currentIndex);
+    FrameArena* arena = FrameArena::current();
+    arena->reset();
+    arena->setStage(STAGE_FRAME);
+    //Subjects only change between frames, see applyEdits().
+    groupsMutex.lock();
     frameProtectMutex.lock();
+    qint64 mark = PipelineMetrics::now();
+    timings.clear(mark);
+    timings.captureTime = currentCaptureTime;
+    if (metrics && metrics->hardwareCountersEnabled())
+        timings.startCounting(HardwareCounters::current());
+    //cvtColor writes into a destination of the right size and type in place.
+    Mat tempFrame = arena->mat(currentFrame.rows, currentFrame.cols, CV_8UC3);
     //Adjust the Saturation of the Received Image
     cvtColor(currentFrame, tempFrame, CV_BGR2HSV);
     for (int i = 0; i < tempFrame.rows; i++) {
@@ -67,11 +146,43 @@ void ProcessingThread::process() {
             tempFrame.data[tempFrame.step*i + tempFrame.channels()*j + 1] += 25;
         }
     }
-    cvtColor(tempFrame, currentFrame, CV_HSV2BGR);
+    //Into a buffer of its own: the frame held so far may already have been published (e.g. by
+    //updateSubjects() between the handover and here), and a published frame is never written.
+    Mat boostedFrame = takeFrameBuffer(currentFrame.rows, currentFrame.cols);
+    cvtColor(tempFrame, boostedFrame, CV_HSV2BGR);
+    currentFrame = boostedFrame;
+    timings.lap(PIPE_COLOR, mark);
+
+    //A frame tracked before is shown as it was tracked then. Tracking it again would
+    //start from the state of a later frame, and its rows were exported when it was first tracked.
+    const TrackingResult* cached = resultCache.find(currentIndex);
+    if (cached || currentIndex <= trackedUpTo) {
+        if (cached) {
+            TRACE_DEBUG("Processing Thread: Restoring cached result of frame %1", currentIndex);
+            restoreResult(*cached);
+        } else {
+            TRACE_DEBUG("Processing Thread: Restoring recorded poses of frame %1", currentIndex);
+            restoreRecorded();
+        }
+        //An edit makes it the last frame tracked, and its rows are exported again.
+        bool edited = applyEdits();
+        if (edited)
+            dropLaterResults();
+        TrackingSnapshot* snapshot = buildSnapshot();
+        if (edited)
+            rememberResult(*snapshot);
+        finishFrame(snapshot, edited);
+        return;
+    }
+
     cvtColor(currentFrame, tempFrame, CV_BGR2Lab);
+    timings.lap(PIPE_COLOR, mark);
+    //Search windows of all subjects in one pass over the kinematic arrays.
+    KinematicStore& kinematics = registry.kinematics();
+    kinematics.computeSearchWindows();
+
     //Iterate through all of the groups and then their subjects.
     map<int, SubjectGroup*>::iterator it1;
-    map<int, Subject*>::iterator it2;
 
     Subject* subject;
     QRectF searchFrame;
@@ -79,68 +190,48 @@ void ProcessingThread::process() {
     float newAngle;
     QPointF newPos;
     int groupID;
-    Mat binMat, labels;
+    Mat labels;
     int numLabels;
-    for (it1 = int_groups.begin(); it1 != int_groups.end() && ! imageData->halted(); it1++) {
+    for (it1 = int_groups.begin(); it1 != int_groups.end() && (imageData == NULL || ! imageData->halted()); it1++) {
         //Iterate through Groups.
-        IntSubjectMap tempMap = it1->second->getSubjects();
-        for (it2 = tempMap.begin(); it2 != tempMap.end(); it2++) {
-            //Iterate through each Subject Group.
+        QPair<int, int> range = registry.groupRange(it1->first);
+        for (int index = range.first; index < range.second; index++) {
+            //Iterate through each Subject of the Group.
+            //Scratch memory of one subject is released before the next.
+            FrameArena::Scope subjectScope(arena);
+            qint64 subjectStart = mark;
             //Get Subject Properties
-            subject = it2->second;
-            searchFrame = subject->getCurrentBoundingFrame();
-            groupID = subject->getGroupID();
-            angle = subject->dir();
-            Point2f center = Point2f(subject->pos().x(), subject->pos().y());
-
-            //Get Major Axis.
-            int a = 1.5*max(searchFrame.height(), searchFrame.width());
-            int b = min(searchFrame.height(), searchFrame.width());
-            qDebug() << "A: " << a << " , " << "B: " << b;
-            Point2f a1 = center, a2 = center, b1 = center, b2 = center;
-
-            //Calculate major axis endpoints.
-            a1.x = a*cos(angle) - a*sin(angle);
-            a1.y = a*sin(angle) + a*cos(angle);
-            a2.x = a*sin(angle) - a*cos(angle);
-            a2.y = -a*sin(angle) - a*cos(angle);
-
-            qDebug() << "A1: {" << a1.x << "," << a1.y << "}";
-            qDebug() << "A2: {" << a2.x << "," << a2.y << "}";
-
-            //Calculate transverse (minor) axis endpoints.
-            b1.x = b*cos(angle) - b*sin(angle);
-            b1.y = b*sin(angle) + b*cos(angle);
-            b2.x = b*sin(angle) - b*cos(angle);
-            b2.y = -b*sin(angle) - b*cos(angle);
-
-            qDebug() << "B1: {" << b1.x << "," << b1.y << "}";
-            qDebug() << "B2: {" << b2.x << "," << b2.y << "}";
-
-            //Calculate the new bounding rectangle based upon the min-max coordinates of the points.
-            Point2f p1, p2;
-            p1.x = max(max(a1.x, a2.x), max(b1.x, b2.x)) + center.x;// + searchFrame.center().x();
-            p1.y = max(max(a1.y, a2.y), max(b1.y, b2.y)) + center.y;// + searchFrame.center().y();
-            p2.x = min(min(a1.x, a2.x), min(b1.x, b2.x)) + center.x;// + searchFrame.center().x();
-            p2.y = min(min(a1.y, a2.y), min(b1.y, b2.y)) + center.y;// + searchFrame.center().y();
-
-            qDebug() << "EFrame Properties: " << floor(p2.x) << ", " << floor(p2.y) << ", " << floor(p1.x - p2.x) << ", " << floor(p1.y - p2.y);
-
-            QRectF eFrame(floor(p2.x), floor(p2.y), floor(p1.x - p2.x), floor(p1.y - p2.y));
+            subject = registry.at(index);
+            Timeline::Span subjectSpan("subject", "subject", subject->getID());
+            groupID = it1->first;
+            angle = kinematics.heading[index];
+            Point2f center = Point2f(kinematics.x[index], kinematics.y[index]);
+
+            //Major axis along the heading, minor axis across it.
+            int a = kinematics.axisMajor[index];
+            int b = kinematics.axisMinor[index];
+            TRACE_VERBOSE("A: %1, B: %2", a, b);
+
+            QRectF eFrame(kinematics.winLeft[index], kinematics.winTop[index],
+                          kinematics.winWidth[index], kinematics.winHeight[index]);
+            TRACE_VERBOSE("EFrame Properties: %1, %2, %3, %4", eFrame.left(), eFrame.top(), eFrame.width(), eFrame.height());
 
             //EFrame serves as the bounding rectangle for the elliptical mask.
             //Create the ellipse mask.
-            Mat eMask = Mat::zeros(tempFrame.rows, tempFrame.cols, CV_8UC3);
+            arena->setStage(STAGE_MASK);
+            Mat eMask = arena->zeros(tempFrame.rows, tempFrame.cols, CV_8UC3);
             ellipse(eMask, center, Size(a, b), rad2Deg(angle-PI/2), 0, 360, Scalar(255, 255, 255), -1);
             eMask = mask(tempFrame, eMask);
+            timings.lap(PIPE_ROI, mark);
 
+            arena->setStage(STAGE_LABELS);
             Mat binMat = extractBinaryMat(eMask, eFrame, int_currentForeground[groupID]);
 
             //Get Components.
             pair<Mat, int> labelPair = extractComponentLabels(binMat);
             labels = labelPair.first;
             numLabels = labelPair.second;
-            map<int, int> labelSizes;
+            ArenaCountMap labelSizes;
             for (int i = 0; i < numLabels; i++) {
                 labelSizes[i] = 0;
             }
@@ -151,7 +242,7 @@ void ProcessingThread::process() {
                 }
             }
             bool hasOutlier = false;
-            map<int, int>::iterator it3;
+            ArenaCountMap::iterator it3;
             float labelsMean = 0;
             float labelsVariance = 0;
             float labelsMaxVariance = 0;
@@ -167,7 +258,7 @@ void ProcessingThread::process() {
                 } else if (maxLabel == sMaxLabel || (*it3).second > labelSizes[sMaxLabel]) {
                     sMaxLabel = (*it3).first;
                 }
-                qDebug() << (*it3).first << ": " << (*it3).second;
+                TRACE_VERBOSE("%1: %2", (*it3).first, (*it3).second);
             }
             labelsMean /= labelSizes.size();
             labelsMaxVariance = pow((double)(labelSizes[maxLabel] - labelsMean), 2);
@@ -175,27 +266,30 @@ void ProcessingThread::process() {
                 labelsVariance += pow((*it3).second - labelsMean, 2);
             }
             labelsVariance /= labelSizes.size();
+            timings.lap(PIPE_LABELS, mark);
 
-            qDebug() << "Max Label: (" << maxLabel << ", " << labelSizes[maxLabel] << ")";
-            qDebug() << "Second Max Label: (" << sMaxLabel << ", " << labelSizes[sMaxLabel] << ")";
-            qDebug() << "Labels Mean: " << labelsMean;
-            qDebug() << "Labels Variance: " << labelsVariance;
-            qDebug() << "Labels Maxes Variance: " << labelsMaxVariance;
+            TRACE_VERBOSE("Max Label: (%1, %2)", maxLabel, labelSizes[maxLabel]);
+            TRACE_VERBOSE("Second Max Label: (%1, %2)", sMaxLabel, labelSizes[sMaxLabel]);
+            TRACE_VERBOSE("Labels Mean: %1", labelsMean);
+            TRACE_VERBOSE("Labels Variance: %1", labelsVariance);
+            TRACE_VERBOSE("Labels Maxes Variance: %1", labelsMaxVariance);
 
             hasOutlier = (labelsMaxVariance > labelsVariance);
             if (! hasOutlier) {
                 //K-Means Data Containers
-                list<Point3_<uchar> >* centers = new list<Point3_<uchar> >();
-                IntClusterMap* clusters = new IntClusterMap();
-                ColorFrequencyMap* colorFreqs = new ColorFrequencyMap();
-                list<Point3_<uchar> >::iterator it1, it2;
+                arena->setStage(STAGE_KMEANS);
+                ArenaColorList centers;
+                ArenaClusterMap clusters;
+                ArenaFrequencyMap colorFreqs;
+                ArenaColorList::iterator it1, it2;
 
-                int kruns = awkmeans(eMask, eFrame, centers, clusters, colorFreqs, groupID);
-                qDebug() << "Ran k-means for " << kruns << " runs.";
+                Point3_<uchar> groupColor = int_groups[groupID]->getColorPoint();
+                int kruns = awkmeans(eMask, eFrame, &centers, &clusters, &colorFreqs, backgroundPalette, &groupColor);
+                TRACE_VERBOSE("Ran k-means for %1 runs.", kruns);
 
                 double minDistance = std::numeric_limits<double>::max();
                 int m = -1, k;
-                for (it1 = centers->begin(), k = 0; it1 != centers->end(); it1++, k++) {
+                for (it1 = centers.begin(), k = 0; it1 != centers.end(); it1++, k++) {
                     double distance = colorDistance(int_groups[groupID]->getColorPoint(), *it1);
                     if (distance < minDistance) {
                         minDistance = distance;
@@ -207,15 +301,21 @@ void ProcessingThread::process() {
                 //qDebug() << "Adding clusters[m] set to group: " << groupID << " for center " << m;
 
                 //Add newly found colors of set to stored cluster. Set properties guarantee uniqueness.
-                int_currentForeground[groupID].insert((*clusters)[m].begin(), (*clusters)[m].end());
+                size_t learned = int_currentForeground[groupID].size();
+                int_currentForeground[groupID].insert(clusters[m].begin(), clusters[m].end());
+                if (int_currentForeground[groupID].size() != learned)
+                    foregroundChanged = true;
                 //Check for convergence. (Later)
+                timings.lap(PIPE_KMEANS, mark);
 
                 //Update Binary Matrix.
+                arena->setStage(STAGE_LABELS);
                 binMat = extractBinaryMat(eMask, eFrame, int_currentForeground[groupID]);
+                timings.lap(PIPE_LABELS, mark);
             }
 
-            IplImage* tempImg = new IplImage(binMat);
-            cvShowImage("Binary", tempImg);
+            if (debugWindows)
+                imshow("Binary", binMat);
 
             //TEMPORARY - get largest cluster
             //binMat = sizeFilter(binMat);
@@ -226,7 +326,7 @@ void ProcessingThread::process() {
 
             Point2f tempPos = getCenterOfMass(binMat);
             newAngle = getDirection(Point2f(tempPos.y, tempPos.x), binMat);
-            qDebug() << "Angle: " << newAngle;
+            TRACE_VERBOSE("Angle: %1", newAngle);
 
             //Rectangle has coordinates with respect to binMat.
             //Recall that binMat is fixed within the eFrame.
@@ -239,17 +339,86 @@ void ProcessingThread::process() {
             subject->setCurrentBoundingFrame(searchFrame);
             subject->setPos(QPointF(tempPos.x + eFrame.left(), tempPos.y + eFrame.top()));
             subject->setDirection(newAngle);
+            subject->record(currentIndex, &trajectories);
+            timings.lap(PIPE_MOMENTS, mark);
+
+            SubjectCost cost = { groupID, subject->getID(), 1, mark - subjectStart, mark - subjectStart };
+            timings.subjects.append(cost);
         }
     }
 
+    trackedUpTo = currentIndex;
+    //Frame boundary: subjects initialized and edits made while this frame was tracked apply from here on.
+    if (applyEdits())
+        dropLaterResults();
+
+    TrackingSnapshot* snapshot = buildSnapshot();
+    rememberResult(*snapshot);
+    finishFrame(snapshot, true);
+}
+
+Mat ProcessingThread::takeFrameBuffer(int rows, int cols) {
+    for (int i = 0; i < framePool.size(); i++) {
+        //Only the pool holds it: every snapshot it was published with has been released.
+        Mat& buffer = framePool[i];
+        if (buffer.refcount && *buffer.refcount == 1 && buffer.rows == rows && buffer.cols == cols)
+            return buffer;
+    }
+    frameBuffers++;
+    Mat buffer(rows, cols, CV_8UC3);
+    //A buffer of another size (a new video) is replaced, otherwise the pool grows to its size.
+    for (int i = 0; i < framePool.size(); i++) {
+        if (framePool[i].rows != rows || framePool[i].cols != cols) {
+            framePool[i] = buffer;
+            return buffer;
+        }
+    }
+    if (framePool.size() < FRAME_POOL_SIZE)
+        framePool.append(buffer);
+    return buffer;
+}
+
+void ProcessingThread::finishFrame(TrackingSnapshot* snapshot, bool exportRows) {
+    FrameArena* arena = FrameArena::current();
+    qint64 mark = PipelineMetrics::now();
+    //Only copies the poses into the exporter's queue, the file is written on its own thread.
+    if (trackExporter && exportRows)
+        trackExporter->submit(*snapshot);
+    shareSnapshot(*snapshot);
+    //Hand the frame to the display (if any). This never waits for it to be painted.
+    if (imageData)
+        imageData->setData(snapshot);
+    else delete snapshot;
+    timings.lap(PIPE_PUBLISH, mark);
+    //Only the copy of the state is made here, the file is written on the pool.
+    if (checkpointWriter && exportRows && currentIndex >= 0) {
+        int interval = checkpointWriter->interval();
+        if (interval > 0 && qAbs(currentIndex - lastCheckpointFrame) >= interval) {
+            checkpointWriter->submit(captureState());
+            lastCheckpointFrame = currentIndex;
+        }
+    }
+    int processedIndex = currentIndex;
+    arenaStats = arena->getStats();
+    arenaStats.frameBuffers = frameBuffers;
+    if (metrics) {
+        timings.stages[PIPE_FRAME] = mark - timings.frameStart;
+        if (timings.captureTime > 0)
+            timings.stages[PIPE_LATENCY] = mark - timings.captureTime;
+        metrics->addFrame(timings);
+    }
     frameProtectMutex.unlock();
-    imageData->getReadSlot();
-    frameProtectMutex.lock();
-    imageData->setData(currentFrame, currentIndex, int_groups);
-    frameProtectMutex.unlock();
+    groupsMutex.unlock();
+
+    //A job may have finished or an edit been made after the edits were applied above,
+    //while its own attempt found the groups locked.
+    jobsMutex.lock();
+    bool hasPending = ! pendingEdits.isEmpty();
+    jobsMutex.unlock();
+    if (hasPending)
+        QMetaObject::invokeMethod(this, "applyPendingEdits", Qt::QueuedConnection);
 
-    //qDebug() << "Processing Thread: Releasing write slot for imageData.";
-    imageData->releaseWriteSlot();
+    emit frameProcessed(processedIndex);
 }
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -296,66 +465,508 @@ void ProcessingThread::trimBackgroundPalette(list<Point3_<uchar> >* bgPalette) {
     }
 }
 
+QFuture<SubjectInitResult> ProcessingThread::submitSubject(int groupID, int subjectID, QRectF bound, Mat source, int frameIndex) {
+    SubjectInitRequest request;
+    request.groupID = groupID;
+    request.subjectID = subjectID;
+    request.frameIndex = frameIndex;
+    request.bound = bound;
+    request.source = source;
+
+    sharedMutex.lock();
+    if (sharedGroupColors.contains(groupID))
+        request.groupColor = sharedGroupColors[groupID];
+    request.backgroundPalette = sharedPalette;
+    sharedMutex.unlock();
+
+    QPair<int, int> key(groupID, subjectID);
+    jobsMutex.lock();
+    //The box was redrawn before the previous job finished.
+    if (subjectJobs.contains(key))
+        subjectJobs[key].cancel();
+    request.generation = ++subjectJobGenerations[key];
+    SubjectInitJob* job = new SubjectInitJob(this, request);
+    QFuture<SubjectInitResult> future = job->start(QThreadPool::globalInstance());
+    subjectJobs[key] = future;
+    jobsMutex.unlock();
+
+    return future;
+}
+
 void ProcessingThread::addSubject(int groupID, int subjectID, QRectF bound, Mat source, int frameIndex) {
-    Mat dest;
-    QRectF fittedBound;
-    list<Point3_<uchar> >* centers = new list<Point3_<uchar> >();
-    IntClusterMap* clusters = new IntClusterMap();
-    ColorFrequencyMap* colorFreqs = new ColorFrequencyMap();
-    list<Point3_<uchar> >::iterator it1, it2;
+    submitSubject(groupID, subjectID, bound, source, frameIndex).waitForFinished();
+
+    groupsMutex.lock();
+    bool changed = applyEdits();
+    if (changed)
+        resultsEdited();
+    groupsMutex.unlock();
+
+    //Pass update to DisplayThread.
+    if (changed)
+        updateSubjects();
+}
+
+void ProcessingThread::queueSubjectResult(const SubjectInitResult &result) {
+    TrackerEdit edit;
+    edit.kind = TrackerEdit::SUBJECT_INITIALIZED;
+    edit.groupID = result.groupID;
+    edit.subjectID = result.subjectID;
+    edit.result = result;
+    queueEdit(edit);
+}
+
+void ProcessingThread::queueEdit(const TrackerEdit &edit) {
+    jobsMutex.lock();
+    pendingEdits.append(edit);
+    jobsMutex.unlock();
+    QMetaObject::invokeMethod(this, "applyPendingEdits", Qt::QueuedConnection);
+}
+
+void ProcessingThread::applyPendingEdits() {
+    //While a frame is processed it applies the edits itself at its end.
+    if (! groupsMutex.tryLock())
+        return;
+    bool changed = applyEdits();
+    if (changed)
+        resultsEdited();
+    groupsMutex.unlock();
+
+    if (changed)
+        updateSubjects();
+}
+
+bool ProcessingThread::applyEdits() {
+    jobsMutex.lock();
+    QList<TrackerEdit> edits;
+    edits.swap(pendingEdits);
+    QMap<QPair<int, int>, int> generations = subjectJobGenerations;
+    jobsMutex.unlock();
+
+    bool changed = false;
+    for (int i = 0; i < edits.size(); i++) {
+        const TrackerEdit& edit = edits[i];
+        switch (edit.kind) {
+        case TrackerEdit::SUBJECT_INITIALIZED: {
+            const SubjectInitResult& result = edit.result;
+            //Superseded by a newer box, or the group was removed in the meantime.
+            if (generations.value(qMakePair(result.groupID, result.subjectID)) != result.generation)
+                break;
+            if (! result.found || ! int_groups.count(result.groupID))
+                break;
+            //Store the subject's cluster in the foreground maps.
+            int_currentForeground[result.groupID] = result.cluster;
+            foregroundChanged = true;
+            //Store the subject, replacing an earlier one with the same ID.
+            registry.insert(Subject(result.bound, result.pos, result.dir, result.cluster,
+                                    result.subjectID, result.groupID, result.frameIndex));
+            changed = true;
+            break;
+        }
+        case TrackerEdit::SUBJECT_REMOVED:
+            if (registry.remove(edit.groupID, edit.subjectID))
+                changed = true;
+            break;
+        case TrackerEdit::DIRECTION_SET: {
+            Subject* subject = registry.find(edit.groupID, edit.subjectID);
+            if (subject) {
+                subject->setDirection(edit.dir);
+                changed = true;
+            }
+            break;
+        }
+        case TrackerEdit::GROUP_COLOR_SET:
+            if (int_groups.count(edit.groupID)) { //Already contains key
+                SubjectGroup* group = int_groups[edit.groupID];
+                //groups is keyed by color, so the group moves to its new key.
+                eraseGroupKey(group);
+                group->setColor(edit.color);
+                groups[group->getColorString()] = group;
+                //No need to alter the int_groups as it contains the pointer.
+            }
+            else {
+                SubjectGroup* tempGroup = new SubjectGroup(edit.color, edit.groupID);
+                groups[color2Hex(edit.color)] = tempGroup;
+                int_groups[edit.groupID] = tempGroup;
+            }
+            //Later frames were tracked with the old color.
+            changed = true;
+            break;
+        case TrackerEdit::GROUP_REMOVED:
+            if (int_groups.count(edit.groupID)) {
+                SubjectGroup* group = int_groups[edit.groupID];
+                eraseGroupKey(group);
+                int_groups.erase(edit.groupID);
+                int_currentForeground.erase(edit.groupID);
+                registry.removeGroup(edit.groupID);
+                //Snapshots only hold poses, nothing refers to the group anymore.
+                delete group;
+                foregroundChanged = true;
+                changed = true;
+            }
+            break;
+        }
+    }
+    return changed;
+}
+
+//By pointer: the key may no longer match the group's color, and another group of the same
+//color may have taken it over.
+void ProcessingThread::eraseGroupKey(SubjectGroup* group) {
+    StringGroupMap::iterator it = groups.begin();
+    while (it != groups.end()) {
+        if (it->second == group)
+            groups.erase(it++);
+        else it++;
+    }
+}
+
+//Subjects removed since keep being removed, subjects added since keep their pose.
+void ProcessingThread::restoreResult(const TrackingResult& result) {
+    for (int i = 0; i < result.subjects.size(); i++) {
+        const SubjectPose& pose = result.subjects[i];
+        Subject* subject = registry.find(pose.groupID, pose.subjectID);
+        if (subject == NULL)
+            continue;
+        subject->setPos(pose.pos);
+        subject->setDirection(pose.dir);
+        subject->setCurrentBoundingFrame(pose.bound);
+    }
+    if (result.foreground) {
+        int_currentForeground = *result.foreground;
+        sharedForeground = result.foreground;
+        foregroundChanged = false;
+    }
+}
+
+//Frames evicted from the cache are shown with the poses their trajectories hold: the pose
+//recorded on the frame, or on the latest frame before it the ring still holds. Subjects
+//recorded on neither keep their pose.
+void ProcessingThread::restoreRecorded() {
+    //Only read from the store once a subject's ring does not reach back far enough.
+    QMap<QPair<int, int>, TrajectorySample> stored;
+    bool storeRead = false;
+    for (int i = 0; i < registry.size(); i++) {
+        Subject* subject = registry.at(i);
+        TrajectorySample sample;
+        if (! subject->getTrajectory().sampleAt(currentIndex, sample)) {
+            if (! storeRead) {
+                QVector<TrajectoryPose> poses = trajectories.posesAt(currentIndex);
+                for (int j = 0; j < poses.size(); j++)
+                    stored.insert(qMakePair(poses[j].groupID, poses[j].subjectID), poses[j].sample);
+                storeRead = true;
+            }
+            QMap<QPair<int, int>, TrajectorySample>::const_iterator it =
+                    stored.constFind(qMakePair(subject->getGroupID(), subject->getID()));
+            if (it == stored.constEnd())
+                continue;
+            sample = it.value();
+        }
+        subject->setPos(sample.pos);
+        subject->setDirection(sample.dir);
+        subject->setCurrentBoundingFrame(sample.bound);
+    }
+}
+
+void ProcessingThread::rememberResult(const TrackingSnapshot& snapshot) {
+    if (snapshot.frameIndex < 0)
+        return;
+    //Learned colors rarely change from one frame to the next, so most results share them.
+    if (foregroundChanged || ! sharedForeground) {
+        sharedForeground = QSharedPointer<const IntClusterMap>(new IntClusterMap(int_currentForeground));
+        foregroundChanged = false;
+    }
+    resultCache.store(snapshot.frameIndex, snapshot, sharedForeground);
+}
+
+//Results, trails, trajectories and exported rows of frames after the current one no longer
+//follow from it. The current frame becomes the last one tracked, with the poses it has now.
+void ProcessingThread::dropLaterResults() {
+    resultCache.invalidateAfter(currentIndex);
+    for (int i = 0; i < registry.size(); i++) {
+        if (currentIndex >= 0)
+            registry.at(i)->record(currentIndex, &trajectories);
+        else registry.at(i)->truncateTrajectory(currentIndex);
+    }
+    trackedUpTo = currentIndex;
+    //The caller exports the current frame again.
+    if (trackExporter && currentIndex >= 0)
+        trackExporter->rewind(currentIndex - 1);
+}
+
+void ProcessingThread::resultsEdited() {
+    frameProtectMutex.lock();
+    dropLaterResults();
+    TrackingSnapshot* snapshot = buildSnapshot();
+    if (trackExporter && currentIndex >= 0)
+        trackExporter->submit(*snapshot);
+    frameProtectMutex.unlock();
+    rememberResult(*snapshot);
+    delete snapshot;
+}
+
+TrackerState ProcessingThread::captureState() {
+    TrackerState state;
+    state.frameIndex = currentIndex;
+    map<int, SubjectGroup*>::iterator it;
+    for (it = int_groups.begin(); it != int_groups.end(); it++) {
+        CheckpointGroup group;
+        group.ID = it->first;
+        group.color = it->second->getColorPoint();
+        state.groups.append(group);
+    }
+    for (int i = 0; i < registry.size(); i++) {
+        Subject* subject = registry.at(i);
+        CheckpointSubject saved;
+        saved.groupID = subject->getGroupID();
+        saved.subjectID = subject->getID();
+        saved.startingFrameIndex = subject->getStartingFrameIndex();
+        saved.pos = subject->pos();
+        saved.dir = subject->dir();
+        saved.bound = subject->getCurrentBoundingFrame();
+        saved.colors = subject->getColors();
+        state.subjects.append(saved);
+    }
+    state.foreground = int_currentForeground;
+    state.backgroundPalette = backgroundPalette.clone();
+    state.referenceAreas = referenceAreas;
+    return state;
+}
+
+bool ProcessingThread::saveCheckpoint() {
+    groupsMutex.lock();
+    frameProtectMutex.lock();
+    bool saved = checkpointWriter != NULL && currentIndex >= 0;
+    if (saved)
+        checkpointWriter->submit(captureState());
+    frameProtectMutex.unlock();
+    groupsMutex.unlock();
+    return saved;
+}
+
+void ProcessingThread::restoreState(const TrackerState& state) {
+    //Subjects still initializing belong to the state being replaced.
+    jobsMutex.lock();
+    QList<QFuture<SubjectInitResult> > jobs = subjectJobs.values();
+    subjectJobs.clear();
+    jobsMutex.unlock();
+    for (int i = 0; i < jobs.size(); i++) {
+        jobs[i].cancel();
+        jobs[i].waitForFinished();
+    }
+    jobsMutex.lock();
+    pendingEdits.clear();
+    jobsMutex.unlock();
+
+    groupsMutex.lock();
+    registry.clear();
+    map<int, SubjectGroup*>::iterator it;
+    for (it = int_groups.begin(); it != int_groups.end(); it++)
+        delete it->second;
+    groups.clear();
+    int_groups.clear();
+    for (int i = 0; i < state.groups.size(); i++) {
+        SubjectGroup* group = new SubjectGroup(state.groups[i].color, state.groups[i].ID);
+        groups[group->getColorString()] = group;
+        int_groups[group->getID()] = group;
+    }
+    for (int i = 0; i < state.subjects.size(); i++) {
+        const CheckpointSubject& saved = state.subjects[i];
+        registry.insert(Subject(saved.bound, saved.pos, saved.dir, saved.colors,
+                                saved.subjectID, saved.groupID, saved.startingFrameIndex));
+    }
+    int_currentForeground = state.foreground;
+    foregroundChanged = true;
+    if (! state.backgroundPalette.empty()) {
+        backgroundPalette = state.backgroundPalette.clone();
+        hasBackgroundPalette = true;
+    }
+    sharedMutex.lock();
+    sharedGroupColors.clear();
+    for (int i = 0; i < state.groups.size(); i++)
+        sharedGroupColors[state.groups[i].ID] = state.groups[i].color;
+    sharedPalette = backgroundPalette;
+    sharedMutex.unlock();
+    referenceAreas = state.referenceAreas;
+    lastCheckpointFrame = state.frameIndex;
+    //Tracking resumes after the checkpoint's frame, rows exported for later frames are stale.
+    trackedUpTo = state.frameIndex;
+
+    //Cached as the result of the checkpoint's frame, so seeking there does not track it again.
+    resultCache.clear();
+    frameProtectMutex.lock();
+    if (trackExporter)
+        trackExporter->rewind(state.frameIndex);
+    TrackingSnapshot* snapshot = buildSnapshot();
+    frameProtectMutex.unlock();
+    snapshot->frameIndex = state.frameIndex;
+    rememberResult(*snapshot);
+    shareSnapshot(*snapshot);
+    delete snapshot;
+    groupsMutex.unlock();
+}
+
+SubjectInitResult ProcessingThread::initSubject(const SubjectInitRequest &request, QFutureInterfaceBase *progress) {
+    SubjectInitResult result;
+    result.groupID = request.groupID;
+    result.subjectID = request.subjectID;
+    result.frameIndex = request.frameIndex;
+    result.generation = request.generation;
+    result.found = false;
+    result.dir = 0;
 
     //Fix negative widths and heights.
-    bound = bound.normalized();
+    QRectF bound = request.bound.normalized();
+    //Only the selection is looked at, so only the selection is converted.
+    Rect roi((int)bound.left(), (int)bound.top(), (int)bound.width(), (int)bound.height());
+    roi &= Rect(0, 0, request.source.cols, request.source.rows);
+    if (roi.width <= 0 || roi.height <= 0)
+        return result;
+    QRectF localBound(0, 0, roi.width, roi.height);
+
+    //Pool threads keep their arena between jobs, only this job's memory is released.
+    FrameArena* arena = FrameArena::current();
+    FrameArena::Scope jobScope(arena);
+    arena->setStage(STAGE_KMEANS);
+    Mat dest = arena->mat(roi.height, roi.width, CV_8UC3);
+    ArenaColorList centers;
+    ArenaClusterMap clusters;
+    ArenaFrequencyMap colorFreqs;
+    ArenaColorList::iterator it1;
+
     //Convert RGB color space to CIEL*a*b*
-    cvtColor(source, dest, CV_BGR2Lab);
+    cvtColor(request.source(roi), dest, CV_BGR2Lab);
     //Perform comprehensive k-means.
-    int numKRuns= awkmeans(dest, bound, centers, clusters, colorFreqs, groupID);
+    int numKRuns = awkmeans(dest, localBound, &centers, &clusters, &colorFreqs,
+                            request.backgroundPalette, &request.groupColor, progress, MAX_KMEANS_RUNS);
+    if (numKRuns < 0)
+        return result;
     //qDebug() << "Ran k-means for " << numKRuns << " time steps.";
     //Determine which cluster is the desired one by finding the minimum distance between
     //the currently selected group's color and each center.
     double minDistance = std::numeric_limits<double>::max();
-    int m, k;
-    for (it1 = centers->begin(), k = 0; it1 != centers->end(); it1++, k++) {
-        double distance = colorDistance(int_groups[groupID]->getColorPoint(), *it1);
+    int m = 0, k;
+    for (it1 = centers.begin(), k = 0; it1 != centers.end(); it1++, k++) {
+        double distance = colorDistance(request.groupColor, *it1);
         //qDebug() << "\t" << k << ": " << distance;
         if (distance < minDistance) {
             //Update the minimum to represent this new min.
             minDistance = distance;
             //Update m to represent the new aligned cluster.
             m = k;
-            //Update it2 to hold a reference to the new aligned cluster color.
-            it2 = it1;
         }
     }
-    //Store clusters[m] set in the foreground maps.
-    //qDebug() << "Adding clusters[m] set to group: " << groupID;
-    int_currentForeground[groupID] = (*clusters)[m];
+    result.cluster = set<std::string>(clusters[m].begin(), clusters[m].end());
     //Now m represents the cluster index in "clusters" and "centers" corresponding to the group color.
     //Now to check for the right colors, all we need to do is see if the color exists in the clusters[m] set.
-    fittedBound = fitRect(dest, bound, clusters, m);
+    QRectF fittedBound = fitRect(dest, localBound, clusters[m]);
     if (fittedBound.top() != -1) {
         //fittedBound.adjust(DIR_SEARCH_THRESH * -1, DIR_SEARCH_THRESH * -1, DIR_SEARCH_THRESH, DIR_SEARCH_THRESH);
-        Mat binMat = extractBinaryMat(dest, fittedBound, clusters, m);
+        arena->setStage(STAGE_LABELS);
+        Mat binMat = extractBinaryMat(dest, fittedBound, clusters[m]);
         binMat = sizeFilter(removeBridges(sizeFilter(binMat)));
         //Calculate the angle formed by the axis of inertia and the x-axis.
         //Note: Due to the nature of inverse trigonometric functions, a value returned by the getDirection function can mean 4 different things.
         //An angle formed with respect to the x-axis will take any value between 0-90, in any quadrant.
         //When processing, use past-states to determine which quadrant/value is the most sensible.
         Point2f cen = getCenterOfMass(binMat);
-        float dir = getDirection(Point2f(cen.y, cen.x), binMat);
+        result.dir = getDirection(Point2f(cen.y, cen.x), binMat);
         //OpenCV Format:: Regular X and Y are swapped.
         //Qt Format:: Reflected across X axis.
-        cen.x += fittedBound.top();
-        cen.y += fittedBound.left();
+        cen.x += fittedBound.top() + roi.y;
+        cen.y += fittedBound.left() + roi.x;
         //qDebug() << "Adding Subject with Position: " << cen.x << "," << cen.y;
-        //Create a new Subject pointer with the given information.
-        Subject* tempSubject = new Subject(fittedBound, QPointF(cen.y, cen.x), dir, (*clusters)[m], subjectID, groupID, frameIndex);
-        //Store subject in map.
-        int_groups[groupID]->addSubject(tempSubject);
+        result.bound = fittedBound.translated(roi.x, roi.y);
+        result.pos = QPointF(cen.y, cen.x);
+        result.found = true;
+    }
+    return result;
+}
 
-        //Pass update to DisplayThread.
-        updateSubjects();
+//Drops every subject but keeps the groups and the colors learned for them.
+//The mean box area of each group's subjects is remembered as a reference for detectSubjects().
+void ProcessingThread::clearSubjects() {
+    groupsMutex.lock();
+    applyEdits();
+    map<int, SubjectGroup*>::iterator it1;
+    for (it1 = int_groups.begin(); it1 != int_groups.end(); it1++) {
+        QPair<int, int> range = registry.groupRange(it1->first);
+        if (range.first == range.second)
+            continue;
+        float area = 0;
+        for (int i = range.first; i < range.second; i++) {
+            QRectF bound = registry.at(i)->getCurrentBoundingFrame();
+            area += bound.width() * bound.height();
+        }
+        referenceAreas[it1->first] = area / (range.second - range.first);
     }
+    registry.clear();
+    resultsEdited();
+    groupsMutex.unlock();
+}
+
+//Orders blobs top to bottom, then left to right.
+static bool readingOrder(const Rect& a, const Rect& b) {
+    if (a.y != b.y)
+        return a.y < b.y;
+    return a.x < b.x;
+}
+
+//Replaces each group's subjects by the blobs of the group's learned colors in the current frame.
+//Blobs smaller than a quarter of the group's reference area are treated as noise.
+//IDs are handed out in reading order, so the same frame always yields the same subjects.
+int ProcessingThread::detectSubjects() {
+    groupsMutex.lock();
+    //Groups colored just before are among those to detect.
+    applyEdits();
+    frameProtectMutex.lock();
+    Mat labFrame;
+    cvtColor(currentFrame, labFrame, CV_BGR2Lab);
+    int frameIndex = currentIndex;
+    frameProtectMutex.unlock();
+
+    QRectF wholeFrame(0, 0, labFrame.cols, labFrame.rows);
+    int found = 0;
+    FrameArena* arena = FrameArena::current();
+    FrameArena::Scope detectScope(arena);
+    arena->setStage(STAGE_LABELS);
+    map<int, SubjectGroup*>::iterator it1;
+    for (it1 = int_groups.begin(); it1 != int_groups.end(); it1++) {
+        int groupID = it1->first;
+        //Only the first channel of the binary matrix carries the mask.
+        vector<Mat> planes;
+        split(extractBinaryMat(labFrame, wholeFrame, int_currentForeground[groupID]), planes);
+        Mat binary = planes[0];
+
+        vector<vector<Point> > contours;
+        findContours(binary.clone(), contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+
+        float minArea = referenceAreas.count(groupID) ? referenceAreas[groupID] / 4 : 1;
+        vector<Rect> blobs;
+        for (size_t i = 0; i < contours.size(); i++) {
+            Rect blob = boundingRect(contours[i]);
+            if (blob.area() >= minArea)
+                blobs.push_back(blob);
+        }
+        std::sort(blobs.begin(), blobs.end(), readingOrder);
+
+        for (size_t i = 0; i < blobs.size(); i++) {
+            Mat blobMat = binary(blobs[i]);
+            Point2f tempPos = getCenterOfMass(blobMat);
+            float dir = getDirection(Point2f(tempPos.y, tempPos.x), blobMat);
+            QRectF bound(blobs[i].x, blobs[i].y, blobs[i].width, blobs[i].height);
+            registry.insert(Subject(bound, QPointF(tempPos.x + bound.left(), tempPos.y + bound.top()), dir,
+                                    int_currentForeground[groupID], i, groupID, frameIndex));
+            found++;
+        }
+        qDebug() << "Detected " << blobs.size() << " subjects for group " << groupID;
+    }
+    foregroundChanged = true;
+    resultsEdited();
+    groupsMutex.unlock();
+
+    updateSubjects();
+    return found;
 }
 
 Point2f ProcessingThread::getCenterOfMass(Mat binMat) {
@@ -429,7 +1040,7 @@ float ProcessingThread::getDirection(Point2f center, Mat binMat) {
 
 //Connected Component Labeling to Identify Blobs.
 pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
-    Mat labels = Mat::zeros(image.rows, image.cols, CV_8UC1);
+    Mat labels = FrameArena::current()->zeros(image.rows, image.cols, CV_8UC1);
     int step = image.step, lstep = labels.step;
     int channels = image.channels(), lchannels = labels.channels();
     int labelcount = 1;
@@ -440,13 +1051,15 @@ pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
             if (image.data[i*step + j*channels]) {
                 //If not background, check neighbors of foreground.
                 int minLabel = std::numeric_limits<int>::max();
-                list<Point> neighbors;
+                //At most the 4 already visited neighbors.
+                Point neighbors[4];
+                int numNeighbors = 0;
                 //If neighbor is already labeled, assign minimum label value.
                 //Check NW pixel.
                 if (i > 0 && j > 0 && labels.data[(i-1)*lstep + (j-1)*lchannels] > 0)
                 {
                     //qDebug() << "NW: " << labels.data[(i-1)*lstep + (j-1)*lchannels];
-                    neighbors.push_back(Point(i-1, j-1));
+                    neighbors[numNeighbors++] = Point(i-1, j-1);
                     if (labels.data[(i-1)*lstep + (j-1)*lchannels] < minLabel)
                         minLabel = labels.data[(i-1)*lstep + (j-1)*lchannels];
                     //qDebug() << "Adding NW";
@@ -455,7 +1068,7 @@ pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
                 if (i > 0 && labels.data[(i-1)*lstep + j*lchannels] > 0)
                 {
                     //qDebug() << "N: " << labels.data[(i-1)*lstep + j*lchannels];
-                    neighbors.push_back(Point(i-1, j));
+                    neighbors[numNeighbors++] = Point(i-1, j);
                     if (labels.data[(i-1)*lstep + j*lchannels] < minLabel)
                         minLabel = labels.data[(i-1)*lstep + j*lchannels];
                     //qDebug() << "Adding N";
@@ -464,7 +1077,7 @@ pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
                 if (i > 0 && j < image.cols-1 && labels.data[(i-1)*lstep + (j+1)*lchannels] > 0)
                 {
                     //qDebug() << "NE: " << labels.data[(i-1)*lstep + (j+1)*lchannels];
-                    neighbors.push_back(Point(i-1, j+1));
+                    neighbors[numNeighbors++] = Point(i-1, j+1);
                     if (labels.data[(i-1)*lstep + (j+1)*lchannels] < minLabel)
                         minLabel = labels.data[(i-1)*lstep + (j+1)*lchannels];
                     //qDebug() << "Adding NE.";
@@ -473,12 +1086,12 @@ pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
                 if (j > 0 && labels.data[i*lstep + (j-1)*lchannels] > 0)
                 {
                     //qDebug() << "W: " << labels.data[i*lstep + (j-1)*lchannels];
-                    neighbors.push_back(Point(i, j-1));
+                    neighbors[numNeighbors++] = Point(i, j-1);
                     if (labels.data[i*lstep + (j-1)*lchannels] < minLabel)
                         minLabel = labels.data[i*lstep + (j-1)*lchannels];
                     //qDebug() << "Adding W.";
                 }
-                if (neighbors.empty()) {
+                if (numNeighbors == 0) {
                     //If no neighbors have a label, then simply assign a new one.
                     //qDebug() << "Neighbors is empty. Adding new label: " << labelcount;
                     dset.AddElements(1);
@@ -490,10 +1103,9 @@ pair<Mat, int> ProcessingThread::extractComponentLabels(Mat image) {
                     labels.data[i*lstep + j*lchannels] = minLabel;
                     //qDebug() << "Assigning " << minLabel << " as the new label for " << i << "," << j;
                     //Then, merge all of the neighboring labels with this smallest label.
-                    list<Point>::iterator it1;
-                    for (it1 = neighbors.begin(); it1 != neighbors.end(); it1++) {
-                        //qDebug() << "Merging " << labels.data[it1->x*lstep + it1->y*lchannels] << " with " << minLabel;
-                        dset.Union(labels.data[it1->x*lstep + it1->y*lchannels], minLabel);
+                    for (int n = 0; n < numNeighbors; n++) {
+                        //qDebug() << "Merging " << labels.data[neighbors[n].x*lstep + neighbors[n].y*lchannels] << " with " << minLabel;
+                        dset.Union(labels.data[neighbors[n].x*lstep + neighbors[n].y*lchannels], minLabel);
                     }
                 }
             }
@@ -523,7 +1135,7 @@ Mat ProcessingThread::sizeFilter(Mat image) {
     int lstep = labels.step;
     int lchannels = labels.channels();
 
-    map<int, int> blobSizes;
+    ArenaCountMap blobSizes;
     for (int i = 1; i < labelcount; i++) {
         blobSizes[i] = 0;
     }
@@ -539,10 +1151,10 @@ Mat ProcessingThread::sizeFilter(Mat image) {
     for (int i = 1; i < labelcount; i++) {
         if (blobSizes[i] > blobSizes[largestBlobLabel])
             largestBlobLabel = i;
-        qDebug() << i << ": " << blobSizes[i];
+        TRACE_VERBOSE("%1: %2", i, blobSizes[i]);
     }
     //Create new binary image of only the largest blob.
-    Mat tempImg(image.rows, image.cols, image.type());
+    Mat tempImg = FrameArena::current()->mat(image.rows, image.cols, image.type());
     for (int i = 0; i < image.rows; i++) {
         for (int j = 0; j < image.cols; j++) {
             int newValue = (labels.data[i*lstep + j*lchannels] == largestBlobLabel) ? 100 : 0;
@@ -583,15 +1195,16 @@ Mat ProcessingThread::removeBridges(Mat image) {
 }
 
 //Converts an image to a two-color bitmap.
-Mat ProcessingThread::extractBinaryMat(Mat image, QRectF frame, set<string> cluster) {
-    Mat binMat = Mat::zeros(frame.height(), frame.width(), image.type());
+template <class ColorSet>
+Mat ProcessingThread::extractBinaryMat(Mat image, QRectF frame, const ColorSet& cluster) {
+    Mat binMat = FrameArena::current()->zeros(frame.height(), frame.width(), image.type());
     int i, j, x, y;
     int step = image.step;
     int channels = image.channels();
     Point3_<uchar> pixelData;
-    qDebug() << "Extracting Binary Matrix from Image of : {" << image.rows << "," << image.cols << "}";
-    qDebug() << "Binary Mat is of : {" << binMat.rows << "," << binMat.cols << "}";
-    qDebug() << "Frame provided is of : {" << frame.height() << "," << frame.width() << "}";
+    TRACE_VERBOSE("Extracting Binary Matrix from Image of : {%1,%2}", image.rows, image.cols);
+    TRACE_VERBOSE("Binary Mat is of : {%1,%2}", binMat.rows, binMat.cols);
+    TRACE_VERBOSE("Frame provided is of : {%1,%2}", frame.height(), frame.width());
     for (i = frame.top(), x = 0; i < frame.bottom(); i++, x++) {
         for (j = frame.left(), y = 0; j < frame.right(); j++, y++) {
             //qDebug() << "{" << i << "," << j << "}";
@@ -615,14 +1228,9 @@ Mat ProcessingThread::extractBinaryMat(Mat image, QRectF frame, set<string> clus
     return binMat;
 }
 
-Mat ProcessingThread::extractBinaryMat(Mat image, QRectF frame, IntClusterMap *clusters, int clusterID) {
-    set<std::string> cluster = (*clusters)[clusterID];
-    return extractBinaryMat(image, frame, cluster);
-}
-
 //
 Mat ProcessingThread::mask(Mat image, Mat mask) {
-    Mat dest = Mat::zeros(image.rows, image.cols, CV_8UC3);
+    Mat dest = FrameArena::current()->zeros(image.rows, image.cols, CV_8UC3);
     //mask is guaranteed to be a bitmap (only 2 distinct values, 0 and a non 0.
     for (int i = 0; i < dest.rows; i++) {
         for (int j = 0; j < dest.cols; j++) {
@@ -668,7 +1276,7 @@ QRectF ProcessingThread::fitBinRect(Mat image) {
 }
 
 //
-QRectF ProcessingThread::fitRect(Mat dest, QRectF bound, IntClusterMap *clusters, int m) {
+QRectF ProcessingThread::fitRect(Mat dest, QRectF bound, const ArenaColorSet& cluster) {
     QRectF fittedBound;
     int fit_top = -1; //Start the top as invalid. The first color that fits within the desired cluster decides the top row.
     int fit_left = std::numeric_limits<int>::max(); //Start the left as invalid. The first color that fits within the desired cluster decides the left column.
@@ -696,8 +1304,8 @@ QRectF ProcessingThread::fitRect(Mat dest, QRectF bound, IntClusterMap *clusters
             //qDebug() << pixelData.x << ", " << pixelData.y << ", " << pixelData.z;
 
             //Check to see if color c (pixelData) at the current position (j, i) is in the accepted cluster.
-            if ((*clusters)[m].count(color2Hex(pixelData))) {
-                //qDebug() << QString::fromStdString(color2Hex(pixelData)) << " exists in cluster " << m;
+            if (cluster.count(color2Hex(pixelData))) {
+                //qDebug() << QString::fromStdString(color2Hex(pixelData)) << " exists in the cluster";
                 if (fit_top == -1) //The first chance we get, assign a row value to this.
                     fit_top = i; //After all, i represents a row (vertical) position.
                 //Minimum j value at which the color exists becomes the left bound.
@@ -708,10 +1316,7 @@ QRectF ProcessingThread::fitRect(Mat dest, QRectF bound, IntClusterMap *clusters
         }
     }
 
-    qDebug() << "Fit Left: " << fit_left;
-    qDebug() << "Fit Top: " << fit_top;
-    qDebug() << "Fit Right: " << fit_right;
-    qDebug() << "Fit Bottom: " << fit_bottom;
+    TRACE_VERBOSE("Fit Left: %1, Top: %2, Right: %3, Bottom: %4", fit_left, fit_top, fit_right, fit_bottom);
 
     //With the new fitted box, the top() position is calculated by fit_top, the height() is calculated by fit_bottom - fit_top,
     //and the left() position is calculated by fit_left, where the width() is calculated by fit_right - fit_left.
@@ -724,8 +1329,9 @@ QRectF ProcessingThread::fitRect(Mat dest, QRectF bound, IntClusterMap *clusters
 }
 
 //
-int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *centers, IntClusterMap *clusters, ColorFrequencyMap *colorFreqs,
-                                int groupID = -1) { //groupID reflects the ID of the group cluster color to be focused on. Guaranteed to be a center.
+int ProcessingThread::awkmeans(Mat image, QRectF bound, ArenaColorList *centers, ArenaClusterMap *clusters, ArenaFrequencyMap *colorFreqs,
+                                Mat palette, const Point3_<uchar>* focusColor, QFutureInterfaceBase* progress,
+                                int maxRuns) {
     if (bound.isEmpty() || bound.isNull() || ! bound.isValid())
         return -1;
     int step = image.step;
@@ -740,14 +1346,14 @@ int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *c
     int ki = sqrt((double)n/5);
     int i, j; //looping iterants
     int x = 0, y = 0; //pixel coordinate references
-    list<Point3_<uchar> > prevCenters;
-    list<Point3_<uchar> >::iterator it1, it2;
+    ArenaColorList prevCenters;
+    ArenaColorList::iterator it1, it2;
     Point3_<uchar> pixelData;
 
     if (ki <= 0)
         return -1;
 
-    qDebug() << "n: " << n << ", " << "ki: " << ki;
+    TRACE_VERBOSE("n: %1, ki: %2", n, ki);
 
     //Choose Ki (initial) evenly spaced pixels throughout the grid.
     //Spacing = n / Ki.
@@ -768,17 +1374,17 @@ int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *c
     }
 
     //Add background colors to clusters.
-    for(i = 0; i < backgroundPalette.cols; i++) {
-        pixelData.x = backgroundPalette.data[backgroundPalette.channels()*i];
-        pixelData.y = backgroundPalette.data[backgroundPalette.channels()*i + 1];
-        pixelData.z = backgroundPalette.data[backgroundPalette.channels()*i + 2];
+    for(i = 0; i < palette.cols; i++) {
+        pixelData.x = palette.data[palette.channels()*i];
+        pixelData.y = palette.data[palette.channels()*i + 1];
+        pixelData.z = palette.data[palette.channels()*i + 2];
         centers->push_back(pixelData);
     }
 
-    //If a positive (or zero) groupID was provided, add the group's representative color to the centers.
-    if (groupID > -1)
-        centers->push_back(int_groups[groupID]->getColorPoint());
-    qDebug() << "Starting with: " << centers->size() << " clusters.";
+    //If a group color was provided, add it to the centers.
+    if (focusColor)
+        centers->push_back(*focusColor);
+    TRACE_VERBOSE("Starting with: %1 clusters.", centers->size());
 
     //Given that sqrt(n/2) clusters might be a bit excessive, "merge" similar pixel values.
     for (it1 = centers->begin(); it1 != centers->end(); it1++) {
@@ -798,13 +1404,15 @@ int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *c
             } else it2++;
         }
     }
-    qDebug() << "Shrunk cluster centers down to: " << centers->size();
+    TRACE_VERBOSE("Shrunk cluster centers down to: %1", centers->size());
 
     int numKRuns = 0;
     bool kmeans = true;
     int k, m;
 
-    while (kmeans) {
+    while (kmeans && (maxRuns <= 0 || numKRuns < maxRuns)) {
+        if (progress && progress->isCanceled())
+            return -1;
         //At the beginning of each loop, clear the clusters so they can be refilled
         //upon recalculating.
         clusters->clear();
@@ -843,15 +1451,17 @@ int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *c
 
         if (! numKRuns) {
             //On the first run, calculate the frequencies of every pixel color.
-            map<std::string, float>::iterator it3;
+            ArenaFrequencyMap::iterator it3;
             for (it3 = colorFreqs->begin(); it3 != colorFreqs->end(); it3++) {
                 (*colorFreqs)[(*it3).first] = (*it3).second / n;
             }
         }
         numKRuns++;
+        if (progress)
+            progress->setProgressValue(numKRuns);
 
-        map<int, set<std::string> >::iterator it4;
-        set<std::string>::iterator it5;
+        ArenaClusterMap::iterator it4;
+        ArenaColorSet::const_iterator it5;
 
         //Assign current centers to old centers and recalculate new...
         prevCenters = *centers;
@@ -897,11 +1507,60 @@ int ProcessingThread::awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *c
     return numKRuns+1;
 }
 
-//
+//Republishes the current frame with the current subjects, e.g. after an edit while paused.
 void ProcessingThread::updateSubjects() {
-    imageData->getReadSlot();
-    imageData->updateGroups(int_groups);
-    imageData->releaseWriteSlot();
+    //While a frame is processed it publishes the subjects itself at its end.
+    if (! groupsMutex.tryLock())
+        return;
+    if (applyEdits())
+        resultsEdited();
+    frameProtectMutex.lock();
+    TrackingSnapshot* snapshot = buildSnapshot();
+    frameProtectMutex.unlock();
+    groupsMutex.unlock();
+    shareSnapshot(*snapshot);
+    if (imageData)
+        imageData->setData(snapshot);
+    else delete snapshot;
+}
+
+void ProcessingThread::shareSnapshot(const TrackingSnapshot& snapshot) {
+    sharedMutex.lock();
+    sharedFrame = snapshot.frame;
+    sharedDirections.clear();
+    for (int i = 0; i < snapshot.subjects.size(); i++) {
+        const SubjectPose& pose = snapshot.subjects[i];
+        sharedDirections[qMakePair(pose.groupID, pose.subjectID)] = pose.dir;
+    }
+    sharedMutex.unlock();
+}
+
+//Copies the poses of all subjects into a new snapshot. Caller holds groupsMutex and frameProtectMutex.
+TrackingSnapshot* ProcessingThread::buildSnapshot() {
+    TrackingSnapshot* snapshot = new TrackingSnapshot();
+    snapshot->frameIndex = currentIndex;
+    snapshot->frame = currentFrame;
+
+    //The registry is already ordered by group, then ID.
+    snapshot->subjects.reserve(registry.size());
+    snapshot->trails.resize(registry.size() * TRAIL_LENGTH);
+    int trailEnd = 0;
+    for (int i = 0; i < registry.size(); i++) {
+        Subject* subject = registry.at(i);
+        SubjectPose pose;
+        pose.groupID = subject->getGroupID();
+        pose.subjectID = subject->getID();
+        pose.pos = subject->pos();
+        pose.dir = subject->dir();
+        pose.bound = subject->getCurrentBoundingFrame();
+        pose.trailStart = trailEnd;
+        pose.trailLength = subject->getTrajectory().recentPositions(TRAIL_LENGTH, snapshot->trails.data() + trailEnd,
+                                                                    currentIndex);
+        trailEnd += pose.trailLength;
+        snapshot->subjects.append(pose);
+    }
+    snapshot->trails.resize(trailEnd);
+    return snapshot;
 }
 
 //Returns the Matrix form of the current Frame held.
@@ -917,83 +1576,148 @@ int ProcessingThread::getCurrentFrameIndex() {
     return currentIndex;
 }
 
-Point3_<uchar> ProcessingThread::setGroupColor(QPoint pos, int ID) {
+TrajectoryStore* ProcessingThread::getTrajectoryStore() {
+    return &trajectories;
+}
+
+bool ProcessingThread::openTrajectoryStore(QString dataPath, bool append) {
+    return trajectories.open(dataPath, append);
+}
+
+void ProcessingThread::closeTrajectoryStore() {
+    if (! trajectories.isOpen())
+        return;
     groupsMutex.lock();
+    for (int i = 0; i < registry.size(); i++)
+        registry.at(i)->flushTrajectory(&trajectories);
+    trajectories.close();
+    groupsMutex.unlock();
+}
+
+FrameArenaStats ProcessingThread::getArenaStats() {
     frameProtectMutex.lock();
+    FrameArenaStats stats = arenaStats;
+    frameProtectMutex.unlock();
+    return stats;
+}
 
-    Point3_<uchar> rgbCol;
-    rgbCol.x = currentFrame.data[currentFrame.step*pos.y() + currentFrame.channels()*pos.x() + 0];
-    rgbCol.y = currentFrame.data[currentFrame.step*pos.y() + currentFrame.channels()*pos.x() + 1];
-    rgbCol.z = currentFrame.data[currentFrame.step*pos.y() + currentFrame.channels()*pos.x() + 2];
+bool ProcessingThread::setGroupColor(QPoint pos, int ID, Point3_<uchar>& rgbCol) {
+    //The color is picked on the frame shown, which the processing thread never writes to.
+    sharedMutex.lock();
+    Mat frame = sharedFrame;
+    sharedMutex.unlock();
+    if (frame.empty() || pos.x() < 0 || pos.y() < 0 || pos.x() >= frame.cols || pos.y() >= frame.rows) {
+        qWarning() << "Processing Thread: No color at " << pos << " to set group " << ID << " to.";
+        return false;
+    }
 
+    rgbCol.x = frame.data[frame.step*pos.y() + frame.channels()*pos.x() + 0];
+    rgbCol.y = frame.data[frame.step*pos.y() + frame.channels()*pos.x() + 1];
+    rgbCol.z = frame.data[frame.step*pos.y() + frame.channels()*pos.x() + 2];
+
+    //Only the picked pixel is needed in L*a*b*.
+    Mat_<Vec3b> pixel(1, 1, Vec3b(rgbCol.x, rgbCol.y, rgbCol.z));
     Mat tempDest;
-    cvtColor(currentFrame, tempDest, CV_BGR2Lab);
-    frameProtectMutex.unlock();
+    cvtColor(pixel, tempDest, CV_BGR2Lab);
 
     Point3_<uchar> labCol;
-    labCol.x = tempDest.data[tempDest.step*pos.y() + tempDest.channels()*pos.x() + 0];
-    labCol.y = tempDest.data[tempDest.step*pos.y() + tempDest.channels()*pos.x() + 1];
-    labCol.z = tempDest.data[tempDest.step*pos.y() + tempDest.channels()*pos.x() + 2];
-
-    std::string hexCol = color2Hex(labCol);
+    labCol.x = tempDest.data[0];
+    labCol.y = tempDest.data[1];
+    labCol.z = tempDest.data[2];
+
+    //Subjects requested from now on are initialized with the new color.
+    sharedMutex.lock();
+    sharedGroupColors[ID] = labCol;
+    sharedMutex.unlock();
+
+    TrackerEdit edit;
+    edit.kind = TrackerEdit::GROUP_COLOR_SET;
+    edit.groupID = ID;
+    edit.color = labCol;
+    queueEdit(edit);
+    return true;
+}
 
-    if (int_groups.count(ID)) { //Already contains key
-        int_groups[ID]->setColor(labCol); //Groups maps keys to group pointers.
-        //No need to alter the int_groups as it contains the pointer.
-    }
-    else {
-       SubjectGroup* tempGroup = new SubjectGroup(labCol, ID);
-       groups[hexCol] = tempGroup;
-       int_groups[ID] = tempGroup;
+void ProcessingThread::removeGroup(int ID) {
+    sharedMutex.lock();
+    sharedGroupColors.remove(ID);
+    QMap<QPair<int, int>, float>::iterator it = sharedDirections.begin();
+    while (it != sharedDirections.end()) {
+        if (it.key().first == ID)
+            it = sharedDirections.erase(it);
+        else it++;
     }
-    groupsMutex.unlock();
-    return rgbCol;
+    sharedMutex.unlock();
+
+    TrackerEdit edit;
+    edit.kind = TrackerEdit::GROUP_REMOVED;
+    edit.groupID = ID;
+    queueEdit(edit);
 }
 
-void ProcessingThread::removeGroup(int ID) {
-    groupsMutex.lock();
-    string tempHex = int_groups[ID]->getColorString();
-    groups.erase(tempHex);
-    int_groups.erase(ID);
-    groupsMutex.unlock();
+void ProcessingThread::removeSubject(int groupID, int subjectID) {
+    sharedMutex.lock();
+    sharedDirections.remove(qMakePair(groupID, subjectID));
+    sharedMutex.unlock();
+
+    TrackerEdit edit;
+    edit.kind = TrackerEdit::SUBJECT_REMOVED;
+    edit.groupID = groupID;
+    edit.subjectID = subjectID;
+    queueEdit(edit);
 }
 
-SubjectGroup* ProcessingThread::getSubjectGroup(Point3_<uchar> color) {
-    groupsMutex.lock();
-    SubjectGroup* tempGroup = groups[color2Hex(color)];
-    groupsMutex.unlock();
-    return tempGroup;
+void ProcessingThread::setSubjectDirection(int groupID, int subjectID, float dir) {
+    QPair<int, int> key(groupID, subjectID);
+    sharedMutex.lock();
+    if (sharedDirections.contains(key))
+        sharedDirections[key] = dir;
+    sharedMutex.unlock();
+
+    TrackerEdit edit;
+    edit.kind = TrackerEdit::DIRECTION_SET;
+    edit.groupID = groupID;
+    edit.subjectID = subjectID;
+    edit.dir = dir;
+    queueEdit(edit);
 }
 
-SubjectGroup* ProcessingThread::getSubjectGroup(int ID) {
-    groupsMutex.lock();
-    SubjectGroup* tempGroup = int_groups[ID];
-    groupsMutex.unlock();
-    return tempGroup;
-}
-
-Subject* ProcessingThread::getSubject(int subjectID, int groupID) {
-    map<int, Subject*>::iterator it;
-    SubjectGroup* subjectGroup = int_groups[groupID];
-    IntSubjectMap subjects = subjectGroup->getSubjects();
-    Subject* subj;
-    for (it = subjects.begin(); it != subjects.end(); it++) {
-        if (it->second->getID() == subjectID)
-        {
-            subj = it->second;
-            break;
-        }
-    }
-    return subj;
+bool ProcessingThread::getSubjectDirection(int groupID, int subjectID, float &dir) {
+    QPair<int, int> key(groupID, subjectID);
+    sharedMutex.lock();
+    bool found = sharedDirections.contains(key);
+    if (found)
+        dir = sharedDirections[key];
+    sharedMutex.unlock();
+    return found;
 }
 
 void ProcessingThread::dropFrame() {
     currentFrame.release();
     currentIndex = -1;
+    sharedMutex.lock();
+    sharedFrame.release();
+    sharedDirections.clear();
+    sharedMutex.unlock();
+    //Results belong to the video being dropped.
+    groupsMutex.lock();
+    resultCache.clear();
+    trackedUpTo = -1;
+    groupsMutex.unlock();
 }
 
 //Stops the Processing thread.
 void ProcessingThread::stopProcessingThread() {
+    //Pending subject jobs are of no use anymore.
+    jobsMutex.lock();
+    QList<QFuture<SubjectInitResult> > jobs = subjectJobs.values();
+    subjectJobs.clear();
+    jobsMutex.unlock();
+    for (int i = 0; i < jobs.size(); i++) {
+        jobs[i].cancel();
+        jobs[i].waitForFinished();
+    }
+
     stoppedMutex.lock();
         stopped = true;
     stoppedMutex.unlock();
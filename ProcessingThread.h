@@ -12,72 +12,227 @@
 #include "ImageData.h"
 #include "Structures.h"
 #include "SubjectGroup.h"
+#include "TrackExporter.h"
+#include "SubjectInitJob.h"
+#include "SubjectRegistry.h"
+#include "FrameArena.h"
+#include "TrajectoryStore.h"
+#include "TrackingResultCache.h"
+#include "CheckpointWriter.h"
+#include "VideoCache.h"
+#include "PipelineMetrics.h"
+#include <QFuture>
+#include <QMap>
+#include <QPair>
 
 using namespace cv;
 using namespace std;
 
+//A change to the tracking state requested off the processing thread. Edits are queued and
+//applied in order at a frame boundary, so the GUI never waits for a frame to be tracked.
+struct TrackerEdit {
+    enum Kind { SUBJECT_INITIALIZED, SUBJECT_REMOVED, DIRECTION_SET, GROUP_COLOR_SET, GROUP_REMOVED };
+    Kind kind;
+    int groupID;
+    int subjectID;
+    float dir;
+    //Lab color of GROUP_COLOR_SET.
+    Point3_<uchar> color;
+    SubjectInitResult result;
+};
+
 class ProcessingThread : public QThread
 {
     Q_OBJECT
 public:
+    //iData may be NULL when running without a DisplayThread (headless mode).
     ProcessingThread(ImageHandler* iHandler, ImageData* iData);
     void loadFrame();
     void dropFrame();
     void stopProcessingThread();
+    //Shows the intermediate binary masks in HighGUI windows. Off by default.
+    void setDebugWindows(bool enabled);
+    //Optional sink receiving every subject's pose once per processed frame.
+    void setTrackExporter(TrackExporter* exporter);
+    //Takes the background palette of videoPath from cache if it was computed before,
+    //otherwise stores it there once computed on the first frame. cache may be NULL.
+    void setVideoCache(VideoCache* cache, QString videoPath);
+    //Optional writer of a checkpoint every writer->interval() frames.
+    void setCheckpointWriter(CheckpointWriter* writer);
+    //Optional sink of per-stage timings, fed once per processed frame.
+    void setMetrics(PipelineMetrics* metrics);
+    //Hands the current tracker state to the checkpoint writer. False if there is none or no frame yet.
+    bool saveCheckpoint();
+    //Replaces groups, subjects and learned colors by those of a checkpoint. The caller then
+    //seeks to state.frameIndex, which is shown as saved instead of being tracked again.
+    void restoreState(const TrackerState& state);
 
     //Group Handling
-    Point3_<uchar> setGroupColor(QPoint pos, int ID);
+    //Takes the color at pos of the frame last shown and returns it as BGR in bgr. The group is
+    //created or recolored at the next frame boundary, as is a removed group deleted.
+    //False if no frame was shown yet or pos lies outside of it.
+    bool setGroupColor(QPoint pos, int ID, Point3_<uchar>& bgr);
     void removeGroup(int ID);
-    SubjectGroup* getSubjectGroup(Point3_<uchar> color);
-    SubjectGroup* getSubjectGroup(int ID);
 
+    //Starts initializing a subject from a selection box on the worker pool and returns right away.
+    //A pending job for the same subject is cancelled. The result is applied at a frame boundary.
+    QFuture<SubjectInitResult> submitSubject(int groupID, int subjectID, QRectF bound, Mat source, int frameIndex);
+    //Same as submitSubject, but waits for the job and applies its result before returning.
     void addSubject(int groupID, int subjectID, QRectF bound, Mat source, int frameIndex);
-    Subject* getSubject(int subjectID, int groupID);
+    //Called by SubjectInitJob from the pool thread.
+    void queueSubjectResult(const SubjectInitResult& result);
+    //Computes a subject from a selection box. Only reads the request, safe on any thread.
+    static SubjectInitResult initSubject(const SubjectInitRequest& request, QFutureInterfaceBase* progress);
+    //Both take effect at the next frame boundary.
+    void removeSubject(int groupID, int subjectID);
+    void setSubjectDirection(int groupID, int subjectID, float dir);
+    //Direction as last shown, or as last set. Returns false if the subject does not exist (yet).
+    bool getSubjectDirection(int groupID, int subjectID, float& dir);
+    //Removes all subjects, keeping groups and their learned colors.
+    void clearSubjects();
+    //Re-seeds the subjects of every group from the blobs found in the current frame.
+    int detectSubjects();
 
     //GETTERS
     Mat getCurrentFrame();
     int getCurrentFrameIndex();
+    //Scratch allocation counters of the processing thread, as of the last processed frame.
+    FrameArenaStats getArenaStats();
+    //Trajectory blocks spilled by the subjects.
+    TrajectoryStore* getTrajectoryStore();
+    //Writes trajectories to a file at dataPath from now on, see TrajectoryStore::open().
+    bool openTrajectoryStore(QString dataPath, bool append = false);
+    //Spills what the subjects still hold and closes the file.
+    void closeTrajectoryStore();
 public slots:
+    //Applies pending edits and republishes the current frame, unless a frame is being
+    //processed, which does both itself at its end.
     void updateSubjects();
+    //Applies pending edits unless a frame is being processed, which applies them itself.
+    void applyPendingEdits();
+signals:
+    //Emitted once a frame has been tracked and published.
+    void frameProcessed(const int);
 private:
     volatile bool stopped;
     bool hasBackgroundPalette;
+    bool debugWindows;
 
     Mat currentFrame;
     int currentIndex;
+    //PipelineMetrics::now() when the current frame was decoded, 0 if unknown.
+    qint64 currentCaptureTime;
     StringGroupMap groups;
     IntGroupMap int_groups;
     IntClusterMap int_currentForeground;
+    //Owns every subject, guarded by groupsMutex.
+    SubjectRegistry registry;
+    TrajectoryStore trajectories;
+    //Results of frames tracked so far, guarded by groupsMutex.
+    TrackingResultCache resultCache;
+    //Last frame tracked, guarded by groupsMutex. Frames up to it are not tracked again unless
+    //an edit makes an earlier frame the last one.
+    int trackedUpTo;
+    //Copy of int_currentForeground shared by cached results, renewed once it changed.
+    QSharedPointer<const IntClusterMap> sharedForeground;
+    bool foregroundChanged;
     Mat backgroundPalette;
+    //Mean subject box area per group, recorded by clearSubjects().
+    map<int, float> referenceAreas;
+    //Copied from the thread's arena after each frame, guarded by frameProtectMutex.
+    FrameArenaStats arenaStats;
+    //Buffers the color-boosted frames are written to, reused once no snapshot holds them.
+    QVector<Mat> framePool;
+    quint64 frameBuffers;
 
     QMutex stoppedMutex;
     QMutex frameProtectMutex;
     QMutex groupsMutex;
+    //Protects the subject job bookkeeping below.
+    QMutex jobsMutex;
+    //Latest job per (group, subject), used to cancel it when the box is redrawn.
+    QMap<QPair<int, int>, QFuture<SubjectInitResult> > subjectJobs;
+    QMap<QPair<int, int>, int> subjectJobGenerations;
+    //Finished jobs and GUI edits waiting for a frame boundary.
+    QList<TrackerEdit> pendingEdits;
+    //Copies of what the GUI thread reads, so it never waits on groupsMutex. sharedMutex is held
+    //only briefly and no other lock is taken while holding it.
+    QMutex sharedMutex;
+    Mat sharedPalette;
+    QMap<int, Point3_<uchar> > sharedGroupColors;
+    //Frame and subject directions of the last snapshot published.
+    Mat sharedFrame;
+    QMap<QPair<int, int>, float> sharedDirections;
     ImageHandler* imageHandler;
     ImageData* imageData;
+    TrackExporter* trackExporter;
+    CheckpointWriter* checkpointWriter;
+    VideoCache* videoCache;
+    QString videoPath;
+    //Frame of the last periodic checkpoint.
+    int lastCheckpointFrame;
+    PipelineMetrics* metrics;
+    //Stage times of the frame being processed, guarded by frameProtectMutex.
+    FrameTimings timings;
 
     //Handles the data processing, called from RUN
     void process();
-    //Performs Weighted K-Means Algorithm
-    int awkmeans(Mat image, QRectF bound, list<Point3_<uchar> > *centers, IntClusterMap *clusters, ColorFrequencyMap *colorFreqs, int groupID);
-    //Shrinks Bounding Box to Color represented by Cluster M
-    QRectF fitRect(Mat dest, QRectF bound, IntClusterMap* clusters, int m);
-    QRectF fitBinRect(Mat image);
+    //A buffer from the frame pool that nothing else references, or a new one if all are in use.
+    Mat takeFrameBuffer(int rows, int cols);
+    //Captures the current frame and subject poses for the display.
+    TrackingSnapshot* buildSnapshot();
+    //Applies pending edits to the tracking state. Caller holds groupsMutex.
+    //Returns true if anything changed.
+    bool applyEdits();
+    void queueEdit(const TrackerEdit& edit);
+    //Removes every key of groups that maps to group. Caller holds groupsMutex.
+    void eraseGroupKey(SubjectGroup* group);
+    //Refreshes the frame and directions the GUI thread reads from a published snapshot.
+    void shareSnapshot(const TrackingSnapshot& snapshot);
+    //Puts the subjects back where a cached result has them. Caller holds groupsMutex.
+    void restoreResult(const TrackingResult& result);
+    //Puts the subjects back where their trajectories have them. Caller holds groupsMutex.
+    void restoreRecorded();
+    //Caches the result of the current frame. Caller holds groupsMutex.
+    void rememberResult(const TrackingSnapshot& snapshot);
+    //Forgets what was tracked after the current frame. Caller holds groupsMutex and
+    //frameProtectMutex.
+    void dropLaterResults();
+    //Called after the tracking state was edited by hand: later results are stale and the
+    //current one is replaced. Caller holds groupsMutex, but not frameProtectMutex.
+    void resultsEdited();
+    //Copies everything a checkpoint holds. Caller holds groupsMutex.
+    TrackerState captureState();
+    //Hands a snapshot of the current frame on and ends the frame. Caller holds groupsMutex
+    //and frameProtectMutex, both of which are released.
+    void finishFrame(TrackingSnapshot* snapshot, bool exportRows);
+    //The helpers below allocate their scratch containers and matrices from FrameArena::current().
+    //Callers reset the arena or hold a FrameArena::Scope around them.
+
+    //Performs Weighted K-Means Algorithm until it converges, or for at most maxRuns passes if maxRuns > 0.
+    //focusColor (if any) is guaranteed to be one of the centers. Returns -1 if cancelled through progress.
+    static int awkmeans(Mat image, QRectF bound, ArenaColorList *centers, ArenaClusterMap *clusters, ArenaFrequencyMap *colorFreqs,
+                        Mat palette, const Point3_<uchar>* focusColor = NULL, QFutureInterfaceBase* progress = NULL,
+                        int maxRuns = 0);
+    //Shrinks Bounding Box to the colors of cluster.
+    static QRectF fitRect(Mat dest, QRectF bound, const ArenaColorSet& cluster);
+    static QRectF fitBinRect(Mat image);
     //Returns the Center of Mass of the Blob contained in the Matrix.
-    Point2f getCenterOfMass(Mat binMat);
+    static Point2f getCenterOfMass(Mat binMat);
     //Returns the Direction of the Blob Contained in the Matrix
-    float getDirection(Point2f center, Mat binMat);
+    static float getDirection(Point2f center, Mat binMat);
     //Extracts a bitmap containing only 2 colors, background and foreground (as specified by clusterID).
-    Mat extractBinaryMat(Mat image, QRectF frame, IntClusterMap* clusters, int clusterID);
-    Mat extractBinaryMat(Mat image, QRectF frame, set<std::string> cluster);
+    //ColorSet is either a learned set<string> or a scratch ArenaColorSet.
+    template <class ColorSet>
+    static Mat extractBinaryMat(Mat image, QRectF frame, const ColorSet& cluster);
     //Extract the number of labels and a matrix of labels corresponding to an image.
-    pair<Mat, int> extractComponentLabels(Mat image);
+    static pair<Mat, int> extractComponentLabels(Mat image);
     //Filter out blobs in an image by size. Currently takes the largest blob (but this can be erroneous).
-    Mat sizeFilter(Mat image);
+    static Mat sizeFilter(Mat image);
     //Removes 1-2 pixel long bridges from the image. A bruteforce method of removing noise.
-    Mat removeBridges(Mat image);
+    static Mat removeBridges(Mat image);
     //Masks out an image using a bitmap.
-    Mat mask(Mat image, Mat mask);
+    static Mat mask(Mat image, Mat mask);
     //Returns a matrix representing a set of unique background colors.
     Mat findBackgroundColors();
     //Display the palette as colored squares in a window.
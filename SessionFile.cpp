@@ -0,0 +1,85 @@
+#include "SessionFile.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+
+SessionFile::SessionFile()
+{
+}
+
+bool SessionFile::load(QString filePath) {
+    groups.clear();
+    subjects.clear();
+    error.clear();
+
+    QFile file(filePath);
+    if (! file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "Could not open " + filePath;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (! in.atEnd()) {
+        QString line = in.readLine();
+        lineNumber++;
+        //Strip comments and surrounding whitespace.
+        int comment = line.indexOf('#');
+        if (comment > -1)
+            line.truncate(comment);
+        line = line.simplified();
+        if (line.isEmpty())
+            continue;
+
+        QStringList fields = line.split(' ');
+        bool ok = true;
+        if (fields[0] == "group" && fields.size() == 4) {
+            GroupSeed group;
+            group.ID = fields[1].toInt(&ok);
+            if (ok) group.pos.setX(fields[2].toInt(&ok));
+            if (ok) group.pos.setY(fields[3].toInt(&ok));
+            if (ok) groups.append(group);
+        } else if (fields[0] == "subject" && fields.size() == 7) {
+            SubjectSeed subject;
+            int x = 0, y = 0, w = 0, h = 0;
+            subject.groupID = fields[1].toInt(&ok);
+            if (ok) subject.subjectID = fields[2].toInt(&ok);
+            if (ok) x = fields[3].toInt(&ok);
+            if (ok) y = fields[4].toInt(&ok);
+            if (ok) w = fields[5].toInt(&ok);
+            if (ok) h = fields[6].toInt(&ok);
+            subject.bound = QRect(x, y, w, h);
+            //The subject's group has to exist before its color can be matched.
+            if (ok) {
+                ok = false;
+                for (int i = 0; i < groups.size(); i++)
+                    if (groups[i].ID == subject.groupID) ok = true;
+            }
+            if (ok) subjects.append(subject);
+        } else ok = false;
+
+        if (! ok) {
+            error = QString("Malformed entry on line %1 of %2").arg(lineNumber).arg(filePath);
+            return false;
+        }
+    }
+
+    if (groups.isEmpty()) {
+        error = "No groups defined in " + filePath;
+        return false;
+    }
+    return true;
+}
+
+QList<GroupSeed> SessionFile::getGroups() {
+    return groups;
+}
+
+QList<SubjectSeed> SessionFile::getSubjects() {
+    return subjects;
+}
+
+QString SessionFile::errorString() {
+    return error;
+}
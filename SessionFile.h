@@ -0,0 +1,48 @@
+#ifndef SESSIONFILE_H
+#define SESSIONFILE_H
+
+#include <QString>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+
+//A group, defined the same way the color picker does: by a pixel on the first frame.
+struct GroupSeed {
+    int ID;
+    QPoint pos;
+};
+
+//A subject, defined the same way the subject selector does: by a box on the first frame.
+struct SubjectSeed {
+    int groupID;
+    int subjectID;
+    QRect bound;
+};
+
+/*
+ * Initial annotations for a tracking run without the GUI.
+ * Plain text, one entry per line, '#' starts a comment:
+ *
+ *   group   <groupID> <x> <y>
+ *   subject <groupID> <subjectID> <x> <y> <width> <height>
+ *
+ * Groups must be listed before the subjects that belong to them.
+ */
+class SessionFile
+{
+public:
+    SessionFile();
+
+    bool load(QString filePath);
+
+    QList<GroupSeed> getGroups();
+    QList<SubjectSeed> getSubjects();
+    //Describes why the last load() failed.
+    QString errorString();
+private:
+    QList<GroupSeed> groups;
+    QList<SubjectSeed> subjects;
+    QString error;
+};
+
+#endif // SESSIONFILE_H
@@ -0,0 +1,115 @@
+#include "ShardCoordinator.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QThread>
+#include <QFile>
+#include <QDebug>
+#include "VideoCache.h"
+
+//Five seconds of 30 fps video.
+const int DEFAULT_SHARD_OVERLAP = 150;
+
+ShardCoordinator::ShardCoordinator(QObject* parent) :
+    QObject(parent), shardCount(0), overlap(DEFAULT_SHARD_OVERLAP), runningWorkers(0), failed(false)
+{
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    for (int i = 0; i < workers.size(); i++) {
+        if (workers[i]->state() != QProcess::NotRunning) {
+            workers[i]->kill();
+            workers[i]->waitForFinished();
+        }
+        delete workers[i];
+    }
+}
+
+void ShardCoordinator::setShardCount(int shards) {
+    shardCount = shards;
+}
+
+void ShardCoordinator::setOverlap(int frames) {
+    overlap = frames;
+}
+
+bool ShardCoordinator::start(QString videoPath, QString sessionPath, QString outputPath) {
+    VideoCache videoCache;
+    VideoProbe probe;
+    if (! videoCache.probe(videoPath, probe)) {
+        error = "Could not open video " + videoPath;
+        return false;
+    }
+    int frameCount = probe.frameCount;
+    if (frameCount <= 0) {
+        error = "Could not tell the frame count of " + videoPath;
+        return false;
+    }
+
+    int shards = shardCount > 0 ? shardCount : qMax(1, QThread::idealThreadCount());
+    //Each shard must be long enough to hold more than its overlap window.
+    shards = qMax(1, qMin(shards, frameCount / qMax(1, 2 * overlap)));
+    int shardLength = (frameCount + shards - 1) / shards;
+    this->outputPath = outputPath;
+
+    for (int k = 0; k < shards; k++) {
+        int ownedFrom = k * shardLength;
+        int first = qMax(0, ownedFrom - overlap);
+        int last = qMin(frameCount, ownedFrom + shardLength) - 1;
+        QString shardPath = QString("%1.shard%2.csv").arg(outputPath).arg(k);
+        shardPaths.append(shardPath);
+        stitcher.addShard(shardPath, ownedFrom);
+
+        QStringList args;
+        args << "--first" << QString::number(first) << "--last" << QString::number(last)
+             << videoPath << sessionPath << shardPath;
+        QProcess* worker = new QProcess(this);
+        worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        connect(worker, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(onWorkerFinished(int,QProcess::ExitStatus)));
+        connect(worker, SIGNAL(error(QProcess::ProcessError)), this, SLOT(onWorkerError(QProcess::ProcessError)));
+        workers.append(worker);
+        qWarning("Shard Coordinator: Shard %d tracks frames %d-%d.", k, first, last);
+        worker->start(QCoreApplication::applicationFilePath(), args);
+        runningWorkers++;
+    }
+    return true;
+}
+
+void ShardCoordinator::onWorkerFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+    if (exitStatus != QProcess::NormalExit || exitCode != 0) {
+        failed = true;
+        error = "A shard worker failed.";
+    }
+    workerDone();
+}
+
+//A worker that could not be started never emits finished().
+void ShardCoordinator::onWorkerError(QProcess::ProcessError processError) {
+    if (processError != QProcess::FailedToStart)
+        return;
+    QProcess* worker = qobject_cast<QProcess*>(sender());
+    failed = true;
+    error = "Could not start a shard worker: " + (worker ? worker->errorString() : QString());
+    workerDone();
+}
+
+void ShardCoordinator::workerDone() {
+    if (--runningWorkers > 0)
+        return;
+
+    if (! failed) {
+        failed = ! stitcher.stitch(outputPath);
+        if (failed)
+            error = stitcher.errorString();
+    }
+    //The shard files are only removed once the merged file is complete.
+    if (! failed) {
+        for (int i = 0; i < shardPaths.size(); i++)
+            QFile::remove(shardPaths[i]);
+    }
+    emit finished(! failed);
+}
+
+QString ShardCoordinator::errorString() {
+    return error;
+}
@@ -0,0 +1,51 @@
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QList>
+
+#include "TrackStitcher.h"
+
+/*
+ * Splits one long video into consecutive frame ranges and tracks each range in its own
+ * worker process (this executable, run with --first/--last). Every range except the first
+ * starts overlap frames early, so the TrackStitcher can match its subjects against the
+ * previous range before the range proper begins.
+ */
+class ShardCoordinator : public QObject
+{
+    Q_OBJECT
+public:
+    ShardCoordinator(QObject* parent = 0);
+    ~ShardCoordinator();
+
+    //0 uses one shard per core.
+    void setShardCount(int shards);
+    void setOverlap(int frames);
+
+    bool start(QString videoPath, QString sessionPath, QString outputPath);
+    QString errorString();
+signals:
+    //Emitted once the shards have been stitched together (or have failed).
+    void finished(bool succeeded);
+private slots:
+    void onWorkerFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void onWorkerError(QProcess::ProcessError processError);
+private:
+    QList<QProcess*> workers;
+    TrackStitcher stitcher;
+    QList<QString> shardPaths;
+    QString outputPath;
+    QString error;
+    int shardCount;
+    int overlap;
+    int runningWorkers;
+    bool failed;
+
+    //Stitches the shards once the last worker is done.
+    void workerDone();
+};
+
+#endif // SHARDCOORDINATOR_H
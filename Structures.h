@@ -26,12 +26,42 @@ struct MouseData{
     int cursorType;
 };
 
+//Subject layer drawn over the frame: one box and one heading line per subject, and their trails.
+struct SubjectOverlay{
+    QVector<QRectF> boxes;
+    QVector<QLineF> headings;
+    QVector<QLineF> trails;
+};
+Q_DECLARE_METATYPE(SubjectOverlay)
+
 const float DIST_THRESH_RGB = 30;
 
 const float DIST_THRESH_LAB = 30;
 
 const int DIR_SEARCH_THRESH = 5;
 
+//Upper bound on k-means passes, the clustering usually settles well before.
+const int MAX_KMEANS_RUNS = 50;
+
+//Maximum rate (Hz) at which the DisplayThread paints processed frames.
+const int DEFAULT_DISPLAY_RATE = 30;
+
+//Samples per trajectory block, the unit in which subject histories are spilled.
+const int TRAJECTORY_BLOCK_SIZE = 64;
+//Blocks held in memory per subject before the oldest is spilled.
+const int TRAJECTORY_RING_BLOCKS = 4;
+//Number of past positions drawn as a subject's trail.
+const int TRAIL_LENGTH = 48;
+
+//Memory the ProcessingThread may spend on results of frames it already tracked (bytes).
+const int TRACKING_CACHE_BYTES = 64 << 20;
+//Frame buffers the ProcessingThread reuses for the frames it publishes: enough for the one
+//being displayed, the one waiting in ImageData, the GUI's copy and the one being processed.
+const int FRAME_POOL_SIZE = 6;
+
+//Frames between periodic checkpoints of the tracker state.
+const int CHECKPOINT_INTERVAL = 1000;
+
 //Defines enumeration of Cursor Types.
 enum CURSOR_TYPES {
     DEFAULT = 0,
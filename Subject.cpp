@@ -1,38 +1,38 @@
 #include "Subject.h"
 
 Subject::Subject(QRectF boundFrame, int newID, int frameIndex) :
-    ID(newID), groupID(-1), startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame)
+    ID(newID), groupID(-1), startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame), kinematics(NULL), row(-1)
 {
     this->position = boundFrame.center();
     this->direction = 0;
 }
 
 Subject::Subject(QRectF boundFrame, float newDir, int newID, int frameIndex) :
-    direction(newDir), ID(newID), groupID(-1), startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame)
+    direction(newDir), ID(newID), groupID(-1), startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame), kinematics(NULL), row(-1)
 {
     this->position = currentBoundingFrame.center();
 }
 
 Subject::Subject(QRectF boundFrame, QPointF newPos, float newDir, set<string> newColors, int newID, int groupID, int frameIndex) :
     position(newPos), direction(newDir), colors(newColors), ID(newID), groupID(groupID),
-    startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame)
+    startingFrameIndex(frameIndex), currentBoundingFrame(boundFrame), kinematics(NULL), row(-1)
 {
 }
 
 QPointF Subject::pos() {
+    if (kinematics)
+        return QPointF(kinematics->x[row], kinematics->y[row]);
     return position;
 }
 
 float Subject::dir() {
+    if (kinematics)
+        return kinematics->heading[row];
     return direction;
 }
 
-std::list<QPointF> Subject::getPastPositions() {
-    return pastPositions;
-}
-
-std::list<float> Subject::getPastDirections() {
-    return pastDirections;
+const TrajectoryRing& Subject::getTrajectory() const {
+    return trajectory;
 }
 
 set<std::string> Subject::getColors() {
@@ -48,26 +48,58 @@ int Subject::getID() {
 }
 
 int Subject::getGroupID() {
-    qDebug() << "Group ID Called: " << groupID;
     return groupID;
 }
 
 QRectF Subject::getCurrentBoundingFrame() {
+    if (kinematics)
+        return QRectF(kinematics->left[row], kinematics->top[row], kinematics->width[row], kinematics->height[row]);
     return currentBoundingFrame;
 }
 
 void Subject::setCurrentBoundingFrame(QRectF boundFrame) {
-    this->currentBoundingFrame = boundFrame;
+    if (kinematics)
+        kinematics->setBox(row, boundFrame);
+    else this->currentBoundingFrame = boundFrame;
 }
 
 void Subject::setPos(QPointF newPos) {
-    pastPositions.push_front(position);
-    this->position = newPos;
+    if (kinematics)
+        kinematics->setPos(row, newPos);
+    else this->position = newPos;
 }
 
 void Subject::setDirection(float newDir){
-    pastDirections.push_front(direction);
-    this->direction = newDir;
+    if (kinematics)
+        kinematics->setHeading(row, newDir);
+    else this->direction = newDir;
+}
+
+void Subject::record(int frameIndex, TrajectoryStore* spill) {
+    TrajectorySample sample;
+    sample.frameIndex = frameIndex;
+    sample.pos = pos();
+    sample.dir = dir();
+    sample.bound = getCurrentBoundingFrame();
+    trajectory.append(sample, groupID, ID, spill);
+}
+
+void Subject::flushTrajectory(TrajectoryStore* spill) {
+    trajectory.flush(groupID, ID, spill);
+}
+
+void Subject::truncateTrajectory(int frameIndex) {
+    trajectory.truncateAfter(frameIndex);
+}
+
+void Subject::attach(KinematicStore* store, int newRow) {
+    if (kinematics && ! store) {
+        position = pos();
+        direction = dir();
+        currentBoundingFrame = getCurrentBoundingFrame();
+    }
+    kinematics = store;
+    row = newRow;
 }
 
 void Subject::setColors(set<string> newColors) {
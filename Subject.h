@@ -8,9 +8,15 @@
 #include <map>
 #include <set>
 #include "Structures.h"
+#include "KinematicStore.h"
+#include "TrajectoryRing.h"
 
 using namespace cv;
 
+/*
+ * Once registered in a SubjectRegistry, a Subject is a view: its position, direction and
+ * bounding frame live in the registry's KinematicStore row. Before that they are held locally.
+ */
 class Subject {
 public:
     Subject(QRectF boundFrame, int newID, int frameIndex);
@@ -20,8 +26,8 @@ public:
     //Getters
     QPointF pos();
     float dir();
-    std::list<QPointF> getPastPositions();
-    std::list<float> getPastDirections();
+    //Recent poses, one per processed frame.
+    const TrajectoryRing& getTrajectory() const;
     set<std::string> getColors();
     int getStartingFrameIndex();
     int getID();
@@ -33,21 +39,31 @@ public:
     void setDirection(float newDir);
     void setColors(set<std::string> newColors);
     void setCurrentBoundingFrame(QRectF boundFrame);
+    //Appends the current pose to the trajectory. Blocks pushed out of the ring go to spill (may be NULL).
+    void record(int frameIndex, TrajectoryStore* spill);
+    //Hands the part of the trajectory not spilled yet to spill.
+    void flushTrajectory(TrajectoryStore* spill);
+    //Forgets the poses recorded for frames after frameIndex.
+    void truncateTrajectory(int frameIndex);
+
+    //Moves the pose into row of the store, or back into the Subject if store is NULL.
+    void attach(KinematicStore* store, int row);
 
 private:
     QPointF position;
     float direction;
-    std::list<QPointF> pastPositions;
-    std::list<float> pastDirections;
+    TrajectoryRing trajectory;
     set<std::string> colors;
-    const int ID;
-    const int groupID;
-    const int startingFrameIndex;
+    //Not const so subjects can be stored by value (see SubjectRegistry).
+    int ID;
+    int groupID;
+    int startingFrameIndex;
     QRectF currentBoundingFrame;
+    //Backing store once registered, NULL otherwise.
+    KinematicStore* kinematics;
+    int row;
 };
 
-//Maps the Subject's int ID to the Subject pointer.
-typedef std::map<int, Subject*> IntSubjectMap;
 
 
 #endif // SUBJECT_H
@@ -25,13 +25,6 @@ std::string SubjectGroup::getColorString() {
     return tempCol;
 }
 
-IntSubjectMap SubjectGroup::getSubjects() {
-    //subjectsMutex.lock();
-    IntSubjectMap tempMap = subjects;
-    //subjectsMutex.unlock();
-    return tempMap;
-}
-
 int SubjectGroup::getID() {
    return this->ID;
 }
@@ -42,13 +35,3 @@ void SubjectGroup::setColor(Point3_<uchar> color) {
     this->colorHex = color2Hex(color);
     //colorMutex.unlock();
 }
-
-void SubjectGroup::addSubject(Subject *subject) {
-    //if (subjects.count(subject->getID())) qDebug() << "Subject of ID exists: " << subject->getID();
-    //else qDebug() << "Adding new Subject of ID: " << subject->getID();
-    this->subjects[subject->getID()] = subject;
-}
-
-void SubjectGroup::removeSubject(int subjectID) {
-    subjects.erase(subjectID);
-}
@@ -14,20 +14,16 @@ public:
     //GETTERS
     Point3_<uchar> getColorPoint();
     std::string getColorString();
-    IntSubjectMap getSubjects();
     int getID();
 
     //SETTERS
     void setColor(Point3_<uchar> color);
-    void addSubject(Subject* subject);
-    void removeSubject(int subjectID);
 
 private:
     //Color is guaranteed to be a unique center m in LAB
     Point3_<uchar> colorPoint;
     std::string colorHex;
-    //Contains a list of all subjects guaranteed to be of the same color cluster.
-    IntSubjectMap subjects;
+    //The group's subjects live in the ProcessingThread's SubjectRegistry.
     const int ID;
     //Thread Protection
     //QMutex colorMutex;
@@ -0,0 +1,31 @@
+#include "SubjectInitJob.h"
+#include "ProcessingThread.h"
+#include "Structures.h"
+#include "Timeline.h"
+
+SubjectInitJob::SubjectInitJob(ProcessingThread* owner, const SubjectInitRequest& request) :
+    owner(owner), request(request)
+{
+    setAutoDelete(true);
+    futureInterface.setProgressRange(0, MAX_KMEANS_RUNS);
+}
+
+QFuture<SubjectInitResult> SubjectInitJob::start(QThreadPool* pool) {
+    futureInterface.reportStarted();
+    QFuture<SubjectInitResult> future = futureInterface.future();
+    pool->start(this);
+    return future;
+}
+
+void SubjectInitJob::run() {
+    Timeline::Span span("subject init", "subject", request.subjectID);
+    if (! futureInterface.isCanceled()) {
+        SubjectInitResult result = ProcessingThread::initSubject(request, &futureInterface);
+        if (! futureInterface.isCanceled()) {
+            futureInterface.reportResult(result);
+            //Queued before finishing, so whoever waits on the future can apply it right away.
+            owner->queueSubjectResult(result);
+        }
+    }
+    futureInterface.reportFinished();
+}
@@ -0,0 +1,65 @@
+#ifndef SUBJECTINITJOB_H
+#define SUBJECTINITJOB_H
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QRectF>
+#include <QPointF>
+#include <set>
+#include <string>
+#include "opencv/highgui.h"
+
+using namespace cv;
+
+//Everything needed to initialize a subject, copied so the job never reads tracking state.
+struct SubjectInitRequest {
+    int groupID;
+    int subjectID;
+    int frameIndex;
+    //Bumped each time the same subject is requested again, older results are dropped.
+    int generation;
+    //Selection box in frame coordinates.
+    QRectF bound;
+    //BGR frame the box was drawn on. Shared, never written to.
+    Mat source;
+    //Lab color of the group, the cluster closest to it becomes the subject's colors.
+    Point3_<uchar> groupColor;
+    Mat backgroundPalette;
+};
+
+//Outcome of a SubjectInitRequest. found is false if no pixel of the group's color was in the box.
+struct SubjectInitResult {
+    int groupID;
+    int subjectID;
+    int frameIndex;
+    int generation;
+    bool found;
+    QRectF bound;
+    QPointF pos;
+    float dir;
+    std::set<std::string> cluster;
+};
+
+class ProcessingThread;
+
+/*
+ * Runs ProcessingThread::initSubject() on a pool thread.
+ * Progress is reported in k-means passes. Cancelling the future stops the job at the next pass
+ * and its result is never handed to the ProcessingThread.
+ */
+class SubjectInitJob : public QRunnable
+{
+public:
+    SubjectInitJob(ProcessingThread* owner, const SubjectInitRequest& request);
+    //Queues the job on the pool and returns its future.
+    QFuture<SubjectInitResult> start(QThreadPool* pool);
+    void run();
+private:
+    ProcessingThread* owner;
+    SubjectInitRequest request;
+    QFutureInterface<SubjectInitResult> futureInterface;
+};
+
+#endif // SUBJECTINITJOB_H
@@ -0,0 +1,162 @@
+#include "SubjectRegistry.h"
+
+SubjectRegistry::SubjectRegistry() :
+    trajectoryStore(NULL)
+{
+}
+
+void SubjectRegistry::setTrajectoryStore(TrajectoryStore* store) {
+    trajectoryStore = store;
+}
+
+quint64 SubjectRegistry::key(int groupID, int subjectID) {
+    return ((quint64)(quint32)groupID << 32) | (quint32)subjectID;
+}
+
+SubjectHandle SubjectRegistry::insert(const Subject& subject) {
+    Subject tempSubject = subject;
+    //Take the pose out of any store before rows start moving.
+    tempSubject.attach(NULL, -1);
+    int groupID = tempSubject.getGroupID();
+    int subjectID = tempSubject.getID();
+
+    //Same subject drawn again, the old entry goes and its handles turn stale.
+    if (lookup.contains(key(groupID, subjectID)))
+        remove(groupID, subjectID);
+
+    //Keep the array sorted by group, then ID.
+    int lo = 0, hi = subjects.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int midGroup = subjects[mid].getGroupID();
+        if (midGroup < groupID || (midGroup == groupID && subjects[mid].getID() < subjectID))
+            lo = mid + 1;
+        else hi = mid;
+    }
+    int index = lo;
+
+    quint32 slot;
+    if (! freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        Slot newSlot;
+        newSlot.index = -1;
+        newSlot.generation = 0;
+        slots.push_back(newSlot);
+        slot = slots.size() - 1;
+    }
+    //Generation 0 is reserved for null handles.
+    if (++slots[slot].generation == 0)
+        slots[slot].generation = 1;
+
+    kinematicStore.insert(index, tempSubject.pos(), tempSubject.dir(), tempSubject.getCurrentBoundingFrame());
+    subjects.insert(subjects.begin() + index, tempSubject);
+    slotOfIndex.insert(slotOfIndex.begin() + index, slot);
+    lookup.insert(key(groupID, subjectID), slot);
+    reindex(index);
+
+    SubjectHandle handle;
+    handle.slot = slot;
+    handle.generation = slots[slot].generation;
+    return handle;
+}
+
+bool SubjectRegistry::remove(int groupID, int subjectID) {
+    QHash<quint64, quint32>::iterator it = lookup.find(key(groupID, subjectID));
+    if (it == lookup.end())
+        return false;
+    int index = slots[it.value()].index;
+    eraseAt(index);
+    reindex(index);
+    return true;
+}
+
+int SubjectRegistry::removeGroup(int groupID) {
+    QPair<int, int> range = groupRange(groupID);
+    for (int i = range.second - 1; i >= range.first; i--)
+        eraseAt(i);
+    reindex(range.first);
+    return range.second - range.first;
+}
+
+void SubjectRegistry::clear() {
+    for (int i = subjects.size() - 1; i >= 0; i--)
+        eraseAt(i);
+    kinematicStore.clear();
+    ranges.clear();
+}
+
+Subject* SubjectRegistry::get(SubjectHandle handle) {
+    if (handle.isNull() || handle.slot >= slots.size())
+        return NULL;
+    const Slot& slot = slots[handle.slot];
+    if (slot.generation != handle.generation || slot.index < 0)
+        return NULL;
+    return &subjects[slot.index];
+}
+
+Subject* SubjectRegistry::find(int groupID, int subjectID) {
+    QHash<quint64, quint32>::const_iterator it = lookup.constFind(key(groupID, subjectID));
+    if (it == lookup.constEnd())
+        return NULL;
+    return &subjects[slots[it.value()].index];
+}
+
+SubjectHandle SubjectRegistry::handle(int groupID, int subjectID) const {
+    SubjectHandle handle;
+    QHash<quint64, quint32>::const_iterator it = lookup.constFind(key(groupID, subjectID));
+    if (it != lookup.constEnd()) {
+        handle.slot = it.value();
+        handle.generation = slots[it.value()].generation;
+    }
+    return handle;
+}
+
+int SubjectRegistry::size() const {
+    return subjects.size();
+}
+
+Subject* SubjectRegistry::at(int index) {
+    return &subjects[index];
+}
+
+KinematicStore& SubjectRegistry::kinematics() {
+    return kinematicStore;
+}
+
+QPair<int, int> SubjectRegistry::groupRange(int groupID) const {
+    return ranges.value(groupID, qMakePair(0, 0));
+}
+
+//Frees the subject's slot and closes the gap. Slot indices and ranges are stale afterwards.
+void SubjectRegistry::eraseAt(int index) {
+    quint32 slot = slotOfIndex[index];
+    //Its history outlives the subject.
+    subjects[index].flushTrajectory(trajectoryStore);
+    lookup.remove(key(subjects[index].getGroupID(), subjects[index].getID()));
+    slots[slot].index = -1;
+    freeSlots.push_back(slot);
+
+    subjects.erase(subjects.begin() + index);
+    slotOfIndex.erase(slotOfIndex.begin() + index);
+    kinematicStore.erase(index);
+}
+
+void SubjectRegistry::reindex(int first) {
+    for (int i = first; i < (int)subjects.size(); i++) {
+        slots[slotOfIndex[i]].index = i;
+        subjects[i].attach(&kinematicStore, i);
+    }
+
+    //Ranges are few (one per group), rebuilding them is cheaper than patching.
+    ranges.clear();
+    for (int i = 0; i < (int)subjects.size();) {
+        int groupID = subjects[i].getGroupID();
+        int j = i;
+        while (j < (int)subjects.size() && subjects[j].getGroupID() == groupID)
+            j++;
+        ranges.insert(groupID, qMakePair(i, j));
+        i = j;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SUBJECTREGISTRY_H
+#define SUBJECTREGISTRY_H
+
+#include <QHash>
+#include <QPair>
+#include <vector>
+#include "Subject.h"
+
+//Refers to a subject in a SubjectRegistry. Stays valid while the subject is registered,
+//and resolves to NULL once it was removed, even if its slot got reused.
+struct SubjectHandle {
+    quint32 slot;
+    quint32 generation;
+
+    SubjectHandle() : slot(0), generation(0) {}
+    bool isNull() const { return generation == 0; }
+};
+
+/*
+ * Owns every Subject in one contiguous array, sorted by group and then by ID, so the
+ * subjects of a group form an index range and a full pass never allocates.
+ * Lookup by (group, ID) and by handle is O(1). Adding or removing subjects moves the
+ * array, so Subject pointers are only good until the next change; keep handles instead.
+ * Not thread safe, the ProcessingThread guards it with its groups mutex.
+ */
+class SubjectRegistry
+{
+public:
+    SubjectRegistry();
+
+    //Removed subjects flush their trajectory into store (may be NULL).
+    void setTrajectoryStore(TrajectoryStore* store);
+
+    //Adds the subject, replacing a registered subject with the same group and ID.
+    SubjectHandle insert(const Subject& subject);
+    bool remove(int groupID, int subjectID);
+    //Removes every subject of the group, returns how many were removed.
+    int removeGroup(int groupID);
+    void clear();
+
+    //NULL if the handle is stale.
+    Subject* get(SubjectHandle handle);
+    //NULL if no such subject is registered.
+    Subject* find(int groupID, int subjectID);
+    SubjectHandle handle(int groupID, int subjectID) const;
+
+    //Subjects in storage order.
+    int size() const;
+    Subject* at(int index);
+    //Pose arrays of all subjects, row i belongs to at(i).
+    KinematicStore& kinematics();
+    //Index range [first, second) of the group's subjects, empty if it has none.
+    QPair<int, int> groupRange(int groupID) const;
+private:
+    struct Slot {
+        //Position in subjects, -1 while the slot is free.
+        int index;
+        quint32 generation;
+    };
+
+    std::vector<Subject> subjects;
+    //Kinematic state, parallel to subjects.
+    KinematicStore kinematicStore;
+    //Slot of the subject at the same position in subjects.
+    std::vector<quint32> slotOfIndex;
+    std::vector<Slot> slots;
+    std::vector<quint32> freeSlots;
+    //(group, ID) to slot.
+    QHash<quint64, quint32> lookup;
+    QHash<int, QPair<int, int> > ranges;
+    TrajectoryStore* trajectoryStore;
+
+    static quint64 key(int groupID, int subjectID);
+    //Refreshes slot indices and group ranges after the array moved, from index first on.
+    void reindex(int first);
+    void eraseAt(int index);
+};
+
+#endif // SUBJECTREGISTRY_H
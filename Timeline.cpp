@@ -0,0 +1,165 @@
+#include "Timeline.h"
+#include "PipelineMetrics.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+
+QAtomicInt Timeline::enabled(0);
+
+struct TimelineSpan {
+    const char* name;
+    const char* argName;
+    int arg;
+    qint64 start;
+    qint64 end;
+};
+
+static_assert((Timeline::RING_CAPACITY & (Timeline::RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two.");
+
+//Spans of one thread. Written by that thread only.
+struct TimelineRing {
+    TimelineSpan spans[Timeline::RING_CAPACITY];
+    //Spans written so far, span n lives in slot n & (RING_CAPACITY - 1). Unsigned, so it
+    //wraps around on long recordings without ever giving a negative slot.
+    QAtomicInteger<quint32> count;
+    //Set once the thread finished, the ring may then be handed to another thread.
+    QAtomicInt retired;
+    QByteArray threadName;
+    int tid;
+
+    TimelineRing() : count(0), retired(0), tid(0) {}
+};
+
+//Retires the ring of a thread when QThreadStorage deletes it at thread exit.
+struct TimelineRingHandle {
+    TimelineRing* ring;
+    ~TimelineRingHandle() { if (ring) ring->retired.storeRelease(1); }
+};
+
+static QThreadStorage<TimelineRingHandle*> threadRings;
+//Guards rings and the fields set at registration. Threads only take it once.
+static QMutex ringsMutex;
+static QList<TimelineRing*> rings;
+static int threadCount = 0;
+//Spans ending before this are left out of exports, see clear().
+static QAtomicInt clearedAtMs(0);
+
+//NULL if every ring belongs to a live thread.
+static TimelineRing* currentRing() {
+    if (! threadRings.hasLocalData()) {
+        TimelineRingHandle* handle = new TimelineRingHandle();
+        handle->ring = NULL;
+        ringsMutex.lock();
+        if (rings.size() < Timeline::MAX_THREADS) {
+            handle->ring = new TimelineRing();
+            rings.append(handle->ring);
+        } else {
+            for (int i = 0; i < rings.size() && handle->ring == NULL; i++) {
+                if (rings[i]->retired.loadAcquire()) {
+                    handle->ring = rings[i];
+                    handle->ring->count.storeRelease(0);
+                    handle->ring->retired.storeRelease(0);
+                }
+            }
+        }
+        if (handle->ring) {
+            handle->ring->tid = ++threadCount;
+            handle->ring->threadName = QByteArray(QThread::currentThread()->metaObject()->className()) + "-" +
+                                       QByteArray::number(handle->ring->tid);
+        }
+        ringsMutex.unlock();
+        threadRings.setLocalData(handle);
+    }
+    return threadRings.localData()->ring;
+}
+
+Timeline::Span::Span(const char* name, const char* argName, int arg) :
+    name(name), argName(argName), arg(arg), start(isEnabled() ? PipelineMetrics::now() : -1)
+{
+}
+
+Timeline::Span::~Span() {
+    if (start >= 0)
+        record(name, start, PipelineMetrics::now(), argName, arg);
+}
+
+void Timeline::setEnabled(bool enable) {
+    enabled.storeRelease(enable);
+}
+
+void Timeline::clear() {
+    clearedAtMs.storeRelease(PipelineMetrics::now() / 1000000);
+}
+
+void Timeline::record(const char* name, qint64 start, qint64 end, const char* argName, int arg) {
+    TimelineRing* ring = currentRing();
+    if (ring == NULL)
+        return;
+    quint32 n = ring->count.loadAcquire();
+    TimelineSpan& span = ring->spans[n & (RING_CAPACITY - 1)];
+    span.name = name;
+    span.argName = argName;
+    span.arg = arg;
+    span.start = start;
+    span.end = end;
+    ring->count.storeRelease(n + 1);
+}
+
+//Nanoseconds to the microseconds of the trace format.
+static QByteArray micros(qint64 ns) {
+    return QByteArray::number(ns / 1000.0, 'f', 3);
+}
+
+bool Timeline::writeChromeTrace(QString filePath) {
+    QFile file(filePath);
+    if (! file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Timeline: Could not open " << filePath;
+        return false;
+    }
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    qint64 clearedAt = (qint64)clearedAtMs.loadAcquire() * 1000000;
+    int written = 0;
+
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    ringsMutex.lock();
+    for (int r = 0; r < rings.size(); r++) {
+        TimelineRing* ring = rings[r];
+        QByteArray tid = QByteArray::number(ring->tid);
+        QByteArray out = "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid +
+                         ",\"args\":{\"name\":\"" + ring->threadName + "\"}},\n";
+
+        quint32 count = ring->count.loadAcquire();
+        quint32 held = qMin(count, (quint32)RING_CAPACITY);
+        quint32 first = count - held;
+        QVector<TimelineSpan> spans;
+        spans.reserve(held);
+        for (quint32 n = 0; n < held; n++)
+            spans.append(ring->spans[(first + n) & (RING_CAPACITY - 1)]);
+        //Spans the thread overwrote (or is overwriting) while they were copied are dropped.
+        quint32 written = ring->count.loadAcquire() - count + 1;
+        quint32 lost = written > RING_CAPACITY - held ? qMin(written - (RING_CAPACITY - held), held) : 0;
+
+        for (int i = lost; i < spans.size(); i++) {
+            const TimelineSpan& span = spans[i];
+            if (span.end < clearedAt)
+                continue;
+            out += "{\"ph\":\"X\",\"cat\":\"pipeline\",\"name\":\"" + QByteArray(span.name) + "\",\"pid\":" + pid +
+                   ",\"tid\":" + tid + ",\"ts\":" + micros(span.start) + ",\"dur\":" + micros(span.end - span.start);
+            if (span.argName)
+                out += ",\"args\":{\"" + QByteArray(span.argName) + "\":" + QByteArray::number(span.arg) + "}";
+            out += "},\n";
+            written++;
+        }
+        file.write(out);
+    }
+    ringsMutex.unlock();
+    //Closes the array without a trailing comma.
+    file.write("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" + pid + ",\"args\":{\"name\":\"ParticleTracker\"}}\n]}\n");
+    qDebug() << "Timeline: Wrote " << written << " spans to " << filePath;
+    return file.error() == QFile::NoError;
+}
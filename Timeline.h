@@ -0,0 +1,52 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QtGlobal>
+
+/*
+ * Records what each pipeline thread was doing and when, for viewing the threads side by
+ * side in a trace viewer (chrome://tracing or Perfetto).
+ *
+ * Spans are kept on a ring per thread holding the last RING_CAPACITY of them, so memory
+ * stays bounded however long the recording runs; older spans are overwritten. Recording
+ * a span takes no lock. Off until setEnabled(true), spans then cost one atomic load.
+ */
+class Timeline
+{
+public:
+    //Times the enclosing scope, if recording is on when it is entered.
+    class Span {
+    public:
+        //name and argName must be string literals. argName names an integer shown
+        //with the span, e.g. the frame or subject.
+        Span(const char* name, const char* argName = NULL, int arg = 0);
+        ~Span();
+    private:
+        const char* name;
+        const char* argName;
+        int arg;
+        qint64 start;
+    };
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return enabled.loadAcquire() != 0; }
+    //Drops everything recorded so far from later exports.
+    static void clear();
+    //Records a span over [start, end] in PipelineMetrics::now() time. Callers check isEnabled() first.
+    static void record(const char* name, qint64 start, qint64 end, const char* argName = NULL, int arg = 0);
+
+    //Writes every span still held in Chrome trace-event JSON. Safe while recording.
+    static bool writeChromeTrace(QString filePath);
+
+    //Spans kept per thread, a power of two so slots are taken with a mask.
+    static const int RING_CAPACITY = 1 << 14;
+    //Threads with a ring of their own. Rings of finished threads are handed to new ones
+    //once this many exist.
+    static const int MAX_THREADS = 32;
+private:
+    static QAtomicInt enabled;
+};
+
+#endif // TIMELINE_H
@@ -0,0 +1,201 @@
+#include "Trace.h"
+#include "PipelineMetrics.h"
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+#include <QWaitCondition>
+#include <algorithm>
+#include <cstdio>
+
+QAtomicInt Trace::runtimeLevel(TRACE_LEVEL_OFF);
+
+static const char* levelNames[] = { "", "I", "D", "V" };
+
+//Records of one thread. Filled by that thread only, emptied by the drainer only.
+struct TraceRing {
+    TraceRecord records[Trace::RING_CAPACITY];
+    //Next slot to read, owned by the drainer.
+    QAtomicInt head;
+    //Next slot to write, owned by the thread.
+    QAtomicInt tail;
+    QAtomicInt dropped;
+    //Set once the thread finished, the drainer frees the ring after emptying it.
+    QAtomicInt retired;
+    QByteArray threadName;
+    int reportedDrops;
+
+    TraceRing() : head(0), tail(0), dropped(0), retired(0), reportedDrops(0) {}
+};
+
+//Retires the ring of a thread when QThreadStorage deletes it at thread exit.
+struct TraceRingHandle {
+    TraceRing* ring;
+    ~TraceRingHandle() { ring->retired.storeRelease(1); }
+};
+
+class TraceDrainer : public QThread
+{
+public:
+    TraceDrainer() : stopped(false) {}
+    void stop();
+    //Empties every ring and writes the records out in time order.
+    void drain();
+protected:
+    void run();
+private:
+    QMutex sleepMutex;
+    QWaitCondition wake;
+    bool stopped;
+    QVector<TraceRecord> batch;
+    QVector<QByteArray> batchThreads;
+};
+
+static QThreadStorage<TraceRingHandle*> threadRings;
+//Guards rings and drainer. Threads only take it once, to register their ring.
+static QMutex ringsMutex;
+static QList<TraceRing*> rings;
+static int threadCount = 0;
+static TraceDrainer* drainer = NULL;
+
+static bool earlier(const QPair<qint64, int>& a, const QPair<qint64, int>& b) {
+    return a.first < b.first;
+}
+
+static TraceRing* currentRing() {
+    if (! threadRings.hasLocalData()) {
+        TraceRingHandle* handle = new TraceRingHandle();
+        handle->ring = new TraceRing();
+        QThread* thread = QThread::currentThread();
+        ringsMutex.lock();
+        handle->ring->threadName = QByteArray(thread->metaObject()->className()) + "-" +
+                                   QByteArray::number(++threadCount);
+        rings.append(handle->ring);
+        ringsMutex.unlock();
+        threadRings.setLocalData(handle);
+    }
+    return threadRings.localData()->ring;
+}
+
+void Trace::push(TraceRecord& record) {
+    record.time = PipelineMetrics::now();
+    TraceRing* ring = currentRing();
+    int t = ring->tail.loadAcquire();
+    int next = (t + 1) % RING_CAPACITY;
+    if (next == ring->head.loadAcquire()) {
+        ring->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    ring->records[t] = record;
+    ring->tail.storeRelease(next);
+}
+
+void Trace::start(int level) {
+    ringsMutex.lock();
+    if (drainer == NULL) {
+        drainer = new TraceDrainer();
+        drainer->start(QThread::LowPriority);
+    }
+    ringsMutex.unlock();
+    setLevel(level);
+}
+
+void Trace::stop() {
+    setLevel(TRACE_LEVEL_OFF);
+    ringsMutex.lock();
+    TraceDrainer* stopping = drainer;
+    drainer = NULL;
+    ringsMutex.unlock();
+    if (stopping) {
+        stopping->stop();
+        stopping->wait();
+        delete stopping;
+    }
+}
+
+void Trace::setLevel(int level) {
+    runtimeLevel.storeRelease(qMin(level, TRACE_LEVEL));
+}
+
+void TraceDrainer::stop() {
+    sleepMutex.lock();
+    stopped = true;
+    wake.wakeOne();
+    sleepMutex.unlock();
+}
+
+void TraceDrainer::run() {
+    for (;;) {
+        sleepMutex.lock();
+        if (! stopped)
+            wake.wait(&sleepMutex, Trace::DRAIN_INTERVAL_MS);
+        bool done = stopped;
+        sleepMutex.unlock();
+        //Traces recorded up to stop() are still written.
+        drain();
+        if (done)
+            break;
+    }
+}
+
+void TraceDrainer::drain() {
+    batch.resize(0);
+    batchThreads.resize(0);
+    QVector<QPair<qint64, int> > order;
+    QByteArray warnings;
+
+    ringsMutex.lock();
+    for (int r = 0; r < rings.size(); r++) {
+        TraceRing* ring = rings[r];
+        //Read before the records: a retired ring receives nothing after them.
+        bool retired = ring->retired.loadAcquire();
+        int h = ring->head.loadAcquire();
+        int t = ring->tail.loadAcquire();
+        for (; h != t; h = (h + 1) % Trace::RING_CAPACITY) {
+            order.append(qMakePair(ring->records[h].time, batch.size()));
+            batch.append(ring->records[h]);
+            batchThreads.append(ring->threadName);
+        }
+        ring->head.storeRelease(h);
+
+        int dropped = ring->dropped.loadAcquire();
+        if (dropped != ring->reportedDrops) {
+            warnings += "Trace: " + QByteArray::number(dropped - ring->reportedDrops) + " records of " +
+                        ring->threadName + " dropped, its ring was full.\n";
+            ring->reportedDrops = dropped;
+        }
+        if (retired) {
+            rings.removeAt(r--);
+            delete ring;
+        }
+    }
+    ringsMutex.unlock();
+
+    if (batch.isEmpty() && warnings.isEmpty())
+        return;
+    //Rings are drained one after the other, so records of different threads interleave here.
+    std::stable_sort(order.begin(), order.end(), earlier);
+    QByteArray out = warnings;
+    for (int i = 0; i < order.size(); i++) {
+        const TraceRecord& record = batch[order[i].second];
+        QString message = QString::fromLatin1(record.format);
+        for (int a = 0; a < record.argCount; a++) {
+            const TraceArg& arg = record.args[a];
+            switch (arg.type) {
+            case TraceArg::INT: message = message.arg(arg.i); break;
+            case TraceArg::UINT: message = message.arg(arg.u); break;
+            case TraceArg::REAL: message = message.arg(arg.d); break;
+            case TraceArg::TEXT: message = message.arg(QLatin1String(arg.s)); break;
+            }
+        }
+        out += QByteArray::number(record.time / 1000000.0, 'f', 3) + " " + levelNames[record.level] + " [" +
+               batchThreads[order[i].second] + "] " + message.toLocal8Bit() + "\n";
+    }
+    //One write per pass instead of one locked write per message.
+    fwrite(out.constData(), 1, out.size(), stderr);
+    fflush(stderr);
+}
@@ -0,0 +1,135 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+//Trace levels, from least to most chatty.
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_INFO 1
+//Once per frame and thread handoff.
+#define TRACE_LEVEL_DEBUG 2
+//Once per subject, blob or label.
+#define TRACE_LEVEL_VERBOSE 3
+
+//Traces above this level are not compiled in at all: their arguments are not even evaluated.
+//Set with DEFINES += TRACE_LEVEL=3 for the per-subject output.
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+/*
+ * Tracing for the per-frame paths, where qDebug()'s formatting and the shared stderr lock
+ * cost more than the work being traced.
+ *
+ *   TRACE_DEBUG("Processing Thread: Restoring cached result of frame %1", currentIndex);
+ *
+ * The format must be a string literal with QString::arg() style placeholders. Arguments are
+ * numbers or string literals, at most TRACE_MAX_ARGS of them. A trace only copies them into
+ * a binary record on a ring owned by the calling thread, without locking or allocating; a
+ * drainer thread formats the records and writes them to stderr. When a ring is full the
+ * record is dropped and counted instead of waiting.
+ *
+ * Nothing is recorded before start() or after stop().
+ */
+
+const int TRACE_MAX_ARGS = 6;
+
+struct TraceArg {
+    enum Type { INT, UINT, REAL, TEXT };
+    Type type;
+    union {
+        qint64 i;
+        quint64 u;
+        double d;
+        const char* s;
+    };
+};
+
+struct TraceRecord {
+    //PipelineMetrics::now() of the call.
+    qint64 time;
+    const char* format;
+    int level;
+    int argCount;
+    TraceArg args[TRACE_MAX_ARGS];
+};
+
+inline TraceArg traceArg(qint64 value) { TraceArg arg; arg.type = TraceArg::INT; arg.i = value; return arg; }
+inline TraceArg traceArg(quint64 value) { TraceArg arg; arg.type = TraceArg::UINT; arg.u = value; return arg; }
+inline TraceArg traceArg(int value) { return traceArg((qint64)value); }
+inline TraceArg traceArg(long value) { return traceArg((qint64)value); }
+inline TraceArg traceArg(unsigned int value) { return traceArg((quint64)value); }
+inline TraceArg traceArg(unsigned long value) { return traceArg((quint64)value); }
+inline TraceArg traceArg(bool value) { return traceArg((qint64)value); }
+inline TraceArg traceArg(double value) { TraceArg arg; arg.type = TraceArg::REAL; arg.d = value; return arg; }
+inline TraceArg traceArg(float value) { return traceArg((double)value); }
+//Only the pointer is kept, so this has to be a string literal.
+inline TraceArg traceArg(const char* value) { TraceArg arg; arg.type = TraceArg::TEXT; arg.s = value; return arg; }
+
+class Trace
+{
+public:
+    //Traces from construction to destruction, for the lifetime of main().
+    class Session {
+    public:
+        Session(int level) { Trace::start(level); }
+        ~Session() { Trace::stop(); }
+    };
+
+    //Starts the drainer and records traces up to level (at most TRACE_LEVEL).
+    static void start(int level);
+    //Stops recording, writes out what was recorded and stops the drainer.
+    static void stop();
+    static void setLevel(int level);
+    static bool enabled(int level) { return level <= runtimeLevel.loadAcquire(); }
+
+    template <typename... Args>
+    static void log(int level, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= TRACE_MAX_ARGS, "Too many trace arguments.");
+        if (! enabled(level))
+            return;
+        TraceRecord record;
+        record.format = format;
+        record.level = level;
+        record.argCount = sizeof...(Args);
+        setArgs(record.args, args...);
+        push(record);
+    }
+
+    //Slots of each thread's ring, one stays empty to tell a full ring from an empty one.
+    static const int RING_CAPACITY = 1 << 11;
+    //How often the drainer empties the rings.
+    static const int DRAIN_INTERVAL_MS = 20;
+private:
+    static QAtomicInt runtimeLevel;
+
+    static void setArgs(TraceArg*) {}
+    template <typename T, typename... Rest>
+    static void setArgs(TraceArg* out, T value, Rest... rest) {
+        *out = traceArg(value);
+        setArgs(out + 1, rest...);
+    }
+    //Timestamps the record and copies it onto the calling thread's ring.
+    static void push(TraceRecord& record);
+};
+
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(...) Trace::log(TRACE_LEVEL_INFO, __VA_ARGS__)
+#else
+#define TRACE_INFO(...) do {} while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(...) Trace::log(TRACE_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define TRACE_DEBUG(...) do {} while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_VERBOSE
+#define TRACE_VERBOSE(...) Trace::log(TRACE_LEVEL_VERBOSE, __VA_ARGS__)
+#else
+#define TRACE_VERBOSE(...) do {} while (0)
+#endif
+
+#endif // TRACE_H
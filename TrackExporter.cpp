@@ -0,0 +1,260 @@
+#include "TrackExporter.h"
+#include <QDebug>
+#include <cstring>
+
+//Rows written before the writer hands freed slots back to the producer.
+static const int RELEASE_BATCH = 1024;
+
+TrackExporter::TrackExporter() :
+    opened(false), stopped(false)
+{
+    queue = new TrackRow[QUEUE_CAPACITY];
+    memset(&stats, 0, sizeof(stats));
+}
+
+TrackExporter::~TrackExporter() {
+    close();
+    delete[] queue;
+}
+
+bool TrackExporter::open(QString filePath, bool append) {
+    close();
+    if (! writer.open(filePath, TrackWriter::formatFor(filePath), append))
+        return false;
+
+    head.storeRelease(0);
+    tail.storeRelease(0);
+    backlog.clear();
+    framesQueued.storeRelease(0);
+    rowsDeferred.storeRelease(0);
+    backlogSize.storeRelease(0);
+    statsMutex.lock();
+    memset(&stats, 0, sizeof(stats));
+    writeError.clear();
+    statsMutex.unlock();
+
+    stopped = false;
+    opened = true;
+    clock.start();
+    start(QThread::LowPriority);
+    return true;
+}
+
+void TrackExporter::close() {
+    if (! opened)
+        return;
+    sleepMutex.lock();
+    stopped = true;
+    dataReady.wakeOne();
+    sleepMutex.unlock();
+    wait();
+
+    //The producer is done, so whatever is left in its backlog is written from here.
+    int rows = 0;
+    for (int i = 0; i < backlog.size(); i++) {
+        if (write(backlog[i]))
+            rows++;
+    }
+    backlog.clear();
+    backlogSize.storeRelease(0);
+    writer.sync();
+
+    statsMutex.lock();
+    stats.rowsWritten += rows;
+    stats.framesWritten = writer.framesWritten();
+    stats.bytesWritten = writer.bytesWritten();
+    stats.syncs++;
+    takeWriterErrors();
+    statsMutex.unlock();
+
+    //Synced above, nothing is left to write.
+    writer.close();
+    opened = false;
+    qDebug() << "Track Exporter: Wrote " << stats.framesWritten << " frames, " << stats.bytesWritten << " bytes.";
+}
+
+bool TrackExporter::isOpen() {
+    return opened;
+}
+
+void TrackExporter::submit(const TrackingSnapshot& snapshot) {
+    if (! opened)
+        return;
+    //Rows deferred earlier go first, so the file stays in frame order.
+    if (! backlog.isEmpty()) {
+        int moved = push(backlog.constData(), backlog.size());
+        backlog.remove(0, moved);
+    }
+
+    TrackRow row;
+    row.frame = snapshot.frameIndex;
+    for (int i = 0; i < snapshot.subjects.size(); i++) {
+        const SubjectPose& pose = snapshot.subjects[i];
+        row.group = pose.groupID;
+        row.subject = pose.subjectID;
+        row.x = pose.pos.x();
+        row.y = pose.pos.y();
+        row.dir = pose.dir;
+        row.left = pose.bound.left();
+        row.top = pose.bound.top();
+        row.width = pose.bound.width();
+        row.height = pose.bound.height();
+        enqueue(row);
+    }
+    TrackRow frameEnd;
+    memset(&frameEnd, 0, sizeof(frameEnd));
+    frameEnd.frame = snapshot.frameIndex;
+    frameEnd.group = FRAME_END;
+    enqueue(frameEnd);
+
+    framesQueued.fetchAndAddRelaxed(1);
+    backlogSize.storeRelease(backlog.size());
+    wake();
+}
+
+void TrackExporter::rewind(int frameIndex) {
+    if (! opened)
+        return;
+    TrackRow row;
+    memset(&row, 0, sizeof(row));
+    row.frame = frameIndex;
+    row.group = REWIND;
+    enqueue(row);
+    backlogSize.storeRelease(backlog.size());
+    wake();
+}
+
+void TrackExporter::wake() {
+    //Only an idle writer needs waking, a busy one finds the rows on its next pass.
+    //Both sides use full barriers, so either the writer sees the rows or this sees it sleeping.
+    if (sleeping.fetchAndAddOrdered(0)) {
+        sleepMutex.lock();
+        dataReady.wakeOne();
+        sleepMutex.unlock();
+    }
+}
+
+void TrackExporter::enqueue(const TrackRow& row) {
+    if (backlog.isEmpty() && push(&row, 1) == 1)
+        return;
+    backlog.append(row);
+    rowsDeferred.fetchAndAddRelaxed(1);
+}
+
+int TrackExporter::push(const TrackRow* rows, int count) {
+    int t = tail.loadAcquire();
+    int h = head.loadAcquire();
+    int free = (h - t - 1 + QUEUE_CAPACITY) % QUEUE_CAPACITY;
+    int n = qMin(count, free);
+    for (int i = 0; i < n; i++)
+        queue[(t + i) % QUEUE_CAPACITY] = rows[i];
+    tail.storeRelease((t + n) % QUEUE_CAPACITY);
+    return n;
+}
+
+int TrackExporter::drain() {
+    int h = head.loadAcquire();
+    int t = tail.loadAcquire();
+    int depth = (t - h + QUEUE_CAPACITY) % QUEUE_CAPACITY;
+    int rows = 0, sinceRelease = 0;
+    while (h != t) {
+        if (write(queue[h]))
+            rows++;
+        h = (h + 1) % QUEUE_CAPACITY;
+        if (++sinceRelease == RELEASE_BATCH) {
+            head.storeRelease(h);
+            sinceRelease = 0;
+        }
+    }
+    head.storeRelease(h);
+
+    if (depth > 0) {
+        statsMutex.lock();
+        stats.rowsWritten += rows;
+        stats.framesWritten = writer.framesWritten();
+        stats.maxQueueDepth = qMax(stats.maxQueueDepth, depth);
+        takeWriterErrors();
+        statsMutex.unlock();
+    }
+    return depth;
+}
+
+void TrackExporter::run() {
+    qDebug() << "Starting Track Exporter...";
+    QElapsedTimer sinceSync;
+    sinceSync.start();
+    bool unsynced = false;
+    while (true) {
+        if (drain() > 0) {
+            unsynced = true;
+        } else {
+            //Idle: sleep until rows arrive or it is time to sync. Rows stay batched in the writer meanwhile.
+            sleepMutex.lock();
+            sleeping.fetchAndStoreOrdered(1);
+            bool done = stopped && head.loadAcquire() == tail.loadAcquire();
+            if (! done && head.loadAcquire() == tail.loadAcquire())
+                dataReady.wait(&sleepMutex, EXPORT_SYNC_INTERVAL);
+            sleeping.storeRelease(0);
+            sleepMutex.unlock();
+            if (done)
+                break;
+        }
+        if (unsynced && sinceSync.elapsed() >= EXPORT_SYNC_INTERVAL) {
+            writer.sync();
+            unsynced = false;
+            sinceSync.restart();
+            statsMutex.lock();
+            stats.bytesWritten = writer.bytesWritten();
+            stats.syncs++;
+            takeWriterErrors();
+            statsMutex.unlock();
+        }
+    }
+    qDebug() << "Stopping Track Exporter...";
+}
+
+bool TrackExporter::write(const TrackRow& row) {
+    if (row.group == FRAME_END) {
+        writer.endFrame(row.frame);
+        return false;
+    }
+    if (row.group == REWIND) {
+        writer.truncateAfter(row.frame);
+        return false;
+    }
+    writer.writeRow(row);
+    return true;
+}
+
+TrackExportStats TrackExporter::getStats() {
+    statsMutex.lock();
+    TrackExportStats current = stats;
+    statsMutex.unlock();
+    current.framesQueued = framesQueued.loadAcquire();
+    current.rowsDeferred = rowsDeferred.loadAcquire();
+    current.backlog = backlogSize.loadAcquire();
+    current.queueDepth = (tail.loadAcquire() - head.loadAcquire() + QUEUE_CAPACITY) % QUEUE_CAPACITY;
+    qint64 elapsed = clock.isValid() ? clock.elapsed() : 0;
+    current.rowsPerSecond = elapsed > 0 ? current.rowsWritten * 1000.0 / elapsed : 0;
+    return current;
+}
+
+void TrackExporter::takeWriterErrors() {
+    stats.writeErrors = writer.errors();
+    if (stats.writeErrors > 0 && writeError.isEmpty())
+        writeError = writer.errorString();
+}
+
+QString TrackExporter::errorString() {
+    statsMutex.lock();
+    QString current = writeError;
+    statsMutex.unlock();
+    return current;
+}
+
+int TrackExporter::framesWritten() {
+    statsMutex.lock();
+    int frames = stats.framesWritten;
+    statsMutex.unlock();
+    return frames;
+}
@@ -0,0 +1,114 @@
+#ifndef TRACKEXPORTER_H
+#define TRACKEXPORTER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+#include "TrackingSnapshot.h"
+#include "TrackWriter.h"
+
+struct TrackExportStats {
+    int framesQueued;
+    int framesWritten;
+    quint64 rowsWritten;
+    qint64 bytesWritten;
+    //Rows that found the queue full and waited in the producer's backlog.
+    quint64 rowsDeferred;
+    int queueDepth;
+    int maxQueueDepth;
+    int backlog;
+    int syncs;
+    //Failed writes, flushes and syncs of the file, see TrackWriter::errors().
+    int writeErrors;
+    double rowsPerSecond;
+};
+
+/*
+ * Streams the poses of every processed frame to a track file (CSV or binary, see
+ * TrackWriter) from a thread of its own. submit() is called by the ProcessingThread at
+ * its publish point and only copies rows into a single-producer/single-consumer ring,
+ * so export never holds up tracking. If the writer falls behind and the ring fills up,
+ * rows wait in a backlog owned by the producer and are queued on the next submit().
+ * The writer batches rows and syncs the file to disk every EXPORT_SYNC_INTERVAL ms.
+ */
+class TrackExporter : public QThread
+{
+    Q_OBJECT
+public:
+    TrackExporter();
+    ~TrackExporter();
+
+    //Opens the file (format by suffix) and starts the writer thread. With append, the rows
+    //of an existing file are kept, see TrackWriter::open().
+    bool open(QString filePath, bool append = false);
+    //Writes everything submitted so far, stops the writer thread and closes the file.
+    //The producer must not submit concurrently.
+    void close();
+    bool isOpen();
+
+    //Producer side, called from the ProcessingThread. Never blocks on the writer.
+    void submit(const TrackingSnapshot& snapshot);
+    //Drops the rows of frames after frameIndex, before they are submitted again after an edit.
+    //Producer side, ordered with submit().
+    void rewind(int frameIndex);
+
+    TrackExportStats getStats();
+    int framesWritten();
+    //The first write failure since open(), empty if there was none.
+    QString errorString();
+
+    //Rows in the ring, one slot stays empty to tell a full ring from an empty one.
+    static const int QUEUE_CAPACITY = 1 << 15;
+    static const int EXPORT_SYNC_INTERVAL = 1000;
+    static const int FRAME_END = -1;
+    static const int REWIND = -2;
+protected:
+    void run();
+private:
+    TrackWriter writer;
+    volatile bool opened;
+    volatile bool stopped;
+
+    //Ring of QUEUE_CAPACITY rows. A row with group FRAME_END closes a frame, one with
+    //group REWIND cuts the file back after its frame.
+    TrackRow* queue;
+    //Next slot to read, owned by the writer thread.
+    QAtomicInt head;
+    //Next slot to write, owned by the producer.
+    QAtomicInt tail;
+    //Rows that did not fit into the ring, owned by the producer.
+    QVector<TrackRow> backlog;
+
+    //The writer sleeps on dataReady when the ring is empty.
+    QMutex sleepMutex;
+    QWaitCondition dataReady;
+    QAtomicInt sleeping;
+
+    //Producer counters.
+    QAtomicInt framesQueued;
+    QAtomicInt rowsDeferred;
+    QAtomicInt backlogSize;
+    //Writer counters, guarded by statsMutex.
+    QMutex statsMutex;
+    TrackExportStats stats;
+    QString writeError;
+    QElapsedTimer clock;
+
+    //Moves rows into the ring until it is full, returns how many were moved.
+    int push(const TrackRow* rows, int count);
+    //Queues a row behind any backlog.
+    void enqueue(const TrackRow& row);
+    //Wakes the writer if it is idle.
+    void wake();
+    //Hands a row of the ring to the writer, returns true if it holds a pose.
+    bool write(const TrackRow& row);
+    //Writes everything in the ring, returns the number of slots it took (rows and frame ends).
+    int drain();
+    //Copies the writer's failures into the stats. Caller holds statsMutex.
+    void takeWriterErrors();
+};
+
+#endif // TRACKEXPORTER_H
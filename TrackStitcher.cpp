@@ -0,0 +1,200 @@
+#include "TrackStitcher.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+typedef QPair<int, int> SubjectKey;
+
+//A possible match between a subject of the previous shard and one of the current shard.
+struct StitchCandidate {
+    float cost;
+    SubjectKey previous;
+    SubjectKey current;
+};
+
+static bool cheapestFirst(const StitchCandidate& a, const StitchCandidate& b) {
+    if (a.cost != b.cost)
+        return a.cost < b.cost;
+    if (a.previous != b.previous)
+        return a.previous < b.previous;
+    return a.current < b.current;
+}
+
+//Indexes the rows of a shard by subject and then by frame.
+static QMap<SubjectKey, QMap<int, TrackRow> > bySubject(QList<TrackRow>& rows) {
+    QMap<SubjectKey, QMap<int, TrackRow> > tracks;
+    for (int i = 0; i < rows.size(); i++)
+        tracks[SubjectKey(rows[i].group, rows[i].subject)][rows[i].frame] = rows[i];
+    return tracks;
+}
+
+TrackStitcher::TrackStitcher()
+{
+}
+
+void TrackStitcher::addShard(QString path, int ownedFrom) {
+    TrackShard shard;
+    shard.path = path;
+    shard.ownedFrom = ownedFrom;
+    shards.append(shard);
+}
+
+//Reads the rows with fromFrame <= frame < toFrame.
+bool TrackStitcher::readRows(QString path, int fromFrame, int toFrame, QList<TrackRow>& rows) {
+    QFile file(path);
+    if (! file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "Could not open " + path;
+        return false;
+    }
+    QTextStream in(&file);
+    in.readLine(); //Header.
+    while (! in.atEnd()) {
+        QStringList fields = in.readLine().split(',');
+        if (fields.size() != 10)
+            continue;
+        TrackRow row;
+        row.frame = fields[0].toInt();
+        if (row.frame < fromFrame || row.frame >= toFrame)
+            continue;
+        row.group = fields[1].toInt();
+        row.subject = fields[2].toInt();
+        row.x = fields[3].toFloat();
+        row.y = fields[4].toFloat();
+        row.dir = fields[5].toFloat();
+        row.left = fields[6].toFloat();
+        row.top = fields[7].toFloat();
+        row.width = fields[8].toFloat();
+        row.height = fields[9].toFloat();
+        rows.append(row);
+    }
+    return true;
+}
+
+//Copies the rows with fromFrame <= frame < toFrame, renaming subjects through ids.
+//Subjects missing from ids either keep their ID (keepIDs) or are given the next free one.
+bool TrackStitcher::copyRows(QString path, int fromFrame, int toFrame, bool keepIDs, IDMap& ids,
+                             QMap<int, int>& nextID, QTextStream& out) {
+    QFile file(path);
+    if (! file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "Could not open " + path;
+        return false;
+    }
+    QTextStream in(&file);
+    in.readLine(); //Header.
+    while (! in.atEnd()) {
+        QString line = in.readLine();
+        QStringList fields = line.split(',');
+        if (fields.size() != 10)
+            continue;
+        int frame = fields[0].toInt();
+        if (frame < fromFrame || frame >= toFrame)
+            continue;
+        SubjectKey key(fields[1].toInt(), fields[2].toInt());
+        if (! ids.contains(key)) {
+            ids[key] = keepIDs ? key.second : nextID[key.first]++;
+            nextID[key.first] = qMax(nextID[key.first], ids[key] + 1);
+        }
+        fields[2] = QString::number(ids[key]);
+        out << fields.join(",") << '\n';
+    }
+    return true;
+}
+
+TrackStitcher::IDMap TrackStitcher::matchSubjects(QList<TrackRow>& previous, IDMap& previousIDs,
+                                                  QList<TrackRow>& current, QMap<int, int>& nextID) {
+    QMap<SubjectKey, QMap<int, TrackRow> > previousTracks = bySubject(previous);
+    QMap<SubjectKey, QMap<int, TrackRow> > currentTracks = bySubject(current);
+    QMap<SubjectKey, QMap<int, TrackRow> >::iterator it1, it2;
+    QMap<int, TrackRow>::iterator it3;
+
+    QList<StitchCandidate> candidates;
+    for (it1 = currentTracks.begin(); it1 != currentTracks.end(); it1++) {
+        for (it2 = previousTracks.begin(); it2 != previousTracks.end(); it2++) {
+            //Different groups have different colors, so they can never be the same subject.
+            if (it1.key().first != it2.key().first || ! previousIDs.contains(it2.key()))
+                continue;
+            float distance = 0, sizeDifference = 0, diagonal = 0;
+            int common = 0;
+            for (it3 = it1.value().begin(); it3 != it1.value().end(); it3++) {
+                if (! it2.value().contains(it3.key()))
+                    continue;
+                TrackRow& a = it3.value();
+                TrackRow& b = it2.value()[it3.key()];
+                distance += sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2));
+                sizeDifference += fabs(sqrt(a.width * a.height) - sqrt(b.width * b.height));
+                diagonal += sqrt(b.width * b.width + b.height * b.height);
+                common++;
+            }
+            //Both trackers have to agree on the position for most of the overlap.
+            if (common == 0 || common * 2 < it1.value().size())
+                continue;
+            distance /= common;
+            if (distance > diagonal / common)
+                continue;
+            StitchCandidate candidate;
+            candidate.cost = distance + sizeDifference / common;
+            candidate.previous = it2.key();
+            candidate.current = it1.key();
+            candidates.append(candidate);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), cheapestFirst);
+
+    IDMap ids;
+    QMap<SubjectKey, bool> taken;
+    for (int i = 0; i < candidates.size(); i++) {
+        if (ids.contains(candidates[i].current) || taken.contains(candidates[i].previous))
+            continue;
+        ids[candidates[i].current] = previousIDs[candidates[i].previous];
+        taken[candidates[i].previous] = true;
+    }
+    //Subjects seen only by the current shard start new tracks.
+    for (it1 = currentTracks.begin(); it1 != currentTracks.end(); it1++) {
+        if (! ids.contains(it1.key()))
+            ids[it1.key()] = nextID[it1.key().first]++;
+    }
+    qDebug() << "Track Stitcher: Matched " << taken.size() << " of " << currentTracks.size() << " subjects.";
+    return ids;
+}
+
+bool TrackStitcher::stitch(QString outputPath) {
+    QFile file(outputPath);
+    if (! file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        error = "Could not open " + outputPath + " for writing.";
+        return false;
+    }
+    QTextStream out(&file);
+    out << "frame,group,subject,x,y,direction,left,top,width,height\n";
+
+    QMap<int, int> nextID;
+    IDMap previousIDs;
+    for (int k = 0; k < shards.size(); k++) {
+        int ownedTo = k + 1 < shards.size() ? shards[k + 1].ownedFrom : std::numeric_limits<int>::max();
+        IDMap ids;
+        if (k > 0) {
+            //Only the overlap window is held in memory, everything else is streamed.
+            QList<TrackRow> overlap, previous;
+            if (! readRows(shards[k].path, 0, shards[k].ownedFrom, overlap))
+                return false;
+            int overlapStart = shards[k].ownedFrom;
+            for (int i = 0; i < overlap.size(); i++)
+                overlapStart = qMin(overlapStart, overlap[i].frame);
+            if (! readRows(shards[k - 1].path, overlapStart, shards[k].ownedFrom, previous))
+                return false;
+            ids = matchSubjects(previous, previousIDs, overlap, nextID);
+        }
+        //The first shard was seeded from the session file and keeps its IDs.
+        if (! copyRows(shards[k].path, k == 0 ? 0 : shards[k].ownedFrom, ownedTo, k == 0, ids, nextID, out))
+            return false;
+        previousIDs = ids;
+    }
+    return true;
+}
+
+QString TrackStitcher::errorString() {
+    return error;
+}
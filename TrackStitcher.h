@@ -0,0 +1,46 @@
+#ifndef TRACKSTITCHER_H
+#define TRACKSTITCHER_H
+
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QTextStream>
+#include "TrackWriter.h"
+
+//A shard's track file. Frames before ownedFrom are the overlap with the previous shard.
+struct TrackShard {
+    QString path;
+    int ownedFrom;
+};
+
+/*
+ * Merges the track files of consecutive, overlapping frame ranges into one file.
+ * Subjects of a shard are matched to those of the previous shard over the overlap
+ * window: only subjects of the same group (i.e. the same color cluster) are candidates,
+ * and the pair with the smallest mean distance between positions is matched first.
+ * Matched subjects keep the ID of the previous shard, the others get fresh IDs.
+ */
+class TrackStitcher
+{
+public:
+    TrackStitcher();
+
+    //Shards must be added in frame order.
+    void addShard(QString path, int ownedFrom);
+    bool stitch(QString outputPath);
+    QString errorString();
+private:
+    //(group, subject) of a shard mapped to (group, subject) in the merged output.
+    typedef QMap<QPair<int, int>, int> IDMap;
+
+    QList<TrackShard> shards;
+    QString error;
+
+    bool readRows(QString path, int fromFrame, int toFrame, QList<TrackRow>& rows);
+    bool copyRows(QString path, int fromFrame, int toFrame, bool keepIDs, IDMap& ids,
+                  QMap<int, int>& nextID, QTextStream& out);
+    IDMap matchSubjects(QList<TrackRow>& previous, IDMap& previousIDs, QList<TrackRow>& current, QMap<int, int>& nextID);
+};
+
+#endif // TRACKSTITCHER_H
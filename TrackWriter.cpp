@@ -0,0 +1,230 @@
+#include "TrackWriter.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QtEndian>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//Rows are collected up to this size before they are written.
+static const int BATCH_BYTES = 64 * 1024;
+static const char CSV_HEADER[] = "frame,group,subject,x,y,direction,left,top,width,height\n";
+
+//Orders frame starts by frame number.
+static bool startsBefore(const QPair<int, qint64>& start, int frame) {
+    return start.first < frame;
+}
+
+TrackWriter::TrackWriter() : format(CSV), frameCount(0), inFrame(false), errorCount(0)
+{
+}
+
+TrackWriter::~TrackWriter() {
+    close();
+}
+
+bool TrackWriter::open(QString filePath, Format format, bool append) {
+    close();
+    this->format = format;
+    file.setFileName(filePath);
+    frameCount = 0;
+    inFrame = false;
+    frameStarts.clear();
+    errorCount = 0;
+    error.clear();
+    bool existing = append && file.exists() && file.size() > 0;
+    //Not in text mode: file offsets of frames are counted in buffered bytes, so lines end in "\n" everywhere.
+    if (! file.open(existing ? QIODevice::ReadWrite : QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Track Writer: Could not open " << filePath;
+        return false;
+    }
+    buffer.reserve(BATCH_BYTES + 256);
+    if (existing) {
+        if (! scanFrames()) {
+            qWarning() << "Track Writer: " << filePath << " is not a track file of this format.";
+            file.close();
+            return false;
+        }
+        qDebug() << "Track Writer: Appending to " << filePath << " after " << frameCount << " frames.";
+        return true;
+    }
+    if (format == CSV) {
+        buffer.append(CSV_HEADER);
+    } else {
+        char header[8] = { 'P', 'T', 'R', 'K' };
+        qToLittleEndian<quint32>(BINARY_VERSION, (uchar*)header + 4);
+        buffer.append(header, sizeof(header));
+    }
+    return true;
+}
+
+bool TrackWriter::scanFrames() {
+    qint64 end;
+    if (format == CSV) {
+        if (file.readLine() != CSV_HEADER)
+            return false;
+        end = file.pos();
+        while (! file.atEnd()) {
+            qint64 start = file.pos();
+            QByteArray line = file.readLine();
+            if (! line.endsWith('\n'))
+                break;
+            int frame = line.left(line.indexOf(',')).toInt();
+            if (frameStarts.isEmpty() || frameStarts.last().first != frame)
+                frameStarts.append(qMakePair(frame, start));
+            end = file.pos();
+        }
+    } else {
+        uchar header[8];
+        if (file.read((char*)header, sizeof(header)) != sizeof(header) || memcmp(header, "PTRK", 4) != 0 ||
+                qFromLittleEndian<quint32>(header + 4) != BINARY_VERSION)
+            return false;
+        end = sizeof(header);
+        uchar record[40];
+        while (file.read((char*)record, sizeof(record)) == sizeof(record)) {
+            int frame = qFromLittleEndian<qint32>(record);
+            if (frameStarts.isEmpty() || frameStarts.last().first != frame)
+                frameStarts.append(qMakePair(frame, end));
+            end += sizeof(record);
+        }
+    }
+    //Frames without rows leave nothing in the file, so only those with rows are counted.
+    frameCount = frameStarts.size();
+    if ((end < file.size() && ! file.resize(end)) || ! file.seek(end))
+        fail("append to " + file.fileName() + ": " + file.errorString());
+    return true;
+}
+
+void TrackWriter::close() {
+    if (file.isOpen()) {
+        flush();
+        file.close();
+    }
+}
+
+bool TrackWriter::isOpen() {
+    return file.isOpen();
+}
+
+TrackWriter::Format TrackWriter::formatFor(QString filePath) {
+    return QFileInfo(filePath).suffix().toLower() == "trk" ? BINARY : CSV;
+}
+
+void TrackWriter::writeRow(const TrackRow& row) {
+    if (! file.isOpen())
+        return;
+    if (! inFrame)
+        beginFrame(row.frame);
+    if (format == CSV) {
+        //Same notation as QTextStream's default: %g with 6 significant digits.
+        buffer.append(QByteArray::number(row.frame)).append(',')
+              .append(QByteArray::number(row.group)).append(',')
+              .append(QByteArray::number(row.subject)).append(',');
+        const float values[7] = { row.x, row.y, row.dir, row.left, row.top, row.width, row.height };
+        for (int i = 0; i < 7; i++) {
+            buffer.append(QByteArray::number(values[i], 'g', 6));
+            buffer.append(i < 6 ? ',' : '\n');
+        }
+        if (buffer.size() >= BATCH_BYTES)
+            flush();
+        return;
+    }
+    uchar record[40];
+    qToLittleEndian<qint32>(row.frame, record);
+    qToLittleEndian<qint32>(row.group, record + 4);
+    qToLittleEndian<qint32>(row.subject, record + 8);
+    const float values[7] = { row.x, row.y, row.dir, row.left, row.top, row.width, row.height };
+    for (int i = 0; i < 7; i++) {
+        quint32 bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        qToLittleEndian<quint32>(bits, record + 12 + 4*i);
+    }
+    buffer.append((const char*)record, sizeof(record));
+    if (buffer.size() >= BATCH_BYTES)
+        flush();
+}
+
+void TrackWriter::endFrame(int frame) {
+    if (! file.isOpen())
+        return;
+    if (! inFrame)
+        beginFrame(frame);
+    inFrame = false;
+    frameCount++;
+}
+
+void TrackWriter::beginFrame(int frame) {
+    inFrame = true;
+    frameStarts.append(qMakePair(frame, file.pos() + buffer.size()));
+}
+
+void TrackWriter::truncateAfter(int frame) {
+    if (! file.isOpen() || frameStarts.isEmpty() || frameStarts.last().first <= frame)
+        return;
+    //Tracked again: the rows of every later frame are stale.
+    QVector<QPair<int, qint64> >::iterator it = std::lower_bound(frameStarts.begin(), frameStarts.end(),
+                                                                 frame + 1, startsBefore);
+    qint64 offset = it->second;
+    int dropped = frameStarts.end() - it;
+    frameStarts.erase(it, frameStarts.end());
+    frameCount -= dropped;
+    flush();
+    if (! file.resize(offset) || ! file.seek(offset))
+        fail("rewind " + file.fileName() + ": " + file.errorString());
+    qDebug() << "Track Writer: Rewound to frame " << frame << ", dropped " << dropped << " frames.";
+}
+
+void TrackWriter::flush() {
+    if (! file.isOpen())
+        return;
+    if (! buffer.isEmpty()) {
+        if (file.write(buffer) != buffer.size())
+            fail("write " + file.fileName() + ": " + file.errorString());
+        //Keeps the reserved capacity, unlike clear().
+        buffer.resize(0);
+    }
+    if (! file.flush())
+        fail("flush " + file.fileName() + ": " + file.errorString());
+}
+
+void TrackWriter::sync() {
+    flush();
+    if (! file.isOpen())
+        return;
+#ifdef Q_OS_WIN
+    int result = _commit(file.handle());
+#else
+    int result = fsync(file.handle());
+#endif
+    if (result != 0)
+        fail("sync " + file.fileName() + ": " + strerror(errno));
+}
+
+void TrackWriter::fail(QString what) {
+    //Only the first failure is logged, a full disk fails every write after it.
+    if (errorCount++ == 0) {
+        error = "Could not " + what;
+        qWarning() << "Track Writer: " << error;
+    }
+}
+
+int TrackWriter::errors() {
+    return errorCount;
+}
+
+QString TrackWriter::errorString() {
+    return error;
+}
+
+int TrackWriter::framesWritten() {
+    return frameCount;
+}
+
+qint64 TrackWriter::bytesWritten() {
+    return file.isOpen() ? file.pos() : 0;
+}
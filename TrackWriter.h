@@ -0,0 +1,88 @@
+#ifndef TRACKWRITER_H
+#define TRACKWRITER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QPair>
+#include <QVector>
+
+//Pose of one subject on one frame, as stored in a track file.
+struct TrackRow {
+    int frame;
+    int group;
+    int subject;
+    float x, y, dir;
+    float left, top, width, height;
+};
+
+/*
+ * Writes the pose of every tracked subject to a file, one row per subject per frame.
+ * CSV columns: frame,group,subject,x,y,direction,left,top,width,height
+ * The binary format starts with the magic "PTRK" and a 32 bit version, followed by one
+ * 40 byte record per row: frame, group and subject as 32 bit integers, then x, y,
+ * direction, left, top, width and height as 32 bit floats, all little endian.
+ * Rows are buffered and written in batches. Not thread safe, see TrackExporter.
+ *
+ * Frames are expected in increasing order. Before a frame is written again (e.g. after an
+ * edit), truncateAfter() cuts the file back, so every frame holds the rows of its latest
+ * tracking only.
+ */
+class TrackWriter
+{
+public:
+    enum Format {
+        CSV = 0,
+        BINARY = 1
+    };
+
+    TrackWriter();
+    ~TrackWriter();
+
+    //With append, an existing file of the format is written on after its last complete row.
+    bool open(QString filePath, Format format = CSV, bool append = false);
+    void close();
+    bool isOpen();
+    //BINARY for ".trk" files, CSV otherwise.
+    static Format formatFor(QString filePath);
+
+    void writeRow(const TrackRow& row);
+    //Marks the end of the frame's rows. A frame without rows only calls this.
+    void endFrame(int frame);
+    //Drops the rows of every frame after frame from the file.
+    void truncateAfter(int frame);
+    //Hands the buffered rows to the OS.
+    void flush();
+    //Flushes and waits until the OS has written the file to disk.
+    void sync();
+
+    //Number of frames in the file.
+    int framesWritten();
+    //Bytes handed to the OS since open().
+    qint64 bytesWritten();
+    //Failed writes, flushes and syncs since open(). Rows of a failed write are lost.
+    int errors();
+    //The first failure since open(), empty if there was none.
+    QString errorString();
+
+    static const quint32 BINARY_VERSION = 1;
+private:
+    QFile file;
+    Format format;
+    QByteArray buffer;
+    int frameCount;
+    //True between the first row of a frame and its endFrame().
+    bool inFrame;
+    //Frame number and file offset of every frame's first row, in file order.
+    QVector<QPair<int, qint64> > frameStarts;
+    int errorCount;
+    QString error;
+
+    //Remembers where a frame begins.
+    void beginFrame(int frame);
+    //Finds the frames of an existing file, drops a row left incomplete and moves to its end.
+    //False if the file does not start with the header of the format.
+    bool scanFrames();
+    void fail(QString what);
+};
+
+#endif // TRACKWRITER_H
@@ -0,0 +1,166 @@
+#include "TrackerCheckpoint.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+//Fixed so files stay readable whatever Qt version writes them.
+static const int STREAM_VERSION = QDataStream::Qt_4_8;
+
+static QDataStream& operator<<(QDataStream& out, const Point3_<uchar>& color) {
+    return out << (quint8)color.x << (quint8)color.y << (quint8)color.z;
+}
+
+static QDataStream& operator>>(QDataStream& in, Point3_<uchar>& color) {
+    quint8 x, y, z;
+    in >> x >> y >> z;
+    color = Point3_<uchar>(x, y, z);
+    return in;
+}
+
+static void writeColors(QDataStream& out, const std::set<std::string>& colors) {
+    out << (quint32)colors.size();
+    std::set<std::string>::const_iterator it;
+    for (it = colors.begin(); it != colors.end(); it++)
+        out << QByteArray(it->data(), it->size());
+}
+
+static void readColors(QDataStream& in, std::set<std::string>& colors) {
+    quint32 count;
+    in >> count;
+    colors.clear();
+    QByteArray color;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        in >> color;
+        colors.insert(std::string(color.constData(), color.size()));
+    }
+}
+
+bool TrackerCheckpoint::write(QString filePath, const TrackerState& state, QString* error) {
+    QSaveFile file(filePath);
+    if (! file.open(QIODevice::WriteOnly)) {
+        if (error) *error = "Could not open " + filePath + " for writing.";
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(STREAM_VERSION);
+    out << MAGIC << VERSION;
+    out << state.videoPath << (qint32)state.frameIndex;
+
+    out << (quint32)state.groups.size();
+    for (int i = 0; i < state.groups.size(); i++)
+        out << (qint32)state.groups[i].ID << state.groups[i].color;
+
+    out << (quint32)state.subjects.size();
+    for (int i = 0; i < state.subjects.size(); i++) {
+        const CheckpointSubject& subject = state.subjects[i];
+        out << (qint32)subject.groupID << (qint32)subject.subjectID << (qint32)subject.startingFrameIndex
+            << subject.pos << subject.dir << subject.bound;
+        writeColors(out, subject.colors);
+    }
+
+    out << (quint32)state.foreground.size();
+    IntClusterMap::const_iterator it1;
+    for (it1 = state.foreground.begin(); it1 != state.foreground.end(); it1++) {
+        out << (qint32)it1->first;
+        writeColors(out, it1->second);
+    }
+
+    Mat palette = state.backgroundPalette.isContinuous() ? state.backgroundPalette : state.backgroundPalette.clone();
+    out << (quint32)palette.cols;
+    out.writeRawData((const char*)palette.data, palette.cols * 3);
+
+    out << (quint32)state.referenceAreas.size();
+    std::map<int, float>::const_iterator it2;
+    for (it2 = state.referenceAreas.begin(); it2 != state.referenceAreas.end(); it2++)
+        out << (qint32)it2->first << it2->second;
+
+    if (out.status() != QDataStream::Ok || ! file.commit()) {
+        if (error) *error = "Could not write " + filePath;
+        return false;
+    }
+    return true;
+}
+
+bool TrackerCheckpoint::read(QString filePath, TrackerState& state, QString* error) {
+    QFile file(filePath);
+    if (! file.open(QIODevice::ReadOnly)) {
+        if (error) *error = "Could not open " + filePath;
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(STREAM_VERSION);
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != MAGIC) {
+        if (error) *error = filePath + " is not a checkpoint.";
+        return false;
+    }
+    if (version != VERSION) {
+        if (error) *error = QString("%1 has checkpoint version %2, expected %3.").arg(filePath).arg(version).arg(VERSION);
+        return false;
+    }
+
+    state = TrackerState();
+    qint32 frameIndex;
+    in >> state.videoPath >> frameIndex;
+    state.frameIndex = frameIndex;
+
+    quint32 count;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        CheckpointGroup group;
+        qint32 ID;
+        in >> ID >> group.color;
+        group.ID = ID;
+        state.groups.append(group);
+    }
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        CheckpointSubject subject;
+        qint32 groupID, subjectID, startingFrameIndex;
+        in >> groupID >> subjectID >> startingFrameIndex >> subject.pos >> subject.dir >> subject.bound;
+        subject.groupID = groupID;
+        subject.subjectID = subjectID;
+        subject.startingFrameIndex = startingFrameIndex;
+        readColors(in, subject.colors);
+        state.subjects.append(subject);
+    }
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        qint32 groupID;
+        in >> groupID;
+        readColors(in, state.foreground[groupID]);
+    }
+
+    in >> count;
+    //Same bound as the palettes in the VideoCache, it also keeps count * 3 within an int.
+    if (count >= (1 << 16))
+        in.setStatus(QDataStream::ReadCorruptData);
+    if (count > 0 && in.status() == QDataStream::Ok) {
+        state.backgroundPalette.create(1, count, CV_8UC3);
+        if (in.readRawData((char*)state.backgroundPalette.data, count * 3) != (int)count * 3)
+            in.setStatus(QDataStream::ReadPastEnd);
+    }
+
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        qint32 groupID;
+        float area;
+        in >> groupID >> area;
+        state.referenceAreas[groupID] = area;
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        if (error) *error = filePath + " is truncated or corrupt.";
+        return false;
+    }
+    return true;
+}
+
+QString TrackerCheckpoint::pathFor(QString filePath) {
+    QFileInfo info(filePath);
+    return info.dir().filePath(info.completeBaseName() + ".ptck");
+}
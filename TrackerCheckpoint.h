@@ -0,0 +1,64 @@
+#ifndef TRACKERCHECKPOINT_H
+#define TRACKERCHECKPOINT_H
+
+#include <QList>
+#include <QPointF>
+#include <QRectF>
+#include <QString>
+#include <map>
+#include <set>
+#include <string>
+#include "opencv/highgui.h"
+#include "Structures.h"
+
+using namespace cv;
+
+struct CheckpointGroup {
+    int ID;
+    //Lab color of the group.
+    Point3_<uchar> color;
+};
+
+struct CheckpointSubject {
+    int groupID;
+    int subjectID;
+    int startingFrameIndex;
+    QPointF pos;
+    float dir;
+    QRectF bound;
+    std::set<std::string> colors;
+};
+
+//Everything the ProcessingThread needs to carry on tracking after the frame it was taken on.
+struct TrackerState {
+    QString videoPath;
+    int frameIndex;
+    QList<CheckpointGroup> groups;
+    //Ordered by group, then ID.
+    QList<CheckpointSubject> subjects;
+    IntClusterMap foreground;
+    //1xN CV_8UC3, empty if not computed yet.
+    Mat backgroundPalette;
+    std::map<int, float> referenceAreas;
+
+    TrackerState() : frameIndex(-1) {}
+};
+
+/*
+ * Binary checkpoint file of a TrackerState, written with QDataStream:
+ * the magic "PTCK", a format version, then the state. Files are written to a temporary
+ * file and renamed over the target, so a crash while saving leaves the previous checkpoint.
+ */
+class TrackerCheckpoint
+{
+public:
+    static const quint32 MAGIC = 0x5054434B;
+    static const quint32 VERSION = 1;
+
+    static bool write(QString filePath, const TrackerState& state, QString* error = NULL);
+    static bool read(QString filePath, TrackerState& state, QString* error = NULL);
+    //Where the checkpoints of a video (or of a track file) go, e.g. "run.avi" -> "run.ptck".
+    static QString pathFor(QString filePath);
+};
+
+#endif // TRACKERCHECKPOINT_H
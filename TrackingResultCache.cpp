@@ -0,0 +1,66 @@
+#include "TrackingResultCache.h"
+
+TrackingResultCache::TrackingResultCache(qint64 maxBytes) :
+    maxBytes(maxBytes), usedBytes(0)
+{
+}
+
+//Approximate heap footprint of a result. The foreground colors are shared and not counted.
+qint64 TrackingResultCache::cost(const TrackingResult& result) {
+    return sizeof(TrackingResult) + result.subjects.size() * sizeof(SubjectPose);
+}
+
+void TrackingResultCache::store(int frameIndex, const TrackingSnapshot& snapshot, QSharedPointer<const IntClusterMap> foreground) {
+    QMap<int, TrackingResult>::iterator it = results.find(frameIndex);
+    if (it != results.end())
+        erase(it);
+
+    TrackingResult result;
+    result.subjects = snapshot.subjects;
+    result.foreground = foreground;
+    qint64 resultCost = cost(result);
+    if (resultCost > maxBytes)
+        return;
+
+    //Frames far from the one being tracked are the least likely to be revisited soon.
+    while (usedBytes + resultCost > maxBytes && ! results.isEmpty()) {
+        QMap<int, TrackingResult>::iterator first = results.begin();
+        QMap<int, TrackingResult>::iterator last = results.end() - 1;
+        if (frameIndex - first.key() >= last.key() - frameIndex)
+            erase(first);
+        else erase(last);
+    }
+    results.insert(frameIndex, result);
+    usedBytes += resultCost;
+}
+
+const TrackingResult* TrackingResultCache::find(int frameIndex) const {
+    QMap<int, TrackingResult>::const_iterator it = results.constFind(frameIndex);
+    return it == results.constEnd() ? NULL : &it.value();
+}
+
+void TrackingResultCache::invalidateAfter(int frameIndex) {
+    QMap<int, TrackingResult>::iterator it = results.upperBound(frameIndex);
+    while (it != results.end()) {
+        usedBytes -= cost(it.value());
+        it = results.erase(it);
+    }
+}
+
+void TrackingResultCache::clear() {
+    results.clear();
+    usedBytes = 0;
+}
+
+int TrackingResultCache::size() const {
+    return results.size();
+}
+
+qint64 TrackingResultCache::bytes() const {
+    return usedBytes;
+}
+
+void TrackingResultCache::erase(QMap<int, TrackingResult>::iterator it) {
+    usedBytes -= cost(it.value());
+    results.erase(it);
+}
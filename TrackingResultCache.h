@@ -0,0 +1,49 @@
+#ifndef TRACKINGRESULTCACHE_H
+#define TRACKINGRESULTCACHE_H
+
+#include <QMap>
+#include <QSharedPointer>
+#include <QVector>
+#include "Structures.h"
+#include "TrackingSnapshot.h"
+
+//Tracking state left behind by one frame.
+struct TrackingResult {
+    //Same layout as in the TrackingSnapshot the frame was published with. Trails are not
+    //kept, they are read from the subjects' trajectories again.
+    QVector<SubjectPose> subjects;
+    //Learned foreground colors, shared between frames as long as they do not change.
+    QSharedPointer<const IntClusterMap> foreground;
+};
+
+/*
+ * Results of frames the ProcessingThread already tracked, by frame index, so stepping
+ * back shows a frame as it was tracked instead of tracking it again out of order, and
+ * tracking resumes from the state that frame left behind.
+ * Bounded by maxBytes; when full, the entries farthest from the frame being stored go first.
+ * Not thread safe, the ProcessingThread guards it with its groups mutex.
+ */
+class TrackingResultCache
+{
+public:
+    TrackingResultCache(qint64 maxBytes = TRACKING_CACHE_BYTES);
+
+    void store(int frameIndex, const TrackingSnapshot& snapshot, QSharedPointer<const IntClusterMap> foreground);
+    //NULL if the frame is not cached. Valid until the cache is changed.
+    const TrackingResult* find(int frameIndex) const;
+    //Drops the results of every frame after frameIndex, they were derived from state that changed since.
+    void invalidateAfter(int frameIndex);
+    void clear();
+
+    int size() const;
+    qint64 bytes() const;
+private:
+    QMap<int, TrackingResult> results;
+    qint64 maxBytes;
+    qint64 usedBytes;
+
+    static qint64 cost(const TrackingResult& result);
+    void erase(QMap<int, TrackingResult>::iterator it);
+};
+
+#endif // TRACKINGRESULTCACHE_H
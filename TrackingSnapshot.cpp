@@ -0,0 +1,73 @@
+#include "TrackingSnapshot.h"
+#include <QThread>
+#include <climits>
+
+//QAtomicInt starts at 0, so every slot starts out free.
+SnapshotStore::SnapshotStore() : current(NULL), epoch(1), nextVersion(0)
+{
+}
+
+SnapshotStore::~SnapshotStore() {
+    //No readers are left by the time the owner is destroyed.
+    delete current.loadAcquire();
+    for (int i = 0; i < retired.size(); i++)
+        delete retired[i].second;
+}
+
+void SnapshotStore::publish(TrackingSnapshot* snapshot) {
+    writeMutex.lock();
+    if (snapshot)
+        snapshot->version = ++nextVersion;
+
+    TrackingSnapshot* old = current.fetchAndStoreOrdered(snapshot);
+    if (old)
+        retired.append(qMakePair(epoch.loadAcquire(), old));
+    epoch.fetchAndAddOrdered(1);
+
+    reclaim();
+    writeMutex.unlock();
+}
+
+void SnapshotStore::reclaim() {
+    //Oldest epoch any active reader entered at.
+    int oldest = INT_MAX;
+    for (int i = 0; i < READER_SLOTS; i++) {
+        int entered = slots[i].loadAcquire();
+        if (entered != 0 && entered < oldest)
+            oldest = entered;
+    }
+
+    //A reader that entered after a snapshot's retirement epoch can only have seen its successor.
+    for (int i = 0; i < retired.size();) {
+        if (retired[i].first < oldest) {
+            delete retired[i].second;
+            retired.removeAt(i);
+        } else i++;
+    }
+}
+
+int SnapshotStore::enter() {
+    while (1) {
+        int now = epoch.loadAcquire();
+        for (int i = 0; i < READER_SLOTS; i++) {
+            if (slots[i].testAndSetOrdered(0, now))
+                return i;
+        }
+        //Every slot is taken, which only happens with more readers than slots.
+        QThread::yieldCurrentThread();
+    }
+}
+
+void SnapshotStore::leave(int slot) {
+    slots[slot].storeRelease(0);
+}
+
+SnapshotReader::SnapshotReader(SnapshotStore* store) : store(store)
+{
+    slot = store->enter();
+    snapshot = store->current.loadAcquire();
+}
+
+SnapshotReader::~SnapshotReader() {
+    store->leave(slot);
+}
@@ -0,0 +1,102 @@
+#ifndef TRACKINGSNAPSHOT_H
+#define TRACKINGSNAPSHOT_H
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include "opencv/highgui.h"
+
+using namespace cv;
+
+//Pose of one subject at the time a snapshot was taken.
+struct SubjectPose {
+    int groupID;
+    int subjectID;
+    QPointF pos;
+    float dir;
+    QRectF bound;
+    //Range of the subject's recent positions in TrackingSnapshot::trails.
+    int trailStart;
+    int trailLength;
+};
+
+/*
+ * Tracking state of one published frame. Never modified once published, so any number
+ * of readers can use it without locking. Subjects are ordered by group, then by ID.
+ */
+struct TrackingSnapshot {
+    //Assigned by SnapshotStore::publish, increases with every publication.
+    quint64 version;
+    int frameIndex;
+    //Shared with the ProcessingThread, which never writes to a published frame.
+    Mat frame;
+    QVector<SubjectPose> subjects;
+    //Recent positions of all subjects back to back, oldest first per subject.
+    QVector<QPointF> trails;
+
+    TrackingSnapshot() : version(0), frameIndex(-1) {}
+};
+
+/*
+ * Holds the latest TrackingSnapshot. Publishing swaps a single pointer; the replaced
+ * snapshot is deleted once no reader that could still see it is left (epoch based).
+ * Readers take a slot with one compare-and-swap and never wait for the writer.
+ */
+class SnapshotStore
+{
+public:
+    SnapshotStore();
+    ~SnapshotStore();
+
+    //Takes ownership of snapshot (may be NULL) and makes it the current one.
+    void publish(TrackingSnapshot* snapshot);
+
+    //Maximum number of simultaneous readers.
+    static const int READER_SLOTS = 16;
+private:
+    friend class SnapshotReader;
+
+    QAtomicPointer<TrackingSnapshot> current;
+    //Incremented on every publication, starts at 1 so 0 can mark a free slot.
+    QAtomicInt epoch;
+    //Epoch each active reader entered at, 0 if the slot is free.
+    QAtomicInt slots[READER_SLOTS];
+    //Version given to the next published snapshot, protected by writeMutex.
+    quint64 nextVersion;
+    //Serializes writers and protects the retired list.
+    QMutex writeMutex;
+    //Replaced snapshots along with the epoch they were retired in.
+    QList<QPair<int, TrackingSnapshot*> > retired;
+
+    int enter();
+    void leave(int slot);
+    //Deletes every retired snapshot no active reader can still hold.
+    void reclaim();
+};
+
+/*
+ * Scoped read access to the current snapshot. The snapshot stays valid until the reader
+ * is destroyed, so keep readers short lived.
+ */
+class SnapshotReader
+{
+public:
+    SnapshotReader(SnapshotStore* store);
+    ~SnapshotReader();
+    //NULL if nothing has been published yet.
+    const TrackingSnapshot* get() const { return snapshot; }
+    const TrackingSnapshot* operator->() const { return snapshot; }
+private:
+    SnapshotStore* store;
+    int slot;
+    const TrackingSnapshot* snapshot;
+
+    Q_DISABLE_COPY(SnapshotReader)
+};
+
+#endif // TRACKINGSNAPSHOT_H
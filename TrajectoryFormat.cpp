@@ -0,0 +1,176 @@
+#include "TrajectoryFormat.h"
+#include <QtEndian>
+#include <cmath>
+
+static const float POS_SCALE = 100;
+static const float DIR_SCALE = 10000;
+
+static void putVarint(QByteArray& out, quint64 value) {
+    while (value >= 0x80) {
+        out.append((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.append((char)value);
+}
+
+static quint64 zigzag(qint64 value) {
+    return ((quint64)value << 1) ^ (quint64)(value >> 63);
+}
+
+static qint64 unzigzag(quint64 value) {
+    return (qint64)(value >> 1) ^ -(qint64)(value & 1);
+}
+
+//Reads a varint at pos, advancing it. Returns false past end.
+static bool getVarint(const uchar* data, quint32 size, quint32& pos, quint64& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= size)
+            return false;
+        uchar byte = data[pos++];
+        value |= (quint64)(byte & 0x7f) << shift;
+        if (! (byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void putColumn(QByteArray& out, const float* values, int count, float scale) {
+    qint64 previous = 0;
+    for (int i = 0; i < count; i++) {
+        qint64 value = (qint64)floor(values[i] * scale + 0.5f);
+        putVarint(out, zigzag(value - previous));
+        previous = value;
+    }
+}
+
+static bool getColumn(const uchar* data, quint32 size, quint32& pos, float* values, int count, float scale) {
+    qint64 previous = 0;
+    quint64 raw;
+    for (int i = 0; i < count; i++) {
+        if (! getVarint(data, size, pos, raw))
+            return false;
+        previous += unzigzag(raw);
+        values[i] = previous / scale;
+    }
+    return true;
+}
+
+QString TrajectoryFormat::indexPath(QString dataPath) {
+    return dataPath + ".idx";
+}
+
+QByteArray TrajectoryFormat::dataHeader() {
+    char header[DATA_HEADER_SIZE] = { 'P', 'T', 'T', 'J' };
+    qToLittleEndian<quint32>(VERSION, (uchar*)header + 4);
+    return QByteArray(header, DATA_HEADER_SIZE);
+}
+
+bool TrajectoryFormat::isDataHeader(const uchar* data, qint64 size) {
+    return size >= DATA_HEADER_SIZE && data[0] == 'P' && data[1] == 'T' && data[2] == 'T' && data[3] == 'J' &&
+           qFromLittleEndian<quint32>(data + 4) == VERSION;
+}
+
+void TrajectoryFormat::encodeBlock(const TrajectoryBlock& block, QByteArray& out, TrajectoryIndexEntry& entry) {
+    int start = out.size();
+    //Size prefix, filled in once the payload is known.
+    out.append(QByteArray(4, 0));
+    putVarint(out, zigzag(block.groupID));
+    putVarint(out, zigzag(block.subjectID));
+    putVarint(out, block.count);
+    putVarint(out, zigzag(block.count > 0 ? block.frame[0] : 0));
+    for (int i = 1; i < block.count; i++)
+        putVarint(out, zigzag((qint64)block.frame[i] - block.frame[i-1]));
+    putColumn(out, block.x, block.count, POS_SCALE);
+    putColumn(out, block.y, block.count, POS_SCALE);
+    putColumn(out, block.heading, block.count, DIR_SCALE);
+    putColumn(out, block.left, block.count, POS_SCALE);
+    putColumn(out, block.top, block.count, POS_SCALE);
+    putColumn(out, block.width, block.count, POS_SCALE);
+    putColumn(out, block.height, block.count, POS_SCALE);
+
+    quint32 payload = out.size() - start - 4;
+    qToLittleEndian<quint32>(payload, (uchar*)out.data() + start);
+
+    entry.size = payload;
+    entry.groupID = block.groupID;
+    entry.subjectID = block.subjectID;
+    entry.count = block.count;
+    entry.firstFrame = block.frame[0];
+    entry.lastFrame = block.frame[0];
+    //Frames are not necessarily increasing after a seek.
+    for (int i = 1; i < block.count; i++) {
+        entry.firstFrame = qMin(entry.firstFrame, block.frame[i]);
+        entry.lastFrame = qMax(entry.lastFrame, block.frame[i]);
+    }
+}
+
+bool TrajectoryFormat::decodeBlock(const uchar* data, quint32 size, TrajectoryBlock& block) {
+    quint32 pos = 0;
+    quint64 group, subject, count, frame;
+    if (! getVarint(data, size, pos, group) || ! getVarint(data, size, pos, subject) ||
+            ! getVarint(data, size, pos, count) || count > (quint64)TRAJECTORY_BLOCK_SIZE)
+        return false;
+    block.groupID = unzigzag(group);
+    block.subjectID = unzigzag(subject);
+    block.count = count;
+    qint64 previous = 0;
+    for (int i = 0; i < block.count; i++) {
+        if (! getVarint(data, size, pos, frame))
+            return false;
+        previous += unzigzag(frame);
+        block.frame[i] = previous;
+    }
+    return getColumn(data, size, pos, block.x, block.count, POS_SCALE) &&
+           getColumn(data, size, pos, block.y, block.count, POS_SCALE) &&
+           getColumn(data, size, pos, block.heading, block.count, DIR_SCALE) &&
+           getColumn(data, size, pos, block.left, block.count, POS_SCALE) &&
+           getColumn(data, size, pos, block.top, block.count, POS_SCALE) &&
+           getColumn(data, size, pos, block.width, block.count, POS_SCALE) &&
+           getColumn(data, size, pos, block.height, block.count, POS_SCALE);
+}
+
+QByteArray TrajectoryFormat::indexHeader() {
+    char header[INDEX_HEADER_SIZE] = { 'P', 'T', 'T', 'I' };
+    qToLittleEndian<quint32>(VERSION, (uchar*)header + 4);
+    return QByteArray(header, INDEX_HEADER_SIZE);
+}
+
+QByteArray TrajectoryFormat::encodeEntries(const QVector<TrajectoryIndexEntry>& entries, int first) {
+    QByteArray out((entries.size() - first) * INDEX_ENTRY_SIZE, 0);
+    uchar* p = (uchar*)out.data();
+    for (int i = first; i < entries.size(); i++, p += INDEX_ENTRY_SIZE) {
+        const TrajectoryIndexEntry& entry = entries[i];
+        qToLittleEndian<qint64>(entry.offset, p);
+        qToLittleEndian<quint32>(entry.size, p + 8);
+        qToLittleEndian<qint32>(entry.groupID, p + 12);
+        qToLittleEndian<qint32>(entry.subjectID, p + 16);
+        qToLittleEndian<qint32>(entry.firstFrame, p + 20);
+        qToLittleEndian<qint32>(entry.lastFrame, p + 24);
+        qToLittleEndian<quint32>(entry.count, p + 28);
+    }
+    return out;
+}
+
+bool TrajectoryFormat::decodeIndex(const uchar* data, qint64 size, QVector<TrajectoryIndexEntry>& entries) {
+    if (size < INDEX_HEADER_SIZE || data[0] != 'P' || data[1] != 'T' || data[2] != 'T' || data[3] != 'I' ||
+            qFromLittleEndian<quint32>(data + 4) != VERSION)
+        return false;
+    int first = entries.size();
+    int count = (size - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+    if (count < first)
+        return false;
+    entries.resize(count);
+    const uchar* p = data + INDEX_HEADER_SIZE + (qint64)first * INDEX_ENTRY_SIZE;
+    for (int i = first; i < count; i++, p += INDEX_ENTRY_SIZE) {
+        TrajectoryIndexEntry& entry = entries[i];
+        entry.offset = qFromLittleEndian<qint64>(p);
+        entry.size = qFromLittleEndian<quint32>(p + 8);
+        entry.groupID = qFromLittleEndian<qint32>(p + 12);
+        entry.subjectID = qFromLittleEndian<qint32>(p + 16);
+        entry.firstFrame = qFromLittleEndian<qint32>(p + 20);
+        entry.lastFrame = qFromLittleEndian<qint32>(p + 24);
+        entry.count = qFromLittleEndian<quint32>(p + 28);
+    }
+    return true;
+}
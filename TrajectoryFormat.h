@@ -0,0 +1,66 @@
+#ifndef TRAJECTORYFORMAT_H
+#define TRAJECTORYFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "TrajectoryRing.h"
+
+/*
+ * On-disk layout of a trajectory store.
+ *
+ * Data file: the magic "PTTJ" and a 32 bit version, then blocks back to back. A block is
+ * a 32 bit payload size followed by the payload: group, subject, sample count and first
+ * frame as varints, then one column per quantity (frame, x, y, heading, left, top, width,
+ * height). Each column holds the differences between consecutive values as zigzag varints.
+ * Coordinates are stored in 1/100 pixels and headings in 1/10000 radians.
+ *
+ * Index file (data path + ".idx"): the magic "PTTI" and a 32 bit version, then one 32 byte
+ * TrajectoryIndexEntry per block. Entries are appended only after their block was written
+ * to the data file, so a reader never sees an entry for missing data and simply ignores
+ * a trailing entry that is not complete yet. All integers are little endian.
+ */
+
+//Where a block lives in the data file and what it covers.
+struct TrajectoryIndexEntry {
+    qint64 offset;
+    quint32 size;
+    qint32 groupID;
+    qint32 subjectID;
+    qint32 firstFrame;
+    qint32 lastFrame;
+    quint32 count;
+};
+
+//Pose of a subject on one frame, together with the subject.
+struct TrajectoryPose {
+    int groupID;
+    int subjectID;
+    TrajectorySample sample;
+};
+
+namespace TrajectoryFormat {
+    const quint32 VERSION = 1;
+    const int DATA_HEADER_SIZE = 8;
+    const int INDEX_HEADER_SIZE = 8;
+    const int INDEX_ENTRY_SIZE = 32;
+
+    QString indexPath(QString dataPath);
+    QByteArray dataHeader();
+    //True if data starts with the header of a data file of this version.
+    bool isDataHeader(const uchar* data, qint64 size);
+
+    //Appends the encoded block (size prefix included) to out and fills in entry, except its offset.
+    void encodeBlock(const TrajectoryBlock& block, QByteArray& out, TrajectoryIndexEntry& entry);
+    //Decodes the payload of a block. Returns false if it is malformed.
+    bool decodeBlock(const uchar* data, quint32 size, TrajectoryBlock& block);
+
+    QByteArray indexHeader();
+    //Encodes entries [first, end).
+    QByteArray encodeEntries(const QVector<TrajectoryIndexEntry>& entries, int first);
+    //Appends the complete entries of an index file past the first entries.size() ones.
+    //Returns false if data is not an index file.
+    bool decodeIndex(const uchar* data, qint64 size, QVector<TrajectoryIndexEntry>& entries);
+}
+
+#endif // TRAJECTORYFORMAT_H
@@ -0,0 +1,169 @@
+#include "TrajectoryReader.h"
+#include <QDebug>
+#include <algorithm>
+
+//Orders entry indices by the first frame of their block.
+struct FirstFrameLess {
+    const QVector<TrajectoryIndexEntry>* entries;
+    bool operator()(int a, int b) const { return (*entries)[a].firstFrame < (*entries)[b].firstFrame; }
+};
+
+//True if the block of an entry index starts before a frame.
+struct StartsBefore {
+    const QVector<TrajectoryIndexEntry>* entries;
+    bool operator()(int entry, int frame) const { return (*entries)[entry].firstFrame < frame; }
+};
+
+TrajectoryReader::TrajectoryReader() :
+    data(NULL), dataSize(0), maxSpan(0)
+{
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+quint64 TrajectoryReader::key(int groupID, int subjectID) {
+    return ((quint64)(quint32)groupID << 32) | (quint32)subjectID;
+}
+
+bool TrajectoryReader::open(QString dataPath) {
+    close();
+    dataFile.setFileName(dataPath);
+    indexPath = TrajectoryFormat::indexPath(dataPath);
+    if (! dataFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "Trajectory Reader: Could not open " << dataPath;
+        return false;
+    }
+    QByteArray header = dataFile.read(TrajectoryFormat::DATA_HEADER_SIZE);
+    if (! TrajectoryFormat::isDataHeader((const uchar*)header.constData(), header.size())) {
+        qWarning() << "Trajectory Reader: Not a trajectory store: " << dataPath;
+        dataFile.close();
+        return false;
+    }
+    return refresh();
+}
+
+bool TrajectoryReader::refresh() {
+    if (! dataFile.isOpen())
+        return false;
+    QFile indexFile(indexPath);
+    if (! indexFile.open(QIODevice::ReadOnly))
+        return false;
+    qint64 indexSize = indexFile.size();
+    uchar* index = indexSize > 0 ? indexFile.map(0, indexSize) : NULL;
+    if (index == NULL)
+        return false;
+    int first = entries.size();
+    bool valid = TrajectoryFormat::decodeIndex(index, indexSize, entries);
+    indexFile.unmap(index);
+    if (! valid) {
+        entries.resize(first);
+        return false;
+    }
+
+    //Entries are written after their data, but the data file may be a copy cut short.
+    qint64 fileSize = dataFile.size();
+    qint64 needed = dataSize;
+    int count = first;
+    for (; count < entries.size(); count++) {
+        const TrajectoryIndexEntry& entry = entries[count];
+        qint64 end = entry.offset + 4 + entry.size;
+        if (entry.offset < TrajectoryFormat::DATA_HEADER_SIZE || end > fileSize)
+            break;
+        needed = qMax(needed, end);
+    }
+    entries.resize(count);
+
+    if (needed > dataSize || data == NULL) {
+        if (data)
+            dataFile.unmap(data);
+        data = dataFile.map(0, qMax(needed, (qint64)TrajectoryFormat::DATA_HEADER_SIZE));
+        //The file may have been replaced since open().
+        if (data && ! TrajectoryFormat::isDataHeader(data, TrajectoryFormat::DATA_HEADER_SIZE)) {
+            dataFile.unmap(data);
+            data = NULL;
+        }
+        if (data == NULL) {
+            dataSize = 0;
+            entries.resize(first);
+            return false;
+        }
+        dataSize = needed;
+    }
+
+    for (int i = first; i < entries.size(); i++) {
+        const TrajectoryIndexEntry& entry = entries[i];
+        byFirstFrame.append(i);
+        maxSpan = qMax(maxSpan, entry.lastFrame - entry.firstFrame);
+    }
+    //Only the new entries need sorting, the rest already is.
+    FirstFrameLess less;
+    less.entries = &entries;
+    std::stable_sort(byFirstFrame.begin() + first, byFirstFrame.end(), less);
+    std::inplace_merge(byFirstFrame.begin(), byFirstFrame.begin() + first, byFirstFrame.end(), less);
+    return true;
+}
+
+void TrajectoryReader::close() {
+    if (data)
+        dataFile.unmap(data);
+    data = NULL;
+    dataSize = 0;
+    dataFile.close();
+    entries.clear();
+    byFirstFrame.clear();
+    maxSpan = 0;
+}
+
+bool TrajectoryReader::isOpen() {
+    return data != NULL;
+}
+
+int TrajectoryReader::blockCount() {
+    return entries.size();
+}
+
+bool TrajectoryReader::readBlock(int index, TrajectoryBlock& block) {
+    const TrajectoryIndexEntry& entry = entries[index];
+    //Decoded straight from the mapping, no copy of the file contents.
+    return TrajectoryFormat::decodeBlock(data + entry.offset + 4, entry.size, block);
+}
+
+QVector<TrajectoryPose> TrajectoryReader::posesAt(int frameIndex) {
+    QVector<TrajectoryPose> poses;
+    if (data == NULL)
+        return poses;
+    //Only blocks starting within maxSpan frames before frameIndex can contain it.
+    StartsBefore before;
+    before.entries = &entries;
+    QVector<int>::const_iterator it = std::lower_bound(byFirstFrame.constBegin(), byFirstFrame.constEnd(),
+                                                       frameIndex - maxSpan, before);
+    TrajectoryBlock block;
+    //Index into poses of each subject's pose, and the entry it came from.
+    QHash<quint64, int> found;
+    QVector<int> poseEntries;
+    for (; it != byFirstFrame.constEnd() && entries[*it].firstFrame <= frameIndex; it++) {
+        if (entries[*it].lastFrame < frameIndex || ! readBlock(*it, block))
+            continue;
+        for (int i = 0; i < block.count; i++) {
+            if (block.frame[i] != frameIndex)
+                continue;
+            TrajectoryPose pose;
+            pose.groupID = block.groupID;
+            pose.subjectID = block.subjectID;
+            pose.sample = block.sample(i);
+            //Entries are numbered in file order, the later one was recorded last.
+            QHash<quint64, int>::const_iterator earlier = found.constFind(key(block.groupID, block.subjectID));
+            if (earlier == found.constEnd()) {
+                found.insert(key(block.groupID, block.subjectID), poses.size());
+                poses.append(pose);
+                poseEntries.append(*it);
+            } else if (poseEntries[earlier.value()] < *it) {
+                poses[earlier.value()] = pose;
+                poseEntries[earlier.value()] = *it;
+            }
+        }
+    }
+    return poses;
+}
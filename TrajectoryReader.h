@@ -0,0 +1,46 @@
+#ifndef TRAJECTORYREADER_H
+#define TRAJECTORYREADER_H
+
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include "TrajectoryFormat.h"
+
+/*
+ * Reads a trajectory store (see TrajectoryFormat.h) through a read-only memory mapping,
+ * so only the blocks a query touches are paged in. Works while the tracker is still
+ * appending: the reader sees the blocks listed in the index at open() or the last
+ * refresh(). Not thread safe, use one reader per thread.
+ */
+class TrajectoryReader
+{
+public:
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    bool open(QString dataPath);
+    //Picks up blocks appended since open() or the last refresh().
+    bool refresh();
+    void close();
+    bool isOpen();
+
+    int blockCount();
+    //Decodes a block, numbered in file order. Returns false if it is malformed.
+    bool readBlock(int index, TrajectoryBlock& block);
+    //Every subject's pose on the frame. A frame recorded more than once (it was tracked again,
+    //e.g. after an edit) gives the pose recorded last.
+    QVector<TrajectoryPose> posesAt(int frameIndex);
+private:
+    QFile dataFile;
+    QString indexPath;
+    uchar* data;
+    qint64 dataSize;
+    QVector<TrajectoryIndexEntry> entries;
+    //Entries sorted by first frame, and the widest frame range of any block.
+    QVector<int> byFirstFrame;
+    int maxSpan;
+
+    static quint64 key(int groupID, int subjectID);
+};
+
+#endif // TRAJECTORYREADER_H
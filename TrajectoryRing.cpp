@@ -0,0 +1,143 @@
+#include "TrajectoryRing.h"
+#include "TrajectoryStore.h"
+#include <algorithm>
+
+TrajectorySample TrajectoryBlock::sample(int i) const {
+    TrajectorySample sample;
+    sample.frameIndex = frame[i];
+    sample.pos = QPointF(x[i], y[i]);
+    sample.dir = heading[i];
+    sample.bound = QRectF(left[i], top[i], width[i], height[i]);
+    return sample;
+}
+
+TrajectoryRing::TrajectoryRing() :
+    first(0), next(0), spilled(0)
+{
+}
+
+void TrajectoryRing::append(const TrajectorySample& sample, int groupID, int subjectID, TrajectoryStore* store) {
+    //Same frame processed again (e.g. while paused), or an earlier one tracked again: the
+    //latest poses replace what was recorded from there on.
+    truncateAfter(sample.frameIndex - 1);
+    if (next - first == CAPACITY) {
+        //Full, so next starts a block: the oldest one is spilled and reused.
+        if (spilled < first + TRAJECTORY_BLOCK_SIZE)
+            spill(std::max(spilled, first), first + TRAJECTORY_BLOCK_SIZE, groupID, subjectID, store);
+        first += TRAJECTORY_BLOCK_SIZE;
+    }
+    qint64 index = next++;
+
+    TrajectoryBlock& block = blocks[(index / TRAJECTORY_BLOCK_SIZE) % TRAJECTORY_RING_BLOCKS];
+    int i = index % TRAJECTORY_BLOCK_SIZE;
+    block.frame[i] = sample.frameIndex;
+    block.x[i] = sample.pos.x();
+    block.y[i] = sample.pos.y();
+    block.heading[i] = sample.dir;
+    block.left[i] = sample.bound.left();
+    block.top[i] = sample.bound.top();
+    block.width[i] = sample.bound.width();
+    block.height[i] = sample.bound.height();
+}
+
+void TrajectoryRing::flush(int groupID, int subjectID, TrajectoryStore* store) {
+    qint64 from = std::max(spilled, first);
+    while (from < next) {
+        qint64 blockEnd = (from / TRAJECTORY_BLOCK_SIZE + 1) * TRAJECTORY_BLOCK_SIZE;
+        qint64 to = std::min(blockEnd, next);
+        spill(from, to, groupID, subjectID, store);
+        from = to;
+    }
+}
+
+void TrajectoryRing::clear() {
+    first = next = spilled = 0;
+}
+
+void TrajectoryRing::truncateAfter(int frameIndex) {
+    while (next > first && frameAt(next - 1) > frameIndex)
+        next--;
+    spilled = std::min(spilled, next);
+}
+
+int TrajectoryRing::frameAt(qint64 index) const {
+    return blocks[(index / TRAJECTORY_BLOCK_SIZE) % TRAJECTORY_RING_BLOCKS].frame[index % TRAJECTORY_BLOCK_SIZE];
+}
+
+void TrajectoryRing::spill(qint64 from, qint64 to, int groupID, int subjectID, TrajectoryStore* store) {
+    spilled = std::max(spilled, to);
+    if (store == NULL)
+        return;
+    const TrajectoryBlock& source = blocks[(from / TRAJECTORY_BLOCK_SIZE) % TRAJECTORY_RING_BLOCKS];
+    int offset = from % TRAJECTORY_BLOCK_SIZE;
+    int end = offset + (to - from);
+    while (offset < end) {
+        //Each run of consecutive frames becomes a block of its own, so a seek never widens the
+        //frame range of a stored block (which every per-frame query of a reader has to scan).
+        int count = 1;
+        while (offset + count < end && source.frame[offset + count] == source.frame[offset + count - 1] + 1)
+            count++;
+
+        TrajectoryBlock block;
+        block.groupID = groupID;
+        block.subjectID = subjectID;
+        block.count = count;
+        std::copy(source.frame + offset, source.frame + offset + count, block.frame);
+        std::copy(source.x + offset, source.x + offset + count, block.x);
+        std::copy(source.y + offset, source.y + offset + count, block.y);
+        std::copy(source.heading + offset, source.heading + offset + count, block.heading);
+        std::copy(source.left + offset, source.left + offset + count, block.left);
+        std::copy(source.top + offset, source.top + offset + count, block.top);
+        std::copy(source.width + offset, source.width + offset + count, block.width);
+        std::copy(source.height + offset, source.height + offset + count, block.height);
+        store->append(block);
+        offset += count;
+    }
+}
+
+int TrajectoryRing::size() const {
+    return next - first;
+}
+
+TrajectorySample TrajectoryRing::at(int i) const {
+    qint64 index = first + i;
+    return blocks[(index / TRAJECTORY_BLOCK_SIZE) % TRAJECTORY_RING_BLOCKS].sample(index % TRAJECTORY_BLOCK_SIZE);
+}
+
+qint64 TrajectoryRing::endAt(int frameIndex) const {
+    //Frames increase from first to next, see append().
+    qint64 low = first, high = next;
+    while (low < high) {
+        qint64 middle = low + (high - low) / 2;
+        if (frameAt(middle) <= frameIndex)
+            low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+bool TrajectoryRing::sampleAt(int frameIndex, TrajectorySample& sample) const {
+    qint64 end = endAt(frameIndex);
+    if (end == first)
+        return false;
+    sample = at(end - 1 - first);
+    return true;
+}
+
+int TrajectoryRing::recentPositions(int n, QPointF* out, int lastFrame) const {
+    qint64 end = endAt(lastFrame);
+    int count = std::min<qint64>(n, end - first);
+    //Copy block by block, each run is contiguous in the x and y arrays.
+    qint64 index = end - count;
+    int copied = 0;
+    while (copied < count) {
+        const TrajectoryBlock& block = blocks[(index / TRAJECTORY_BLOCK_SIZE) % TRAJECTORY_RING_BLOCKS];
+        int i = index % TRAJECTORY_BLOCK_SIZE;
+        int run = std::min(count - copied, TRAJECTORY_BLOCK_SIZE - i);
+        for (int j = 0; j < run; j++)
+            out[copied + j] = QPointF(block.x[i + j], block.y[i + j]);
+        copied += run;
+        index += run;
+    }
+    return count;
+}
@@ -0,0 +1,81 @@
+#ifndef TRAJECTORYRING_H
+#define TRAJECTORYRING_H
+
+#include <QPointF>
+#include <QRectF>
+#include "Structures.h"
+
+class TrajectoryStore;
+
+//Pose of a subject on one frame.
+struct TrajectorySample {
+    int frameIndex;
+    QPointF pos;
+    float dir;
+    QRectF bound;
+};
+
+//Up to TRAJECTORY_BLOCK_SIZE consecutive samples of one subject, one array per quantity.
+struct TrajectoryBlock {
+    int groupID;
+    int subjectID;
+    int count;
+    int frame[TRAJECTORY_BLOCK_SIZE];
+    float x[TRAJECTORY_BLOCK_SIZE];
+    float y[TRAJECTORY_BLOCK_SIZE];
+    float heading[TRAJECTORY_BLOCK_SIZE];
+    float left[TRAJECTORY_BLOCK_SIZE];
+    float top[TRAJECTORY_BLOCK_SIZE];
+    float width[TRAJECTORY_BLOCK_SIZE];
+    float height[TRAJECTORY_BLOCK_SIZE];
+
+    TrajectorySample sample(int i) const;
+};
+
+/*
+ * Most recent history of one subject in a fixed number of blocks, so appending never
+ * allocates and memory per subject is bounded. When the ring is full, the next append
+ * hands the oldest block to a TrajectoryStore (if any) and reuses it.
+ * Samples are kept in columns, a trail only reads the x and y arrays.
+ */
+class TrajectoryRing
+{
+public:
+    TrajectoryRing();
+
+    //Records a sample. A sample for a frame at or before the last one held (the frame was
+    //tracked again) replaces the samples from that frame on.
+    void append(const TrajectorySample& sample, int groupID, int subjectID, TrajectoryStore* spill);
+    //Drops the samples held for frames after frameIndex, e.g. after they became stale by an edit.
+    //Those spilled already stay in the store, where the samples recorded again supersede them.
+    void truncateAfter(int frameIndex);
+    //Hands every sample not spilled yet to the store, e.g. before the subject goes away.
+    void flush(int groupID, int subjectID, TrajectoryStore* spill);
+    void clear();
+
+    //Samples held in memory, at(0) being the oldest.
+    int size() const;
+    TrajectorySample at(int i) const;
+    //Copies the positions of the (at most) n most recent samples of frames up to lastFrame to
+    //out, oldest first. Returns the number copied.
+    int recentPositions(int n, QPointF* out, int lastFrame) const;
+    //The latest sample held of a frame at or before frameIndex. False if there is none.
+    bool sampleAt(int frameIndex, TrajectorySample& sample) const;
+
+    static const int CAPACITY = TRAJECTORY_BLOCK_SIZE * TRAJECTORY_RING_BLOCKS;
+private:
+    TrajectoryBlock blocks[TRAJECTORY_RING_BLOCKS];
+    //Running sample numbers: first held, next to be written, first not yet spilled.
+    qint64 first;
+    qint64 next;
+    qint64 spilled;
+
+    int frameAt(qint64 index) const;
+    //Running number after the last sample of a frame at or before frameIndex.
+    qint64 endAt(int frameIndex) const;
+    //Hands samples [from, to) to the store, which must not span more than one block.
+    //Stored blocks hold consecutive frames only.
+    void spill(qint64 from, qint64 to, int groupID, int subjectID, TrajectoryStore* store);
+};
+
+#endif // TRAJECTORYRING_H
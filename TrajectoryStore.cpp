@@ -0,0 +1,236 @@
+#include "TrajectoryStore.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QDir>
+#include <QTemporaryFile>
+
+//Encoded blocks are written in chunks of this size.
+static const int WRITE_CHUNK = 1 << 16;
+
+TrajectoryStore::TrajectoryStore() :
+    scratch(false), committed(0), dataSize(0)
+{
+}
+
+TrajectoryStore::~TrajectoryStore() {
+    close();
+}
+
+QString TrajectoryStore::pathFor(QString trackFilePath) {
+    QFileInfo info(trackFilePath);
+    return info.dir().filePath(info.completeBaseName() + ".ptt");
+}
+
+bool TrajectoryStore::open(QString dataPath, bool append) {
+    mutex.lock();
+    QString scratchPath;
+    if (scratch) {
+        //Kept until its blocks are copied over.
+        flushLocked();
+        reader.close();
+        dataFile.close();
+        indexFile.close();
+        scratchPath = dataFile.fileName();
+        scratch = false;
+    } else {
+        closeLocked();
+    }
+    if (! openFile(dataPath, append)) {
+        //Back to the scratch file, nothing recorded so far is lost.
+        if (! scratchPath.isEmpty()) {
+            dataFile.setFileName(scratchPath);
+            indexFile.setFileName(TrajectoryFormat::indexPath(scratchPath));
+            scratch = dataFile.open(QIODevice::WriteOnly | QIODevice::Append) &&
+                      indexFile.open(QIODevice::WriteOnly | QIODevice::Append);
+        }
+        mutex.unlock();
+        return false;
+    }
+
+    //Whatever was recorded before the file was opened goes in first.
+    if (! scratchPath.isEmpty()) {
+        TrajectoryReader recorded;
+        if (recorded.open(scratchPath)) {
+            TrajectoryBlock block;
+            for (int i = 0; i < recorded.blockCount(); i++) {
+                if (recorded.readBlock(i, block))
+                    appendToFile(block);
+            }
+        } else {
+            qWarning() << "Trajectory Store: Could not read back " << scratchPath;
+        }
+        recorded.close();
+        QFile::remove(scratchPath);
+        QFile::remove(TrajectoryFormat::indexPath(scratchPath));
+    }
+    flushLocked();
+    mutex.unlock();
+    return true;
+}
+
+//Reads the index of an existing store into entries. Returns the size of the data its complete
+//blocks take up, 0 if there is no valid store at dataPath.
+static qint64 readExisting(QString dataPath, QVector<TrajectoryIndexEntry>& entries) {
+    QFile data(dataPath);
+    QFile index(TrajectoryFormat::indexPath(dataPath));
+    if (! data.open(QIODevice::ReadOnly) || ! index.open(QIODevice::ReadOnly))
+        return 0;
+    QByteArray header = data.read(TrajectoryFormat::DATA_HEADER_SIZE);
+    QByteArray indexData = index.readAll();
+    if (! TrajectoryFormat::isDataHeader((const uchar*)header.constData(), header.size()) ||
+            ! TrajectoryFormat::decodeIndex((const uchar*)indexData.constData(), indexData.size(), entries))
+        return 0;
+    qint64 size = TrajectoryFormat::DATA_HEADER_SIZE;
+    int count = 0;
+    for (; count < entries.size(); count++) {
+        qint64 end = entries[count].offset + 4 + entries[count].size;
+        if (entries[count].offset < size || end > data.size())
+            break;
+        size = end;
+    }
+    entries.resize(count);
+    return size;
+}
+
+//Starts an empty store at dataPath, or with append carries on with an existing one.
+//Leaves the state of the previous one if that fails.
+bool TrajectoryStore::openFile(QString dataPath, bool append) {
+    QVector<TrajectoryIndexEntry> existing;
+    qint64 existingSize = append ? readExisting(dataPath, existing) : 0;
+    QIODevice::OpenMode mode = existingSize > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly | QIODevice::Truncate;
+    dataFile.setFileName(dataPath);
+    indexFile.setFileName(TrajectoryFormat::indexPath(dataPath));
+    if (! dataFile.open(mode) || ! indexFile.open(mode)) {
+        qWarning() << "Trajectory Store: Could not open " << dataPath;
+        dataFile.close();
+        indexFile.close();
+        return false;
+    }
+    if (existingSize > 0) {
+        //Data past the last block in the index was never committed.
+        qint64 indexSize = TrajectoryFormat::INDEX_HEADER_SIZE + (qint64)existing.size() * TrajectoryFormat::INDEX_ENTRY_SIZE;
+        if (! dataFile.resize(existingSize) || ! dataFile.seek(existingSize) ||
+                ! indexFile.resize(indexSize) || ! indexFile.seek(indexSize))
+            qWarning() << "Trajectory Store: Could not append to " << dataPath;
+        dataSize = existingSize;
+        entries = existing;
+        committed = entries.size();
+        qDebug() << "Trajectory Store: Appending to " << dataPath << " after " << entries.size() << " blocks.";
+        return true;
+    }
+    QByteArray header = TrajectoryFormat::dataHeader();
+    dataFile.write(header);
+    dataSize = header.size();
+    indexFile.write(TrajectoryFormat::indexHeader());
+    entries.clear();
+    committed = 0;
+    return true;
+}
+
+bool TrajectoryStore::openScratch() {
+    QTemporaryFile temp(QDir::temp().filePath("trajectories-XXXXXX.ptt"));
+    temp.setAutoRemove(false);
+    if (! temp.open()) {
+        qWarning() << "Trajectory Store: Could not create a scratch file in " << QDir::tempPath();
+        return false;
+    }
+    QString path = temp.fileName();
+    temp.close();
+    if (! openFile(path)) {
+        QFile::remove(path);
+        return false;
+    }
+    scratch = true;
+    return true;
+}
+
+void TrajectoryStore::close() {
+    mutex.lock();
+    closeLocked();
+    mutex.unlock();
+}
+
+void TrajectoryStore::closeLocked() {
+    if (! dataFile.isOpen())
+        return;
+    flushLocked();
+    reader.close();
+    dataFile.close();
+    indexFile.close();
+    if (scratch) {
+        QFile::remove(dataFile.fileName());
+        QFile::remove(indexFile.fileName());
+        scratch = false;
+    } else {
+        qDebug() << "Trajectory Store: Wrote " << entries.size() << " blocks, " << dataSize << " bytes to " << dataFile.fileName();
+    }
+    entries.clear();
+    committed = 0;
+    dataSize = 0;
+}
+
+bool TrajectoryStore::isOpen() {
+    mutex.lock();
+    bool open = dataFile.isOpen() && ! scratch;
+    mutex.unlock();
+    return open;
+}
+
+void TrajectoryStore::append(const TrajectoryBlock& block) {
+    mutex.lock();
+    if (dataFile.isOpen() || openScratch())
+        appendToFile(block);
+    mutex.unlock();
+}
+
+void TrajectoryStore::appendToFile(const TrajectoryBlock& block) {
+    TrajectoryIndexEntry entry;
+    entry.offset = dataSize + pending.size();
+    TrajectoryFormat::encodeBlock(block, pending, entry);
+    entries.append(entry);
+    if (pending.size() >= WRITE_CHUNK || entries.size() - committed >= INDEX_COMMIT_BLOCKS)
+        flushLocked();
+}
+
+void TrajectoryStore::flush() {
+    mutex.lock();
+    flushLocked();
+    mutex.unlock();
+}
+
+void TrajectoryStore::flushLocked() {
+    if (! dataFile.isOpen())
+        return;
+    if (! pending.isEmpty()) {
+        if (dataFile.write(pending) != pending.size())
+            qWarning() << "Trajectory Store: Write failed on " << dataFile.fileName();
+        dataSize += pending.size();
+        pending.resize(0);
+    }
+    dataFile.flush();
+    //Entries only after the data they point to, so readers never see a dangling one.
+    if (committed < entries.size()) {
+        indexFile.write(TrajectoryFormat::encodeEntries(entries, committed));
+        indexFile.flush();
+        committed = entries.size();
+    }
+}
+
+//Brings the reader up to date with everything appended so far. False if nothing was appended.
+bool TrajectoryStore::syncReader() {
+    if (! dataFile.isOpen())
+        return false;
+    flushLocked();
+    if (reader.isOpen() ? ! reader.refresh() : ! reader.open(dataFile.fileName()))
+        qWarning() << "Trajectory Store: Could not read back " << dataFile.fileName();
+    return true;
+}
+
+QVector<TrajectoryPose> TrajectoryStore::posesAt(int frameIndex) {
+    QVector<TrajectoryPose> poses;
+    mutex.lock();
+    if (syncReader())
+        poses = reader.posesAt(frameIndex);
+    mutex.unlock();
+    return poses;
+}
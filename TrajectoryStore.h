@@ -0,0 +1,73 @@
+#ifndef TRAJECTORYSTORE_H
+#define TRAJECTORYSTORE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+#include "TrajectoryRing.h"
+#include "TrajectoryFormat.h"
+#include "TrajectoryReader.h"
+
+/*
+ * Receives the blocks that subject TrajectoryRings spill, so the full history of every
+ * subject stays available after it left the rings. Blocks of a subject arrive in the order they
+ * were recorded, a frame tracked again (e.g. after an edit) arrives again.
+ *
+ * Blocks are compressed and appended to a file (see TrajectoryFormat.h) and their index
+ * entries are committed every INDEX_COMMIT_BLOCKS blocks, so other processes can follow
+ * the recording with a TrajectoryReader. Until open() names a file, and again after close(),
+ * they go to a scratch file in the temporary directory, so a session without an export does
+ * not hold its whole history in memory. open() copies the scratch file over and removes it.
+ * Thread safe: blocks are appended by the ProcessingThread and may be read from any thread.
+ */
+class TrajectoryStore
+{
+public:
+    TrajectoryStore();
+    ~TrajectoryStore();
+
+    //Starts a new store at dataPath, replacing any existing one. With append, the blocks an
+    //existing store lists in its index are kept.
+    bool open(QString dataPath, bool append = false);
+    //Writes everything out, including the index.
+    void close();
+    //True while a file named by open() is written, not the scratch file.
+    bool isOpen();
+    //The store written next to a track file, e.g. "run.csv" -> "run.ptt".
+    static QString pathFor(QString trackFilePath);
+
+    void append(const TrajectoryBlock& block);
+    //Writes pending blocks and commits the index.
+    void flush();
+
+    //Every spilled pose on the frame. A frame recorded more than once gives the pose
+    //recorded last.
+    QVector<TrajectoryPose> posesAt(int frameIndex);
+
+    static const int INDEX_COMMIT_BLOCKS = 256;
+private:
+    QMutex mutex;
+    //True while blocks go to the scratch file.
+    bool scratch;
+
+    QFile dataFile;
+    QFile indexFile;
+    //Encoded blocks not written yet.
+    QByteArray pending;
+    //Entries of every block, the first committed of them already in the index file.
+    QVector<TrajectoryIndexEntry> entries;
+    int committed;
+    qint64 dataSize;
+    //For reads of an open store.
+    TrajectoryReader reader;
+
+    bool openFile(QString dataPath, bool append = false);
+    bool openScratch();
+    void appendToFile(const TrajectoryBlock& block);
+    void flushLocked();
+    void closeLocked();
+    bool syncReader();
+};
+
+#endif // TRAJECTORYSTORE_H
@@ -1,48 +1,58 @@
 #include <opencv/highgui.h>
 #include <QtGui>
 #include "Utilities.h"
+#include "Trace.h"
 
 using namespace std;
 using namespace cv;
 
-string itoa(int value, std::string& buf, int base){
-
-    int i = 30;
-
-    buf = "";
-
-    for(; value && i ; --i, value /= base)
-        buf = "0123456789abcdef"[value % base] + buf;
-
-    return buf;
-
+//Appends the hexadecimal digits of value without leading zeros. Zero appends nothing.
+static int appendHex(uchar value, char* buf) {
+    static const char digits[] = "0123456789abcdef";
+    if (value >= 16) {
+        buf[0] = digits[value >> 4];
+        buf[1] = digits[value & 0xf];
+        return 2;
+    }
+    if (value) {
+        buf[0] = digits[value];
+        return 1;
+    }
+    return 0;
 }
 
 std::string color2Hex(Point3_<uchar> pixelData) {
     //Converts an 8-bit color of 3 component integers to a hexadecimal string.
     //e.g. Point3_<uchar>(255,255,255) becomes "ffffff"
-
-    //Construct a Hash string (Hexadecimal) from the 3 color components.
-    stringstream hexColorStream;
-    //Stores temporary hex values before appended to the ostringstream.
-    string tempCol;
-    //Convert each pixel component integer to hexadecimal and append it to the stream.s
-    hexColorStream << itoa(pixelData.x, tempCol, 16);
-    hexColorStream << itoa(pixelData.y, tempCol, 16);
-    hexColorStream << itoa(pixelData.z, tempCol, 16);
-
-    return hexColorStream.str();
+    //Called for every pixel by the k-means, so the string is built in place. At most
+    //6 characters, which std::string keeps without a heap allocation.
+    char buf[6];
+    int length = 0;
+    length += appendHex(pixelData.x, buf + length);
+    length += appendHex(pixelData.y, buf + length);
+    length += appendHex(pixelData.z, buf + length);
+
+    return std::string(buf, length);
 }
 
-Point3_<uchar> hex2Color(string col) {
+Point3_<uchar> hex2Color(const string& col) {
     //Converts a string representing a hexadecimal concatenation of color component
     //integers to a color vector.
-    std::stringstream hexToInt;
-    int concatVal;
+    int concatVal = 0;
     Point3_<uchar> tempColor;
     //Converts the entire string to its hexadecimal counterpart as an integer value.
-    hexToInt << std::hex << col;
-    hexToInt >> concatVal;
+    for (size_t i = 0; i < col.size(); i++) {
+        char c = col[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else break;
+        concatVal = (concatVal << 4) | digit;
+    }
 
     //Separate out the color component values through bitwise operations.
     tempColor.x = (concatVal & 0xff0000) >> 16; //2^4 due to four digit shift
@@ -57,7 +67,7 @@ double colorDistance(Point3_<uchar> pt1, Point3_<uchar> pt2) {
 }
 
 float rad2Deg(float rads) {
-    qDebug() << "Converting " << rads << " radians to " << rads*180/PI << " degrees.";
+    TRACE_VERBOSE("Converting %1 radians to %2 degrees.", rads, rads*180/PI);
     return rads*180/PI;
 }
 
@@ -8,7 +8,7 @@
 using namespace cv;
 
 double colorDistance(Point3_<uchar> pt1, Point3_<uchar> pt2);
-Point3_<uchar> hex2Color(std::string col);
+Point3_<uchar> hex2Color(const std::string& col);
 std::string color2Hex(Point3_<uchar> pixelData);
 float rad2Deg(float rads);
 float deg2Rad(float degs);
@@ -0,0 +1,186 @@
+#include "VideoCache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+static const quint32 ENTRY_MAGIC = 0x50545643;
+static const quint32 ENTRY_VERSION = 1;
+//Entries used again after this long are rewritten, which refreshes their age for trim().
+static const qint64 TOUCH_INTERVAL_SECS = 3600;
+
+VideoCache::VideoCache(QString directory) :
+    directory(directory), maxBytes(DEFAULT_MAX_BYTES)
+{
+}
+
+QString VideoCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/videos";
+}
+
+void VideoCache::setMaxBytes(qint64 bytes) {
+    mutex.lock();
+    maxBytes = bytes;
+    mutex.unlock();
+}
+
+QByteArray VideoCache::contentKey(QString videoPath) {
+    QFile file(videoPath);
+    if (! file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    qint64 size = file.size();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(size));
+    //Start, middle and end: headers, the bulk of the stream and the index most containers end with.
+    qint64 offsets[3] = { 0, qMax((qint64)0, size / 2 - SAMPLE_SIZE / 2), qMax((qint64)0, size - SAMPLE_SIZE) };
+    for (int i = 0; i < 3; i++) {
+        if (! file.seek(offsets[i]))
+            return QByteArray();
+        hash.addData(file.read(SAMPLE_SIZE));
+    }
+    return hash.result();
+}
+
+//The key is only recomputed if the file changed size since it was last hashed.
+QByteArray VideoCache::keyFor(QString videoPath, qint64& fileSize) {
+    fileSize = QFileInfo(videoPath).size();
+    mutex.lock();
+    QPair<qint64, QByteArray> known = keys.value(videoPath, qMakePair((qint64)-1, QByteArray()));
+    mutex.unlock();
+    if (known.first == fileSize && ! known.second.isEmpty())
+        return known.second;
+
+    QByteArray key = contentKey(videoPath);
+    if (! key.isEmpty()) {
+        mutex.lock();
+        keys[videoPath] = qMakePair(fileSize, key);
+        mutex.unlock();
+    }
+    return key;
+}
+
+QString VideoCache::entryPath(const QByteArray& key) {
+    return QDir(directory).filePath(QString(key.toHex()) + ".ptvc");
+}
+
+bool VideoCache::load(QString videoPath, Entry& entry) {
+    entry = Entry();
+    entry.key = keyFor(videoPath, entry.fileSize);
+    if (entry.key.isEmpty())
+        return false;
+    QString path = entryPath(entry.key);
+    QFile file(path);
+    if (! file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_8);
+    quint32 magic, version;
+    QByteArray key;
+    qint64 fileSize;
+    in >> magic >> version >> key >> fileSize;
+    bool valid = in.status() == QDataStream::Ok && magic == ENTRY_MAGIC && version == ENTRY_VERSION &&
+                 key == entry.key && fileSize == entry.fileSize;
+    if (valid) {
+        qint32 frameCount, width, height;
+        quint32 paletteSize;
+        in >> entry.hasProbe >> frameCount >> entry.probe.fps >> width >> height >> paletteSize;
+        entry.probe.frameCount = frameCount;
+        entry.probe.width = width;
+        entry.probe.height = height;
+        if (in.status() == QDataStream::Ok && paletteSize > 0 && paletteSize < (1 << 16)) {
+            entry.backgroundPalette.create(1, paletteSize, CV_8UC3);
+            if (in.readRawData((char*)entry.backgroundPalette.data, paletteSize * 3) != (int)paletteSize * 3)
+                in.setStatus(QDataStream::ReadPastEnd);
+        }
+        valid = in.status() == QDataStream::Ok;
+    }
+    file.close();
+    if (! valid) {
+        qWarning() << "Video Cache: Removing invalid entry " << path;
+        QFile::remove(path);
+        entry = Entry();
+        entry.key = keyFor(videoPath, entry.fileSize);
+        return false;
+    }
+    if (QFileInfo(path).lastModified().secsTo(QDateTime::currentDateTime()) > TOUCH_INTERVAL_SECS)
+        store(entry);
+    return true;
+}
+
+void VideoCache::store(const Entry& entry) {
+    if (entry.key.isEmpty() || ! QDir().mkpath(directory))
+        return;
+    QSaveFile file(entryPath(entry.key));
+    if (! file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_8);
+    Mat palette = entry.backgroundPalette.isContinuous() ? entry.backgroundPalette : entry.backgroundPalette.clone();
+    out << ENTRY_MAGIC << ENTRY_VERSION << entry.key << entry.fileSize;
+    out << entry.hasProbe << (qint32)entry.probe.frameCount << entry.probe.fps
+        << (qint32)entry.probe.width << (qint32)entry.probe.height << (quint32)palette.cols;
+    out.writeRawData((const char*)palette.data, palette.cols * 3);
+    if (out.status() != QDataStream::Ok || ! file.commit()) {
+        qWarning() << "Video Cache: Could not write " << entryPath(entry.key);
+        return;
+    }
+    trim();
+}
+
+void VideoCache::trim() {
+    mutex.lock();
+    qint64 limit = maxBytes;
+    mutex.unlock();
+    QFileInfoList files = QDir(directory).entryInfoList(QStringList("*.ptvc"), QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (int i = 0; i < files.size(); i++)
+        total += files[i].size();
+    //Oldest first.
+    for (int i = 0; i < files.size() && total > limit; i++) {
+        if (QFile::remove(files[i].filePath()))
+            total -= files[i].size();
+    }
+}
+
+bool VideoCache::probe(QString videoPath, VideoProbe& result) {
+    Entry entry;
+    if (load(videoPath, entry) && entry.hasProbe) {
+        result = entry.probe;
+        return true;
+    }
+    QByteArray byteArray = videoPath.toUtf8();
+    CvCapture* cap = cvCaptureFromFile(byteArray.data());
+    if (! cap)
+        return false;
+    entry.probe.frameCount = cvGetCaptureProperty(cap, CV_CAP_PROP_FRAME_COUNT);
+    entry.probe.fps = cvGetCaptureProperty(cap, CV_CAP_PROP_FPS);
+    entry.probe.width = cvGetCaptureProperty(cap, CV_CAP_PROP_FRAME_WIDTH);
+    entry.probe.height = cvGetCaptureProperty(cap, CV_CAP_PROP_FRAME_HEIGHT);
+    cvReleaseCapture(&cap);
+    entry.hasProbe = true;
+    result = entry.probe;
+    store(entry);
+    return true;
+}
+
+bool VideoCache::backgroundPalette(QString videoPath, Mat& palette) {
+    Entry entry;
+    if (! load(videoPath, entry) || entry.backgroundPalette.empty())
+        return false;
+    palette = entry.backgroundPalette;
+    return true;
+}
+
+void VideoCache::storeBackgroundPalette(QString videoPath, Mat palette) {
+    Entry entry;
+    //Keeps the probe of an existing entry.
+    load(videoPath, entry);
+    entry.backgroundPalette = palette.clone();
+    store(entry);
+}
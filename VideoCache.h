@@ -0,0 +1,80 @@
+#ifndef VIDEOCACHE_H
+#define VIDEOCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include "opencv/highgui.h"
+
+using namespace cv;
+
+//What opening the container tells about a video.
+struct VideoProbe {
+    int frameCount;
+    double fps;
+    int width;
+    int height;
+};
+
+/*
+ * Results that only depend on a video file, kept across runs in a cache directory so
+ * reopening a video skips the work: the container probe and the background palette
+ * ProcessingThread::findBackgroundColors() computes on the first frame.
+ *
+ * Entries are keyed by a hash of the file size and three sampled 64 KB chunks (start,
+ * middle, end), so a renamed or copied video still hits and a modified one misses even
+ * under the same name. Each entry is a small QDataStream file validated on read (magic,
+ * version, key, size); invalid entries are deleted. The directory is kept under maxBytes
+ * by removing the least recently used entries.
+ * Thread safe. Entries are replaced atomically, concurrent writers of the same entry may
+ * lose one of the updates, which only costs recomputing it.
+ */
+class VideoCache
+{
+public:
+    VideoCache(QString directory = defaultDirectory());
+
+    static QString defaultDirectory();
+    void setMaxBytes(qint64 bytes);
+
+    //Cached probe of the video, or opens the container and caches it. False if it cannot be opened.
+    bool probe(QString videoPath, VideoProbe& result);
+    //False on a miss.
+    bool backgroundPalette(QString videoPath, Mat& palette);
+    void storeBackgroundPalette(QString videoPath, Mat palette);
+
+    //Hash of the sampled content, empty if the file cannot be read.
+    static QByteArray contentKey(QString videoPath);
+
+    static const int SAMPLE_SIZE = 64 << 10;
+    static const qint64 DEFAULT_MAX_BYTES = 16 << 20;
+private:
+    struct Entry {
+        QByteArray key;
+        qint64 fileSize;
+        bool hasProbe;
+        VideoProbe probe;
+        //Empty if not computed yet.
+        Mat backgroundPalette;
+
+        Entry() : fileSize(0), hasProbe(false) {}
+    };
+
+    QString directory;
+    qint64 maxBytes;
+    QMutex mutex;
+    //Keys of the videos seen so far, by path, with the size they had.
+    QHash<QString, QPair<qint64, QByteArray> > keys;
+
+    QByteArray keyFor(QString videoPath, qint64& fileSize);
+    QString entryPath(const QByteArray& key);
+    //Reads the entry of the video into entry. False on a miss.
+    bool load(QString videoPath, Entry& entry);
+    void store(const Entry& entry);
+    //Removes the least recently used entries until the directory fits in maxBytes.
+    void trim();
+};
+
+#endif // VIDEOCACHE_H
@@ -1,5 +1,7 @@
 #include "VideoFrame.h"
 #include <QDebug>
+#include "Timeline.h"
+#include <QStyle>
 
 VideoFrame::VideoFrame(QWidget *parent) : QLabel(parent)
 {
@@ -17,6 +19,78 @@ void VideoFrame::mousePressEvent(QMouseEvent *ev) {
     emit onMousePressEvent(ev);
 }
 
+void VideoFrame::setFrame(const QImage &frame) {
+    QSize oldSize = framePixmap.size();
+    framePixmap = QPixmap::fromImage(frame);
+    //A new frame changes every pixel, unless the geometry moved there is nothing to save.
+    if (oldSize != framePixmap.size())
+        update();
+    else
+        updateFrameRect(framePixmap.rect());
+}
+
+void VideoFrame::setOverlay(const SubjectOverlay &overlay) {
+    QRect oldBounds = overlayBounds;
+
+    //Record the layer once, paintEvent only replays it.
+    overlayPicture = QPicture();
+    QPainter painter(&overlayPicture);
+    painter.setPen(Qt::magenta);
+    painter.drawLines(overlay.trails);
+    painter.setPen(Qt::darkCyan);
+    painter.drawRects(overlay.boxes);
+    painter.setPen(Qt::yellow);
+    painter.drawLines(overlay.headings);
+    painter.end();
+
+    //Pen width and antialiasing can spill a pixel outside the recorded bounds.
+    overlayBounds = overlayPicture.boundingRect().adjusted(-1, -1, 1, 1);
+    if (overlay.boxes.isEmpty() && overlay.headings.isEmpty() && overlay.trails.isEmpty())
+        overlayBounds = QRect();
+
+    updateFrameRect(oldBounds | overlayBounds);
+}
+
+void VideoFrame::setSelectionBox(const QRect &box) {
+    QRect oldBox = selectionBox;
+    selectionBox = box;
+    //Only the strips around the old and new rubber-band are repainted.
+    updateFrameRect(oldBox.normalized().adjusted(-1, -1, 1, 1) |
+                    selectionBox.normalized().adjusted(-1, -1, 1, 1));
+}
+
+QPoint VideoFrame::frameOrigin() const {
+    //Same placement QLabel uses for its pixmap.
+    return QStyle::alignedRect(layoutDirection(), alignment(), framePixmap.size(), contentsRect()).topLeft();
+}
+
+void VideoFrame::updateFrameRect(const QRect &rect) {
+    if (rect.isEmpty())
+        return;
+    update(rect.translated(frameOrigin()));
+}
+
 void VideoFrame::paintEvent(QPaintEvent *ev) {
-    QLabel::paintEvent(ev);
+    Timeline::Span span("paint");
+    if (framePixmap.isNull()) {
+        QLabel::paintEvent(ev);
+        return;
+    }
+
+    QPoint origin = frameOrigin();
+    //Dirty region in frame coordinates.
+    QRect dirty = ev->rect().translated(-origin) & framePixmap.rect();
+
+    QPainter painter(this);
+    if (!dirty.isEmpty())
+        painter.drawPixmap(dirty.topLeft() + origin, framePixmap, dirty);
+
+    painter.translate(origin);
+    painter.setClipRect(dirty);
+    if (!overlayBounds.isEmpty() && overlayBounds.intersects(dirty))
+        painter.drawPicture(0, 0, overlayPicture);
+    if (!selectionBox.isNull()) {
+        painter.setPen(Qt::cyan);
+        painter.drawRect(selectionBox);
+    }
 }
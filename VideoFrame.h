@@ -4,13 +4,33 @@
 #include "Structures.h"
 #include <QTGui>
 #include <QLabel>
+#include <QPicture>
 
 class VideoFrame : public QLabel
 {
     Q_OBJECT
 public:
     VideoFrame(QWidget *parent = 0);
+public slots:
+    //Replaces the displayed frame; the overlay layers are kept.
+    void setFrame(const QImage &frame);
+    //Replaces the retained subject layer (boxes and headings).
+    void setOverlay(const SubjectOverlay &overlay);
+    //Moves the selection rubber-band, an empty rect hides it.
+    void setSelectionBox(const QRect &box);
 private:
+    //Last frame, uploaded once per frame.
+    QPixmap framePixmap;
+    //Recorded subject layer, replayed on every paint.
+    QPicture overlayPicture;
+    //Frame coordinates covered by the subject layer.
+    QRect overlayBounds;
+    //Selection rubber-band in frame coordinates.
+    QRect selectionBox;
+    //Top left corner of the frame inside the widget.
+    QPoint frameOrigin() const;
+    //Schedules a repaint of a region given in frame coordinates.
+    void updateFrameRect(const QRect &rect);
 protected:
     void mouseMoveEvent(QMouseEvent *ev);
     void mousePressEvent(QMouseEvent *ev);